@@ -32,6 +32,9 @@ typedef double GLdouble;
 typedef double GLclampd;
 typedef long GLsizeiptr;
 typedef long GLintptr;
+typedef long long GLint64;
+typedef unsigned long long GLuint64;
+typedef struct __GLsync *GLsync;
 
 /* Boolean values */
 #define GL_FALSE 0
@@ -254,6 +257,15 @@ typedef long GLintptr;
 #define GL_COMPILE             0x1300
 #define GL_COMPILE_AND_EXECUTE 0x1301
 
+/* Sync objects (OpenGL 3.2 / ARB_sync) */
+#define GL_SYNC_GPU_COMMANDS_COMPLETE 0x9117
+#define GL_ALREADY_SIGNALED           0x911A
+#define GL_TIMEOUT_EXPIRED            0x911B
+#define GL_CONDITION_SATISFIED        0x911C
+#define GL_WAIT_FAILED                0x911D
+#define GL_SYNC_FLUSH_COMMANDS_BIT    0x00000001
+#define GL_TIMEOUT_IGNORED            0xFFFFFFFFFFFFFFFFull
+
 /* Errors */
 #define GL_NO_ERROR          0
 #define GL_INVALID_ENUM      0x0500
@@ -606,6 +618,13 @@ void glBindBuffer(GLenum target, GLuint buffer);
 void glBufferData(GLenum target, GLsizeiptr size, const GLvoid *data, GLenum usage);
 void glBufferSubData(GLenum target, GLintptr offset, GLsizeiptr size, const GLvoid *data);
 
+/* Sync objects (OpenGL 3.2 / ARB_sync) */
+GLsync glFenceSync(GLenum condition, GLbitfield flags);
+GLboolean glIsSync(GLsync sync);
+void glDeleteSync(GLsync sync);
+GLenum glClientWaitSync(GLsync sync, GLbitfield flags, GLuint64 timeout);
+void glWaitSync(GLsync sync, GLbitfield flags, GLuint64 timeout);
+
 /* Vertex arrays */
 void glEnableClientState(GLenum array);
 void glDisableClientState(GLenum array);
@@ -652,6 +671,7 @@ void glTexEnvi(GLenum target, GLenum pname, GLint param);
 void glTexEnvf(GLenum target, GLenum pname, GLfloat param);
 void glTexEnvfv(GLenum target, GLenum pname, const GLfloat *params);
 GLboolean glIsTexture(GLuint texture);
+GLboolean glAreTexturesResident(GLsizei n, const GLuint *textures, GLboolean *residences);
 GLboolean glIsBuffer(GLuint buffer);
 
 /* Light/Material queries */
@@ -5,12 +5,28 @@
  * SPDX-License-Identifier: MIT
  *
  * sdl.h - SDL2 integration helpers
+ *
+ * By default (MTGL_DEFAULT_SWAP_BUFFERS = 1) mtgl_swap waits for the frame and
+ * presents it, and the color buffer keeps its contents.
+ *
+ * MTGL_SWAP_BUFFERS=n with n = 2 or 3 opts in to pipelined presentation. The
+ * context runs in async mode (see queue.h), so its render thread and tile
+ * workers rasterize while the application thread goes on, and each frame
+ * renders into the next of n color buffers. mtgl_swap fences the frame and
+ * switches buffers without waiting for it. It then presents the oldest frame
+ * in flight once its fence has signaled, so frame N is presented while frame
+ * N + 1 rasterizes. At most n - 1 frames are in flight. All SDL calls stay on
+ * the thread that called mtgl_init, since SDL's render API is not thread-safe.
+ * As with any swap chain, the color buffer contents are undefined after
+ * mtgl_swap: clear them at the start of each frame.
  */
 
 #ifndef MYTINYGL_SDL_H
 #define MYTINYGL_SDL_H
 
 #include <SDL2/SDL.h>
+#include <stdlib.h>
+#include <string.h>
 #include "../../src/mytinygl.h"
 
 static SDL_Window *mtgl_window = NULL;
@@ -18,6 +34,109 @@ static SDL_Renderer *mtgl_renderer = NULL;
 static SDL_Texture *mtgl_texture = NULL;
 static GLState *mtgl_ctx = NULL;
 
+#define MTGL_MAX_SWAP_BUFFERS 3
+#ifndef MTGL_DEFAULT_SWAP_BUFFERS
+#define MTGL_DEFAULT_SWAP_BUFFERS 1
+#endif
+
+/* Swap chain: buffers[0] is the context's own color buffer */
+static struct {
+    pixel_t *buffers[MTGL_MAX_SWAP_BUFFERS];
+    int count;                  /* Color buffers (1 = present from mtgl_swap) */
+    int drawing;                /* Buffer the context renders to */
+    int queue[MTGL_MAX_SWAP_BUFFERS];       /* Frames in flight, oldest first */
+    GLsync fences[MTGL_MAX_SWAP_BUFFERS];   /* Signaled when the frame is rasterized */
+    int queued;
+} mtgl_chain = { 0 };
+
+static inline int mtgl_create_renderer(int32_t width, int32_t height)
+{
+    mtgl_renderer = SDL_CreateRenderer(mtgl_window, -1, SDL_RENDERER_ACCELERATED | SDL_RENDERER_PRESENTVSYNC);
+    if (!mtgl_renderer) {
+        return -1;
+    }
+
+    mtgl_texture = SDL_CreateTexture(
+        mtgl_renderer,
+        SDL_PIXELFORMAT_ABGR8888,
+        SDL_TEXTUREACCESS_STREAMING,
+        width,
+        height
+    );
+    if (!mtgl_texture) {
+        SDL_DestroyRenderer(mtgl_renderer);
+        mtgl_renderer = NULL;
+        return -1;
+    }
+    return 0;
+}
+
+static inline void mtgl_present(const pixel_t *pixels, int pitch)
+{
+    SDL_UpdateTexture(mtgl_texture, NULL, pixels, pitch);
+    SDL_RenderCopy(mtgl_renderer, mtgl_texture, NULL, NULL);
+    SDL_RenderPresent(mtgl_renderer);
+}
+
+/* Wait for the oldest frame in flight and present it */
+static inline void mtgl_chain_present_oldest(void)
+{
+    int buffer = mtgl_chain.queue[0];
+    GLsync fence = mtgl_chain.fences[0];
+    for (int i = 1; i < mtgl_chain.queued; i++) {
+        mtgl_chain.queue[i - 1] = mtgl_chain.queue[i];
+        mtgl_chain.fences[i - 1] = mtgl_chain.fences[i];
+    }
+    mtgl_chain.queued--;
+
+    if (fence) {
+        glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, GL_TIMEOUT_IGNORED);
+        glDeleteSync(fence);
+    } else {
+        glFinish();     /* No fence (out of memory) */
+    }
+    mtgl_present(mtgl_chain.buffers[buffer], framebuffer_get_pitch(&mtgl_ctx->framebuffer));
+}
+
+/* Present the frames in flight and give the context its own color buffer back */
+static inline void mtgl_chain_destroy(void)
+{
+    while (mtgl_chain.queued > 0) {
+        mtgl_chain_present_oldest();
+    }
+    if (mtgl_ctx && mtgl_chain.buffers[0]) {
+        gl_set_color_buffer(mtgl_ctx, mtgl_chain.buffers[0]);
+        glFinish();
+    }
+    for (int i = 1; i < mtgl_chain.count; i++) {
+        mtgl_free(mtgl_chain.buffers[i]);
+    }
+    memset(&mtgl_chain, 0, sizeof(mtgl_chain));
+}
+
+/* Set up count color buffers in async mode; returns 0 if frames are pipelined.
+ * The context must be current. */
+static inline int mtgl_chain_create(int count)
+{
+    framebuffer_t *fb = &mtgl_ctx->framebuffer;
+    size_t size = (size_t)fb->width * fb->height * sizeof(pixel_t);
+
+    if (count > MTGL_MAX_SWAP_BUFFERS) count = MTGL_MAX_SWAP_BUFFERS;
+    if (gl_set_async(mtgl_ctx, 1) != 0) return -1;
+    mtgl_chain.buffers[0] = fb->color;
+    mtgl_chain.count = 1;
+    for (int i = 1; i < count; i++) {
+        mtgl_chain.buffers[i] = (pixel_t *)mtgl_alloc(size);
+        if (!mtgl_chain.buffers[i]) break;
+        mtgl_chain.count++;
+    }
+    if (mtgl_chain.count < 2) {
+        mtgl_chain_destroy();
+        return -1;
+    }
+    return 0;
+}
+
 static inline int mtgl_init(const char *title, int32_t width, int32_t height)
 {
     if (SDL_Init(SDL_INIT_VIDEO) < 0) {
@@ -37,57 +156,109 @@ static inline int mtgl_init(const char *title, int32_t width, int32_t height)
         return -1;
     }
 
-    mtgl_renderer = SDL_CreateRenderer(mtgl_window, -1, SDL_RENDERER_ACCELERATED | SDL_RENDERER_PRESENTVSYNC);
-    if (!mtgl_renderer) {
+    mtgl_ctx = gl_create_context(width, height);
+    if (!mtgl_ctx) {
         SDL_DestroyWindow(mtgl_window);
         SDL_Quit();
         return -1;
     }
 
-    mtgl_texture = SDL_CreateTexture(
-        mtgl_renderer,
-        SDL_PIXELFORMAT_ABGR8888,
-        SDL_TEXTUREACCESS_STREAMING,
-        width,
-        height
-    );
-    if (!mtgl_texture) {
-        SDL_DestroyRenderer(mtgl_renderer);
+    if (mtgl_create_renderer(width, height) != 0) {
+        gl_destroy_context(mtgl_ctx);
         SDL_DestroyWindow(mtgl_window);
         SDL_Quit();
         return -1;
     }
 
-    mtgl_ctx = gl_create_context(width, height);
-    if (!mtgl_ctx) {
-        SDL_DestroyTexture(mtgl_texture);
-        SDL_DestroyRenderer(mtgl_renderer);
-        SDL_DestroyWindow(mtgl_window);
-        SDL_Quit();
-        return -1;
+    /* MTGL_THREADS=n rasterizes with n threads */
+    const char *threads = getenv("MTGL_THREADS");
+    if (threads) {
+        gl_set_render_threads(mtgl_ctx, atoi(threads));
+    }
+
+    /* MTGL_AFFINITY=1 pins the render threads to CPUs */
+    const char *affinity = getenv("MTGL_AFFINITY");
+    if (affinity && atoi(affinity)) {
+        gl_set_render_affinity(mtgl_ctx, 1);
+    }
+
+    /* MTGL_UPLOAD_THREADS=n converts textures on n background threads */
+    const char *upload_threads = getenv("MTGL_UPLOAD_THREADS");
+    if (upload_threads) {
+        gl_set_texture_upload_threads(mtgl_ctx, atoi(upload_threads));
     }
 
     gl_make_current(mtgl_ctx);
+
+    /* MTGL_ASYNC=1 executes GL commands on a render thread */
+    const char *async = getenv("MTGL_ASYNC");
+    if (async && atoi(async)) {
+        gl_set_async(mtgl_ctx, 1);
+    }
+
+    /* MTGL_SWAP_BUFFERS=n >= 2 pipelines frames through n color buffers (in async mode) */
+    int swap_buffers = MTGL_DEFAULT_SWAP_BUFFERS;
+    const char *swap = getenv("MTGL_SWAP_BUFFERS");
+    if (swap) {
+        swap_buffers = atoi(swap);
+    }
+    if (swap_buffers >= 2) {
+        mtgl_chain_create(swap_buffers);
+    }
+
+    /* MTGL_NUMA=1 keeps each tile and its framebuffer pages on one render thread's node */
+    const char *numa = getenv("MTGL_NUMA");
+    if (numa && atoi(numa) && gl_set_render_numa(mtgl_ctx, 1) == 0) {
+        for (int i = 1; i < mtgl_chain.count; i++) {
+            gl_set_color_buffer(mtgl_ctx, mtgl_chain.buffers[i]);
+            gl_set_render_numa(mtgl_ctx, 1);
+        }
+        if (mtgl_chain.count > 1) {
+            gl_set_color_buffer(mtgl_ctx, mtgl_chain.buffers[mtgl_chain.drawing]);
+        }
+    }
     return 0;
 }
 
 static inline void mtgl_swap(void)
 {
-    SDL_UpdateTexture(
-        mtgl_texture,
-        NULL,
-        framebuffer_get_color_buffer(&mtgl_ctx->framebuffer),
-        framebuffer_get_pitch(&mtgl_ctx->framebuffer)
-    );
-    SDL_RenderCopy(mtgl_renderer, mtgl_texture, NULL, NULL);
-    SDL_RenderPresent(mtgl_renderer);
+    if (mtgl_chain.count < 2) {
+        glFinish();
+        mtgl_present(
+            framebuffer_get_color_buffer(&mtgl_ctx->framebuffer),
+            framebuffer_get_pitch(&mtgl_ctx->framebuffer)
+        );
+        return;
+    }
+
+    /* Fence the frame; creating the fence hands it to the render thread */
+    mtgl_chain.queue[mtgl_chain.queued] = mtgl_chain.drawing;
+    mtgl_chain.fences[mtgl_chain.queued++] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+
+    /* Present older frames while this one rasterizes, until a buffer is free */
+    while (mtgl_chain.queued > mtgl_chain.count - 1) {
+        mtgl_chain_present_oldest();
+    }
+
+    /* Render the next frame into a buffer that is not in flight */
+    int next = -1;
+    for (int i = 0; i < mtgl_chain.count && next < 0; i++) {
+        int busy = 0;
+        for (int j = 0; j < mtgl_chain.queued; j++) {
+            busy |= i == mtgl_chain.queue[j];
+        }
+        if (!busy) next = i;
+    }
+    mtgl_chain.drawing = next;
+    gl_set_color_buffer(mtgl_ctx, mtgl_chain.buffers[next]);
 }
 
 static inline void mtgl_destroy(void)
 {
-    gl_destroy_context(mtgl_ctx);
+    mtgl_chain_destroy();
     SDL_DestroyTexture(mtgl_texture);
     SDL_DestroyRenderer(mtgl_renderer);
+    gl_destroy_context(mtgl_ctx);
     SDL_DestroyWindow(mtgl_window);
     SDL_Quit();
 }
@@ -0,0 +1,139 @@
+/*
+ * MyTinyGL - OpenGL 1.x Fixed Function Pipeline
+ * arrays.c - Vertex array fetch
+ */
+
+#include "arrays.h"
+#include <math.h>
+
+#define FETCH_FLOAT(v) (v)
+#define FETCH_UBYTE(v) ((v) / 255.0f)
+
+/* Fetcher reading C components of type T; STRIDE is s->stride or a constant for
+ * tightly packed arrays of exactly C components */
+#define DEFINE_FETCH(name, T, C, STRIDE, CONVERT) \
+static void name(const array_stream_t *s, const uint32_t *idx, size_t n, float *const *out) \
+{ \
+    const uint8_t *base = s->base; \
+    size_t stride = (STRIDE); \
+    for (size_t k = 0; k < n; k++) { \
+        const T *src = (const T *)(base + (size_t)idx[k] * stride); \
+        for (int c = 0; c < (C); c++) out[c][k] = CONVERT(src[c]); \
+    } \
+}
+
+DEFINE_FETCH(fetch_float1, GLfloat, 1, s->stride, FETCH_FLOAT)
+DEFINE_FETCH(fetch_float2, GLfloat, 2, s->stride, FETCH_FLOAT)
+DEFINE_FETCH(fetch_float3, GLfloat, 3, s->stride, FETCH_FLOAT)
+DEFINE_FETCH(fetch_float4, GLfloat, 4, s->stride, FETCH_FLOAT)
+DEFINE_FETCH(fetch_float1_packed, GLfloat, 1, 1 * sizeof(GLfloat), FETCH_FLOAT)
+DEFINE_FETCH(fetch_float2_packed, GLfloat, 2, 2 * sizeof(GLfloat), FETCH_FLOAT)
+DEFINE_FETCH(fetch_float3_packed, GLfloat, 3, 3 * sizeof(GLfloat), FETCH_FLOAT)
+DEFINE_FETCH(fetch_float4_packed, GLfloat, 4, 4 * sizeof(GLfloat), FETCH_FLOAT)
+DEFINE_FETCH(fetch_ubyte1, GLubyte, 1, s->stride, FETCH_UBYTE)
+DEFINE_FETCH(fetch_ubyte2, GLubyte, 2, s->stride, FETCH_UBYTE)
+DEFINE_FETCH(fetch_ubyte3, GLubyte, 3, s->stride, FETCH_UBYTE)
+DEFINE_FETCH(fetch_ubyte4, GLubyte, 4, s->stride, FETCH_UBYTE)
+DEFINE_FETCH(fetch_ubyte1_packed, GLubyte, 1, 1 * sizeof(GLubyte), FETCH_UBYTE)
+DEFINE_FETCH(fetch_ubyte2_packed, GLubyte, 2, 2 * sizeof(GLubyte), FETCH_UBYTE)
+DEFINE_FETCH(fetch_ubyte3_packed, GLubyte, 3, 3 * sizeof(GLubyte), FETCH_UBYTE)
+DEFINE_FETCH(fetch_ubyte4_packed, GLubyte, 4, 4 * sizeof(GLubyte), FETCH_UBYTE)
+
+/* [ubyte][packed][components - 1] */
+static const array_fetch_func_t fetchers[2][2][4] = {
+    { { fetch_float1, fetch_float2, fetch_float3, fetch_float4 },
+      { fetch_float1_packed, fetch_float2_packed, fetch_float3_packed, fetch_float4_packed } },
+    { { fetch_ubyte1, fetch_ubyte2, fetch_ubyte3, fetch_ubyte4 },
+      { fetch_ubyte1_packed, fetch_ubyte2_packed, fetch_ubyte3_packed, fetch_ubyte4_packed } },
+};
+
+/* Set up the stream of one array feeding an attribute of max_components */
+static void stream_init(array_stream_t *s, const array_pointer_t *arr, const void *base, int max_components)
+{
+    if (!base) {
+        s->fetch = NULL;
+        s->components = 0;
+        return;
+    }
+
+    int ubyte = arr->type == GL_UNSIGNED_BYTE;
+    size_t packed_stride = (size_t)arr->size * (ubyte ? sizeof(GLubyte) : sizeof(GLfloat));
+    s->base = base;
+    s->stride = arr->stride ? (size_t)arr->stride : packed_stride;
+    s->components = arr->size < max_components ? arr->size : max_components;
+
+    /* The packed variants assume the stride of exactly the components read */
+    int packed = s->components == arr->size && s->stride == packed_stride;
+    s->fetch = fetchers[ubyte][packed][s->components - 1];
+}
+
+void array_fetch_init(array_fetch_t *f, const GLState *ctx, const void *vertex_base,
+                      const void *color_base, const void *texcoord_base, const void *normal_base)
+{
+    /* Arrays feeding attributes nothing reads are not fetched: texture coordinates
+     * without texturing, normals without lighting */
+    if (!(gl_vertex_live(ctx) & VERTEX_LIVE_TEXCOORD)) texcoord_base = NULL;
+    if (!(ctx->flags & FLAG_LIGHTING)) normal_base = NULL;
+
+    stream_init(&f->vertex, &ctx->vertex_pointer, vertex_base, 3);
+    stream_init(&f->color, &ctx->color_pointer, color_base, 4);
+    stream_init(&f->texcoord, &ctx->texcoord_pointer, texcoord_base, 2);
+    stream_init(&f->normal, &ctx->normal_pointer, normal_base, 3);
+    f->clamp_colors = color_base && ctx->color_pointer.type == GL_FLOAT;
+}
+
+/* Fill the columns from the first one the array does not provide: with the current
+ * value if it is disabled, otherwise with the defaults of missing components (0, w = 1) */
+static void fill_columns(float *const *cols, int count, int from, const float *current)
+{
+    for (int c = from; c < count; c++) {
+        float v = from == 0 ? current[c] : (c == 3 ? 1.0f : 0.0f);
+        for (size_t k = 0; k < VERTEX_BATCH_SIZE; k++) cols[c][k] = v;
+    }
+}
+
+void array_fetch_prepare(const array_fetch_t *f, const GLState *ctx, vertex_batch_t *b)
+{
+    const float position[3] = { 0.0f, 0.0f, 0.0f };
+    const float col[4] = { ctx->current_color.r, ctx->current_color.g,
+                           ctx->current_color.b, ctx->current_color.a };
+    const float tex[2] = { ctx->current_texcoord.x, ctx->current_texcoord.y };
+    const float normal[3] = { ctx->current_normal.x, ctx->current_normal.y, ctx->current_normal.z };
+
+    fill_columns((float *const[]){ b->x, b->y, b->z }, 3, f->vertex.components, position);
+    fill_columns((float *const[]){ b->r, b->g, b->b, b->a }, 4, f->color.components, col);
+    fill_columns((float *const[]){ b->s, b->t }, 2, f->texcoord.components, tex);
+    fill_columns((float *const[]){ b->nx, b->ny, b->nz }, 3, f->normal.components, normal);
+
+    /* Array vertices are specified like glVertex3f */
+    for (size_t k = 0; k < VERTEX_BATCH_SIZE; k++) b->w[k] = 1.0f;
+}
+
+/* glColor4f clamping: NaN/Inf become 0 (alpha 1), then [0, 1] */
+static inline float clamp_color(float v, float invalid)
+{
+    if (isnan(v) || isinf(v)) v = invalid;
+    return v < 0.0f ? 0.0f : (v > 1.0f ? 1.0f : v);
+}
+
+void array_fetch_batch(const array_fetch_t *f, const uint32_t *idx, size_t n, vertex_batch_t *b)
+{
+    f->vertex.fetch(&f->vertex, idx, n, (float *const[]){ b->x, b->y, b->z });
+    if (f->color.fetch) {
+        f->color.fetch(&f->color, idx, n, (float *const[]){ b->r, b->g, b->b, b->a });
+        if (f->clamp_colors) {
+            for (size_t k = 0; k < n; k++) {
+                b->r[k] = clamp_color(b->r[k], 0.0f);
+                b->g[k] = clamp_color(b->g[k], 0.0f);
+                b->b[k] = clamp_color(b->b[k], 0.0f);
+                b->a[k] = clamp_color(b->a[k], 1.0f);
+            }
+        }
+    }
+    if (f->texcoord.fetch) {
+        f->texcoord.fetch(&f->texcoord, idx, n, (float *const[]){ b->s, b->t });
+    }
+    if (f->normal.fetch) {
+        f->normal.fetch(&f->normal, idx, n, (float *const[]){ b->nx, b->ny, b->nz });
+    }
+}
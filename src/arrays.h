@@ -0,0 +1,57 @@
+/*
+ * MyTinyGL - OpenGL 1.x Software Renderer
+ * Copyright (c) 2025 zbufferoverflow (Eliezer Solinger)
+ * https://github.com/zbufferoverflow/MyTinyGL
+ * SPDX-License-Identifier: MIT
+ *
+ * arrays.h - Vertex array fetch
+ *
+ * glDrawArrays/glDrawElements read their arrays straight into vertex batches
+ * (see vertex.h) instead of going through glColor/glTexCoord/glNormal/glVertex.
+ * For each enabled array a fetcher specialized for its type, the number of
+ * components read and its stride (tightly packed or not) is chosen once per
+ * draw. Disabled arrays and components an array does not have are constant
+ * over the draw and written to the batch once.
+ */
+
+#ifndef MYTINYGL_ARRAYS_H
+#define MYTINYGL_ARRAYS_H
+
+#include "mytinygl.h"
+#include "vertex.h"
+
+typedef struct array_stream array_stream_t;
+
+/* Read n elements at the given indices into out[0..components) */
+typedef void (*array_fetch_func_t)(const array_stream_t *s, const uint32_t *idx, size_t n, float *const *out);
+
+/* One array of a draw */
+struct array_stream {
+    const uint8_t *base;
+    size_t stride;              /* Bytes between elements */
+    int components;             /* Components read (array size, at most the attribute's) */
+    array_fetch_func_t fetch;   /* NULL = array disabled, the current value is used */
+};
+
+typedef struct {
+    array_stream_t vertex;
+    array_stream_t color;
+    array_stream_t texcoord;
+    array_stream_t normal;
+    int clamp_colors;           /* Float colors: clamped like glColor4f */
+} array_fetch_t;
+
+/* Choose the fetchers of a draw from the array pointers of ctx; a NULL base means the
+ * array is disabled */
+void array_fetch_init(array_fetch_t *f, const GLState *ctx, const void *vertex_base,
+                      const void *color_base, const void *texcoord_base, const void *normal_base);
+
+/* Write the values that are constant over the draw (disabled arrays, missing components,
+ * w = 1) to a batch; array_fetch_batch leaves them in place */
+void array_fetch_prepare(const array_fetch_t *f, const GLState *ctx, vertex_batch_t *b);
+
+/* Fetch the elements at idx[0..n) (n <= VERTEX_BATCH_SIZE) into a prepared batch. Float
+ * colors are clamped to [0, 1] as glColor4f would. */
+void array_fetch_batch(const array_fetch_t *f, const uint32_t *idx, size_t n, vertex_batch_t *b);
+
+#endif /* MYTINYGL_ARRAYS_H */
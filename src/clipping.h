@@ -48,7 +48,7 @@ static inline void snap_to_plane(vertex_t *v, int plane_id)
 
 /* Clip polygon against a single plane using Sutherland-Hodgman algorithm */
 static inline int clip_polygon_plane_id(vertex_t *in, int in_count, vertex_t *out,
-                                        float (*plane_func)(vec4_t *), int plane_id)
+                                        float (*plane_func)(vec4_t *), int plane_id, uint32_t live)
 {
     if (in_count == 0) return 0;
 
@@ -70,7 +70,7 @@ static inline int clip_polygon_plane_id(vertex_t *in, int in_count, vertex_t *ou
                 float denom = prev_dist - curr_dist;
                 if (fabsf(denom) > 1e-10f) {
                     float t = prev_dist / denom;
-                    out[out_count] = vertex_lerp(prev, curr, t);
+                    out[out_count] = vertex_lerp(prev, curr, t, live);
                     snap_to_plane(&out[out_count], plane_id);
                     out_count++;
                 }
@@ -82,7 +82,7 @@ static inline int clip_polygon_plane_id(vertex_t *in, int in_count, vertex_t *ou
                 float denom = prev_dist - curr_dist;
                 if (fabsf(denom) > 1e-10f) {
                     float t = prev_dist / denom;
-                    out[out_count] = vertex_lerp(prev, curr, t);
+                    out[out_count] = vertex_lerp(prev, curr, t, live);
                     snap_to_plane(&out[out_count], plane_id);
                     out_count++;
                 }
@@ -102,25 +102,26 @@ static inline int clip_polygon_plane_id(vertex_t *in, int in_count, vertex_t *ou
  * Input: triangle (3 vertices in clip space)
  * Output: clipped polygon vertices (up to MAX_CLIP_VERTS)
  * Returns: number of output vertices (0 if fully clipped)
+ * Only the live attributes (VERTEX_LIVE_*) are interpolated.
  */
-static inline int clip_triangle(vertex_t *triangle, vertex_t *out)
+static inline int clip_triangle(vertex_t *triangle, vertex_t *out, uint32_t live)
 {
     vertex_t temp1[MAX_CLIP_VERTS];
     vertex_t temp2[MAX_CLIP_VERTS];
     int count;
 
     /* Clip against each plane in sequence */
-    count = clip_polygon_plane_id(triangle, 3, temp1, clip_near, PLANE_NEAR);
+    count = clip_polygon_plane_id(triangle, 3, temp1, clip_near, PLANE_NEAR, live);
     if (count == 0) return 0;
-    count = clip_polygon_plane_id(temp1, count, temp2, clip_far, PLANE_FAR);
+    count = clip_polygon_plane_id(temp1, count, temp2, clip_far, PLANE_FAR, live);
     if (count == 0) return 0;
-    count = clip_polygon_plane_id(temp2, count, temp1, clip_left, PLANE_LEFT);
+    count = clip_polygon_plane_id(temp2, count, temp1, clip_left, PLANE_LEFT, live);
     if (count == 0) return 0;
-    count = clip_polygon_plane_id(temp1, count, temp2, clip_right, PLANE_RIGHT);
+    count = clip_polygon_plane_id(temp1, count, temp2, clip_right, PLANE_RIGHT, live);
     if (count == 0) return 0;
-    count = clip_polygon_plane_id(temp2, count, temp1, clip_bottom, PLANE_BOTTOM);
+    count = clip_polygon_plane_id(temp2, count, temp1, clip_bottom, PLANE_BOTTOM, live);
     if (count == 0) return 0;
-    count = clip_polygon_plane_id(temp1, count, out, clip_top, PLANE_TOP);
+    count = clip_polygon_plane_id(temp1, count, out, clip_top, PLANE_TOP, live);
 
     return count;
 }
@@ -148,8 +149,8 @@ static inline int compute_outcode(vec4_t *v)
 }
 
 /* Clip line segment against frustum. Returns 1 if visible, 0 if fully clipped.
- * Modifies v0 and v1 in place with clipped vertices. */
-static inline int clip_line(vertex_t *v0, vertex_t *v1)
+ * Modifies v0 and v1 in place with clipped vertices (live attributes interpolated). */
+static inline int clip_line(vertex_t *v0, vertex_t *v1, uint32_t live)
 {
     int code0 = compute_outcode(&v0->position);
     int code1 = compute_outcode(&v1->position);
@@ -215,7 +216,7 @@ static inline int clip_line(vertex_t *v0, vertex_t *v1)
         t = d0 / denom;
 
         /* Compute interpolated vertex and snap to plane */
-        vertex_t clipped = vertex_lerp(v0, v1, t);
+        vertex_t clipped = vertex_lerp(v0, v1, t, live);
         snap_to_plane(&clipped, plane_id);
 
         if (code_out == code0) {
@@ -13,17 +13,32 @@
 #include "graphics.h"
 #include "allocation.h"
 #include <stddef.h>
+#include <float.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
 
 typedef uint32_t pixel_t;
 
+/* Hierarchical Z tile size (HiZ keeps one conservative max depth per tile) */
+#define FB_HIZ_TILE_SHIFT 3
+#define FB_HIZ_TILE_SIZE  (1 << FB_HIZ_TILE_SHIFT)
+
 typedef struct {
     int32_t width;
     int32_t height;
     pixel_t *color;
     float *depth;
     uint8_t *stencil;
+    float *hiz;             /* Per-tile upper bound of the depth values (never below the true max) */
+    int32_t hiz_width;      /* Tiles per row */
+    int32_t hiz_height;     /* Tile rows */
 } framebuffer_t;
 
+/* Clears of more bytes than this bypass the cache (non-temporal stores): the lines
+ * would only evict data for values that are overwritten before they are read */
+#define FB_STREAM_CLEAR_BYTES (4u << 20)
+
 /* Framebuffer management */
 
 /* Maximum framebuffer dimension to prevent integer overflow */
@@ -44,16 +59,26 @@ static inline int framebuffer_init(framebuffer_t *fb, int32_t width, int32_t hei
     fb->color = (pixel_t *)mtgl_alloc(pixel_count * sizeof(pixel_t));
     fb->depth = (float *)mtgl_alloc(pixel_count * sizeof(float));
     fb->stencil = (uint8_t *)mtgl_alloc(pixel_count * sizeof(uint8_t));
+    fb->hiz_width = (width + FB_HIZ_TILE_SIZE - 1) >> FB_HIZ_TILE_SHIFT;
+    fb->hiz_height = (height + FB_HIZ_TILE_SIZE - 1) >> FB_HIZ_TILE_SHIFT;
+    fb->hiz = (float *)mtgl_alloc((size_t)fb->hiz_width * fb->hiz_height * sizeof(float));
 
-    if (!fb->color || !fb->depth || !fb->stencil) {
+    if (!fb->color || !fb->depth || !fb->stencil || !fb->hiz) {
         mtgl_free(fb->color);
         mtgl_free(fb->depth);
         mtgl_free(fb->stencil);
+        mtgl_free(fb->hiz);
         fb->color = NULL;
         fb->depth = NULL;
         fb->stencil = NULL;
+        fb->hiz = NULL;
         return -1;
     }
+
+    /* Depth contents are undefined until the first clear */
+    for (int32_t i = 0; i < fb->hiz_width * fb->hiz_height; i++) {
+        fb->hiz[i] = FLT_MAX;
+    }
     return 0;
 }
 
@@ -61,9 +86,11 @@ static inline void framebuffer_free(framebuffer_t *fb) {
     mtgl_free(fb->color);
     mtgl_free(fb->depth);
     mtgl_free(fb->stencil);
+    mtgl_free(fb->hiz);
     fb->color = NULL;
     fb->depth = NULL;
     fb->stencil = NULL;
+    fb->hiz = NULL;
 }
 
 static inline void framebuffer_clear_color(framebuffer_t *fb, color_t c) {
@@ -79,6 +106,112 @@ static inline void framebuffer_clear_depth(framebuffer_t *fb, float depth) {
     for (int32_t i = 0; i < size; i++) {
         fb->depth[i] = depth;
     }
+    for (int32_t i = 0; i < fb->hiz_width * fb->hiz_height; i++) {
+        fb->hiz[i] = depth;
+    }
+}
+
+/* Set count 32-bit values (pixels or depths), with non-temporal stores if stream */
+static inline void framebuffer_fill32(void *dst, uint32_t value, size_t count, int stream) {
+    uint32_t *p = (uint32_t *)dst;
+#ifdef __SSE2__
+    if (stream) {
+        while (count > 0 && ((uintptr_t)p & 15)) {
+            *p++ = value;
+            count--;
+        }
+        __m128i v = _mm_set1_epi32((int)value);
+        for (; count >= 16; count -= 16, p += 16) {
+            _mm_stream_si128((__m128i *)p, v);
+            _mm_stream_si128((__m128i *)(p + 4), v);
+            _mm_stream_si128((__m128i *)(p + 8), v);
+            _mm_stream_si128((__m128i *)(p + 12), v);
+        }
+        for (; count >= 4; count -= 4, p += 4) {
+            _mm_stream_si128((__m128i *)p, v);
+        }
+        _mm_sfence();
+    }
+#else
+    (void)stream;
+#endif
+    for (size_t i = 0; i < count; i++) {
+        p[i] = value;
+    }
+}
+
+/* Clear color in [x0, x1) x [y0, y1) (already clamped to the framebuffer) */
+static inline void framebuffer_clear_color_rect(framebuffer_t *fb, int32_t x0, int32_t y0,
+                                                int32_t x1, int32_t y1, pixel_t pixel, int stream) {
+    if (x0 >= x1 || y0 >= y1) return;
+    if (x0 == 0 && x1 == fb->width) {
+        framebuffer_fill32(fb->color + (size_t)y0 * fb->width, pixel, (size_t)(y1 - y0) * fb->width, stream);
+        return;
+    }
+    for (int32_t y = y0; y < y1; y++) {
+        framebuffer_fill32(fb->color + (size_t)y * fb->width + x0, pixel, (size_t)(x1 - x0), stream);
+    }
+}
+
+/* Clear stencil in [x0, x1) x [y0, y1) (already clamped to the framebuffer) */
+static inline void framebuffer_clear_stencil_rect(framebuffer_t *fb, int32_t x0, int32_t y0,
+                                                  int32_t x1, int32_t y1, uint8_t value) {
+    if (x0 >= x1 || y0 >= y1) return;
+    if (x0 == 0 && x1 == fb->width) {
+        memset(fb->stencil + (size_t)y0 * fb->width, value, (size_t)(y1 - y0) * fb->width);
+        return;
+    }
+    for (int32_t y = y0; y < y1; y++) {
+        memset(fb->stencil + (size_t)y * fb->width + x0, value, (size_t)(x1 - x0));
+    }
+}
+
+/* Clear depth in [x0, x1) x [y0, y1) (already clamped to the framebuffer) */
+static inline void framebuffer_clear_depth_rect(framebuffer_t *fb, int32_t x0, int32_t y0,
+                                                int32_t x1, int32_t y1, float depth, int stream) {
+    if (x0 >= x1 || y0 >= y1) return;
+    uint32_t bits;
+    memcpy(&bits, &depth, sizeof(bits));
+    if (x0 == 0 && x1 == fb->width) {
+        framebuffer_fill32(fb->depth + (size_t)y0 * fb->width, bits, (size_t)(y1 - y0) * fb->width, stream);
+    } else {
+        for (int32_t y = y0; y < y1; y++) {
+            framebuffer_fill32(fb->depth + (size_t)y * fb->width + x0, bits, (size_t)(x1 - x0), stream);
+        }
+    }
+
+    /* Tiles entirely inside the rect take the clear value, partially cleared ones
+     * can only be raised */
+    for (int32_t ty = y0 >> FB_HIZ_TILE_SHIFT; ty <= (y1 - 1) >> FB_HIZ_TILE_SHIFT; ty++) {
+        int32_t ty0 = ty << FB_HIZ_TILE_SHIFT, ty1 = ty0 + FB_HIZ_TILE_SIZE;
+        if (ty1 > fb->height) ty1 = fb->height;
+        for (int32_t tx = x0 >> FB_HIZ_TILE_SHIFT; tx <= (x1 - 1) >> FB_HIZ_TILE_SHIFT; tx++) {
+            int32_t tx0 = tx << FB_HIZ_TILE_SHIFT, tx1 = tx0 + FB_HIZ_TILE_SIZE;
+            if (tx1 > fb->width) tx1 = fb->width;
+            float *h = &fb->hiz[ty * fb->hiz_width + tx];
+            if (tx0 >= x0 && tx1 <= x1 && ty0 >= y0 && ty1 <= y1) {
+                *h = depth;
+            } else if (depth > *h) {
+                *h = depth;
+            }
+        }
+    }
+}
+
+/* Recompute the exact max depth of HiZ tile (tx, ty) */
+static inline void framebuffer_hiz_update_tile(framebuffer_t *fb, int32_t tx, int32_t ty) {
+    int32_t x0 = tx << FB_HIZ_TILE_SHIFT, y0 = ty << FB_HIZ_TILE_SHIFT;
+    int32_t x1 = x0 + FB_HIZ_TILE_SIZE, y1 = y0 + FB_HIZ_TILE_SIZE;
+    if (x1 > fb->width) x1 = fb->width;
+    if (y1 > fb->height) y1 = fb->height;
+    float max_depth = -FLT_MAX;
+    for (int32_t y = y0; y < y1; y++) {
+        const float *row = fb->depth + (size_t)y * fb->width;
+        for (int32_t x = x0; x < x1; x++) {
+            max_depth = row[x] > max_depth ? row[x] : max_depth;
+        }
+    }
+    fb->hiz[ty * fb->hiz_width + tx] = max_depth;
 }
 
 static inline void framebuffer_clear_stencil(framebuffer_t *fb, uint8_t value) {
@@ -109,6 +242,10 @@ static inline void framebuffer_putdepth(framebuffer_t *fb, int32_t x, int32_t y,
     if (x < 0 || x >= fb->width || y < 0 || y >= fb->height) return;
 #endif
     fb->depth[y * fb->width + x] = d;
+
+    /* Keep the HiZ tile an upper bound */
+    float *h = &fb->hiz[(y >> FB_HIZ_TILE_SHIFT) * fb->hiz_width + (x >> FB_HIZ_TILE_SHIFT)];
+    if (d > *h) *h = d;
 }
 
 static inline float framebuffer_getdepth(framebuffer_t *fb, int32_t x, int32_t y) {
@@ -8,29 +8,34 @@
 #include "mytinygl.h"
 #include "lighting.h"
 #include "allocation.h"
+#include "tiles.h"
+#include "workers.h"
+#include "queue.h"
+#include "share.h"
+#include "upload.h"
+#include "vertex.h"
+#include "arrays.h"
+#include <stddef.h>
 #include <string.h>
 #include <math.h>
 
 /* Thread-local context pointer for multi-threaded safety */
-#if defined(_MSC_VER)
-    #define THREAD_LOCAL __declspec(thread)
-#elif defined(__GNUC__) || defined(__clang__)
-    #define THREAD_LOCAL __thread
-#else
-    #define THREAD_LOCAL  /* Fallback: not thread-safe */
-#endif
-
 static THREAD_LOCAL GLState *ctx = NULL;
 
-/* Macro for early return if no context is set */
-#define CHECK_CTX() do { if (!ctx) return; } while(0)
-#define CHECK_CTX_RET(val) do { if (!ctx) return (val); } while(0)
+/* Macro for early return if no context is set. In async mode it also waits until the
+ * render thread has executed every queued command, so the state can be used directly. */
+#define CHECK_CTX() do { if (!ctx) return; queue_sync(ctx); } while(0)
+#define CHECK_CTX_RET(val) do { if (!ctx) return (val); queue_sync(ctx); } while(0)
+
+/* For commands that can be recorded (display lists, async queue): no wait */
+#define CHECK_CTX_RECORD() do { if (!ctx) return; } while(0)
 
-/* Error handling - only set if no error already recorded */
+/* Error handling - only set if no error already recorded. Atomic, since in async mode
+ * both the application and the render thread can report errors. */
 void gl_set_error(GLState *c, GLenum error)
 {
-    if (c && c->error == GL_NO_ERROR) {
-        c->error = error;
+    if (c) {
+        __sync_bool_compare_and_swap(&c->error, GL_NO_ERROR, error);
     }
 }
 
@@ -61,6 +66,46 @@ void vertex_buffer_push(GLState *c, vertex_t v)
     vb->data[vb->count++] = v;
 }
 
+/* Make room for n more vertices and return where they go; the caller fills them
+ * and adds n to the count. Returns NULL (GL_OUT_OF_MEMORY) on failure. */
+vertex_t *vertex_buffer_reserve(GLState *c, size_t n)
+{
+    if (!c) return NULL;
+
+    vertex_buffer_t *vb = &c->vertices;
+    if (vb->count + n > vb->capacity) {
+        size_t new_capacity = vb->capacity ? vb->capacity : INITIAL_VERTEX_CAPACITY;
+        while (new_capacity < vb->count + n) new_capacity *= 2;
+        vertex_t *new_data = mtgl_realloc(vb->data, new_capacity * sizeof(vertex_t));
+        if (!new_data) {
+            gl_set_error(c, GL_OUT_OF_MEMORY);
+            return NULL;
+        }
+        vb->data = new_data;
+        vb->capacity = new_capacity;
+    }
+    return vb->data + vb->count;
+}
+
+/* Make room for the n elements of an indexed primitive (the caller sets the count).
+ * Returns NULL (GL_OUT_OF_MEMORY) on failure. */
+static uint32_t *element_buffer_reserve(GLState *c, size_t n)
+{
+    element_buffer_t *eb = &c->elements;
+    if (n > eb->capacity) {
+        size_t new_capacity = eb->capacity ? eb->capacity : INITIAL_VERTEX_CAPACITY;
+        while (new_capacity < n) new_capacity *= 2;
+        uint32_t *new_data = mtgl_realloc(eb->data, new_capacity * sizeof(uint32_t));
+        if (!new_data) {
+            gl_set_error(c, GL_OUT_OF_MEMORY);
+            return NULL;
+        }
+        eb->data = new_data;
+        eb->capacity = new_capacity;
+    }
+    return eb->data;
+}
+
 vertex_t *vertex_buffer_data(GLState *c)
 {
     return c ? c->vertices.data : NULL;
@@ -73,22 +118,77 @@ size_t vertex_buffer_count(GLState *c)
 
 void vertex_buffer_clear(GLState *c)
 {
-    if (c) c->vertices.count = 0;
+    if (c) {
+        c->vertices.count = 0;
+        c->elements.count = 0;
+    }
 }
 
 /* Context management */
 
 GLState *gl_create_context(int32_t width, int32_t height)
 {
-    GLState *c = mtgl_alloc(sizeof(GLState));
+    return gl_create_context_shared(width, height, NULL);
+}
+
+GLState *gl_create_context_shared(int32_t width, int32_t height, GLState *share)
+{
+    return gl_create_context_in_group(width, height, share ? share->shared : NULL);
+}
+
+GLState *gl_create_context_in_group(int32_t width, int32_t height, struct share_group *group)
+{
+    GLState *c = mtgl_calloc(1, sizeof(GLState));
     if (!c) return NULL;
 
+    /* Join `group`, or start a new one */
+    if (group) {
+        c->shared = group;
+        share_group_retain(c->shared);
+    } else {
+        c->shared = share_group_create();
+        if (!c->shared) {
+            mtgl_free(c);
+            return NULL;
+        }
+    }
+
     /* Init framebuffer */
     if (framebuffer_init(&c->framebuffer, width, height) < 0) {
+        share_group_release(c->shared);
         mtgl_free(c);
         return NULL;
     }
 
+    /* Vertex buffer */
+    c->vertices.data = NULL;
+    c->vertices.count = 0;
+    c->vertices.capacity = 0;
+    c->post_vertices.data = NULL;
+    c->post_vertices.capacity = 0;
+    c->staged = NULL;
+    c->staged_count = 0;
+    memset(&c->elements, 0, sizeof(element_buffer_t));
+    memset(&c->list_pending, 0, sizeof(display_list_t));
+
+    /* Single-threaded until gl_set_render_threads */
+    c->workers = NULL;
+    c->tiles = NULL;
+    c->queue = NULL;
+
+    gl_reset_context(c);
+    return c;
+}
+
+void gl_reset_context(GLState *c)
+{
+    if (!c) return;
+    queue_sync(c);
+    tiles_sync(c);
+
+    int32_t width = c->framebuffer.width;
+    int32_t height = c->framebuffer.height;
+
     c->clear_color = color(0.0f, 0.0f, 0.0f, 1.0f);
     c->clear_depth = 1.0;
 
@@ -106,12 +206,11 @@ GLState *gl_create_context(int32_t width, int32_t height)
     c->projection_stack_depth = 0;
     c->texture_stack_depth = 0;
 
-    /* Initialize all matrix stack levels to identity */
-    for (int i = 0; i < MAX_MATRIX_STACK_DEPTH; i++) {
-        mat4_to_array(mat4_identity(), c->modelview_matrix[i]);
-        mat4_to_array(mat4_identity(), c->projection_matrix[i]);
-        mat4_to_array(mat4_identity(), c->texture_matrix[i]);
-    }
+    /* Only the bottom of each stack: glPushMatrix writes a level before it is used */
+    mat4_to_array(mat4_identity(), c->modelview_matrix[0]);
+    mat4_to_array(mat4_identity(), c->projection_matrix[0]);
+    mat4_to_array(mat4_identity(), c->texture_matrix[0]);
+    c->transform_dirty = TRANSFORM_DIRTY_ALL;
 
     c->primitive_mode = 0;
     c->flags = 0;
@@ -161,15 +260,14 @@ GLState *gl_create_context(int32_t width, int32_t height)
     c->polygon_mode_front = GL_FILL;
     c->polygon_mode_back = GL_FILL;
 
-    /* Init texture store */
-    texture_store_init(&c->textures);
+    /* No texture bound */
     c->bound_texture_2d = 0;
 
     /* Texture environment - default to GL_MODULATE */
     c->tex_env_mode = GL_MODULATE;
     c->tex_env_color = color(0.0f, 0.0f, 0.0f, 0.0f);
 
-    /* Hints - default to nicest for quality */
+    /* Hints - GL_DONT_CARE: span-subdivided perspective correction (see raster.c) */
     c->perspective_correction_hint = GL_DONT_CARE;
 
     /* Raster position - default to origin, valid */
@@ -185,7 +283,6 @@ GLState *gl_create_context(int32_t width, int32_t height)
     c->fog_color = color(0.0f, 0.0f, 0.0f, 0.0f);
 
     /* VBO - OpenGL 1.5 */
-    buffer_store_init(&c->buffers);
     c->bound_array_buffer = 0;
     c->bound_element_buffer = 0;
 
@@ -218,33 +315,81 @@ GLState *gl_create_context(int32_t width, int32_t height)
     c->shade_model = GL_SMOOTH;
 
     /* Display lists */
-    list_store_init(&c->lists);
+    c->list_pending.count = 0;
     c->list_base = 0;
     c->list_index = 0;
     c->list_mode = 0;
     c->list_call_depth = 0;
 
-    /* Vertex buffer */
-    c->vertices.data = NULL;
+    /* Vertex buffer (allocations are kept) */
     c->vertices.count = 0;
-    c->vertices.capacity = 0;
+    c->staged_count = 0;
+    c->elements.count = 0;
 
     /* Error state */
     c->error = GL_NO_ERROR;
+}
 
-    return c;
+void gl_copy_context(GLState *dst, GLState *src)
+{
+    if (!dst || !src || dst == src) return;
+    queue_sync(dst);
+    tiles_sync(dst);
+    queue_sync(src);
+
+    /* Everything but the resources owned by dst */
+    GLState keep = *dst;
+    memcpy(dst, src, offsetof(GLState, modelview_matrix));
+    memcpy((char *)dst + offsetof(GLState, modelview_stack_depth),
+           (const char *)src + offsetof(GLState, modelview_stack_depth),
+           sizeof(GLState) - offsetof(GLState, modelview_stack_depth));
+
+    /* Matrix stacks up to their depth only */
+    memcpy(dst->modelview_matrix, src->modelview_matrix,
+           (size_t)(src->modelview_stack_depth + 1) * sizeof(src->modelview_matrix[0]));
+    memcpy(dst->projection_matrix, src->projection_matrix,
+           (size_t)(src->projection_stack_depth + 1) * sizeof(src->projection_matrix[0]));
+    memcpy(dst->texture_matrix, src->texture_matrix,
+           (size_t)(src->texture_stack_depth + 1) * sizeof(src->texture_matrix[0]));
+
+    dst->flags &= ~FLAG_INSIDE_BEGIN_END;
+    dst->framebuffer = keep.framebuffer;
+    dst->shared = keep.shared;
+    dst->list_pending = keep.list_pending;
+    dst->list_pending.count = 0;
+    dst->list_index = 0;
+    dst->list_mode = 0;
+    dst->list_call_depth = 0;
+    dst->vertices = keep.vertices;
+    dst->vertices.count = 0;
+    dst->post_vertices = keep.post_vertices;
+    dst->staged = keep.staged;
+    dst->staged_count = 0;
+    dst->elements = keep.elements;
+    dst->elements.count = 0;
+    dst->workers = keep.workers;
+    dst->tiles = keep.tiles;
+    dst->queue = keep.queue;
+    dst->error = GL_NO_ERROR;
 }
 
 void gl_destroy_context(GLState *c)
 {
     if (c) {
-        list_store_free(&c->lists);
-        buffer_store_free(&c->buffers);
-        texture_store_free(&c->textures);
+        queue_destroy(c);
+        tiles_destroy(c);
+        worker_pool_destroy(c->workers);
+        mtgl_free(c->list_pending.commands);
+        share_group_release(c->shared);
         framebuffer_free(&c->framebuffer);
         if (c->vertices.data) {
             mtgl_free(c->vertices.data);
         }
+        mtgl_free(c->post_vertices.data);
+        mtgl_free(c->staged);
+        mtgl_free(c->elements.data);
+        mtgl_free(c->elements.cache);
+        mtgl_free(c->elements.unique);
         mtgl_free(c);
     }
 }
@@ -254,100 +399,112 @@ void gl_make_current(GLState *c)
     ctx = c;
 }
 
-GLState *gl_get_current_context(void)
+int gl_set_render_threads(GLState *c, int threads)
 {
-    return ctx;
+    if (!c) return -1;
+    queue_sync(c);
+    tiles_destroy(c);
+    worker_pool_destroy(c->workers);
+    c->workers = NULL;
+    if (threads <= 1) return 0;
+
+    c->workers = worker_pool_create(threads);
+    if (!c->workers) return -1;
+    if (tiles_create(c) < 0) {
+        worker_pool_destroy(c->workers);
+        c->workers = NULL;
+        return -1;
+    }
+    return 0;
 }
 
-/* Helper to build vertex from current state */
-static void emit_vertex(float x, float y, float z, float w)
+int gl_set_render_affinity(GLState *c, int enabled)
 {
-    /* Compute eye-space position (after modelview, before projection) */
-    vec4_t v = vec4(x, y, z, w);
-    mat4_t mv = mat4_from_array(ctx->modelview_matrix[ctx->modelview_stack_depth]);
-    vec4_t eye = mat4_mul_vec4(mv, v);
-    float eye_z = -eye.z;  /* Negate because OpenGL looks down -Z */
-    vec3_t eye_pos = vec3(eye.x, eye.y, eye.z);
-
-    /* Transform normal to eye-space using inverse-transpose of modelview.
-     * This correctly handles non-uniform scaling. */
-    vec3_t obj_normal = ctx->current_normal;
-    mat4_t normal_mat = mat4_normal_matrix(mv);
-    vec4_t n4 = mat4_mul_vec4(normal_mat, vec4(obj_normal.x, obj_normal.y, obj_normal.z, 0.0f));
-    vec3_t eye_normal = vec3(n4.x, n4.y, n4.z);
-    /* Always normalize the result since the normal matrix may not preserve length */
-    eye_normal = vec3_normalize(eye_normal);
-
-    /* Get base vertex color */
-    color_t vert_color = ctx->current_color;
-
-    /* Apply color material if enabled */
-    if ((ctx->flags & FLAG_LIGHTING) && (ctx->flags & FLAG_COLOR_MATERIAL)) {
-        GLenum mode = ctx->color_material_mode;
-        GLenum face = ctx->color_material_face;
-
-        /* Clamp color components to [0, 1] before using as material property */
-        color_t clamped_color = color_clamp(vert_color);
-
-        if (face == GL_FRONT || face == GL_FRONT_AND_BACK) {
-            if (mode == GL_AMBIENT || mode == GL_AMBIENT_AND_DIFFUSE)
-                ctx->material_front.ambient = clamped_color;
-            if (mode == GL_DIFFUSE || mode == GL_AMBIENT_AND_DIFFUSE)
-                ctx->material_front.diffuse = clamped_color;
-            if (mode == GL_SPECULAR)
-                ctx->material_front.specular = clamped_color;
-            if (mode == GL_EMISSION)
-                ctx->material_front.emission = clamped_color;
-        }
-        if (face == GL_BACK || face == GL_FRONT_AND_BACK) {
-            if (mode == GL_AMBIENT || mode == GL_AMBIENT_AND_DIFFUSE)
-                ctx->material_back.ambient = clamped_color;
-            if (mode == GL_DIFFUSE || mode == GL_AMBIENT_AND_DIFFUSE)
-                ctx->material_back.diffuse = clamped_color;
-            if (mode == GL_SPECULAR)
-                ctx->material_back.specular = clamped_color;
-            if (mode == GL_EMISSION)
-                ctx->material_back.emission = clamped_color;
-        }
+    if (!c || !c->workers) return -1;
+    return worker_pool_set_affinity(c->workers, enabled);
+}
+
+int gl_set_render_numa(GLState *c, int enabled)
+{
+    if (!c || !c->workers) return -1;
+    queue_sync(c);
+    if (!enabled) {
+        tiles_set_numa(c, 0);
+        return worker_pool_set_numa(c->workers, 0);
     }
+    if (worker_pool_set_numa(c->workers, 1) < 0) return -1;
+    return tiles_set_numa(c, 1);
+}
 
-    /* Compute per-vertex lighting for GL_FLAT and GL_SMOOTH (Gouraud shading) */
-    /* For GL_PHONG, lighting is computed per-fragment in the rasterizer */
-    /* Note: Two-sided lighting for Gouraud shading is handled per-fragment
-     * since we don't know the face orientation at vertex time. The front material
-     * is used here; back-face lighting is applied during rasterization. */
-    if ((ctx->flags & FLAG_LIGHTING) && ctx->shade_model != GL_PHONG) {
-        vert_color = compute_lighting(ctx, eye_pos, eye_normal, &ctx->material_front);
+int gl_set_async(GLState *c, int enabled)
+{
+    if (!c) return -1;
+    if (!enabled) {
+        queue_destroy(c);
+        return 0;
     }
+    if (c->queue) return 0;
+    return queue_create(c);
+}
 
-    /* Full transform for clip-space position */
-    vec4_t pos = transform_vertex(ctx, x, y, z, w);
+void gl_set_color_buffer(GLState *c, pixel_t *color)
+{
+    if (!c || !color) return;
+    list_command_t cmd = { CMD_COLOR_BUFFER, .data.color_buffer = { color } };
+    if (queue_record(c, &cmd)) return;
+    tiles_sync(c);
+    c->framebuffer.color = color;
+}
 
-    /* Apply texture matrix to texture coordinates */
-    vec2_t texcoord = ctx->current_texcoord;
-    mat4_t tex_mat = mat4_from_array(ctx->texture_matrix[ctx->texture_stack_depth]);
-    vec4_t tex4 = mat4_mul_vec4(tex_mat, vec4(texcoord.x, texcoord.y, 0.0f, 1.0f));
-    /* Perspective divide if w != 1 (for projective texturing) */
-    if (tex4.w != 0.0f && tex4.w != 1.0f) {
-        texcoord = vec2(tex4.x / tex4.w, tex4.y / tex4.w);
-    } else {
-        texcoord = vec2(tex4.x, tex4.y);
-    }
+int gl_set_texture_upload_threads(GLState *c, int threads)
+{
+    if (!c) return -1;
+    queue_sync(c);
+    share_write_lock(c);
+    upload_destroy(c->shared);
+    int result = threads > 0 ? upload_create(c->shared, threads) : 0;
+    share_write_unlock(c);
+    return result;
+}
+
+GLState *gl_get_current_context(void)
+{
+    return ctx;
+}
 
-    /* Build vertex */
-    vertex_t vert;
-    vert.position = pos;
-    vert.color = vert_color;
-    vert.texcoord = texcoord;
-    vert.normal = obj_normal;
-    vert.eye_z = eye_z;
-    vert.eye_pos = eye_pos;
-    vert.eye_normal = eye_normal;
+/* Transform the vertices staged since the last flush into the vertex buffer */
+static void flush_staged_vertices(GLState *c)
+{
+    size_t count = c->staged_count;
+    if (count == 0) return;
+    c->staged_count = 0;
 
-    vertex_buffer_push(ctx, vert);
+    gl_validate_transform(c);
+    vertex_t *out = vertex_buffer_reserve(c, count);
+    if (out) {
+        vertex_process_batch(c, &c->material_front, &c->material_back, c->staged, count, out);
+        c->vertices.count += count;
+    }
+}
+
+/* Helper to build vertex from current state: staged until the batch fills or the
+ * primitive ends, transformed right away outside glBegin/glEnd */
+static void emit_vertex(float x, float y, float z, float w)
+{
+    if (!ctx->staged) {
+        ctx->staged = mtgl_alloc(sizeof(vertex_batch_t));
+        if (!ctx->staged) {
+            gl_set_error(ctx, GL_OUT_OF_MEMORY);
+            return;
+        }
+    }
+    vertex_batch_set(ctx->staged, ctx->staged_count++, x, y, z, w,
+                     ctx->current_color, ctx->current_texcoord, ctx->current_normal);
+    if (ctx->staged_count == VERTEX_BATCH_SIZE || !(ctx->flags & FLAG_INSIDE_BEGIN_END)) {
+        flush_staged_vertices(ctx);
+    }
 }
 
-/* Helper to get flag from cap */
 static uint32_t cap_to_flag(GLenum cap)
 {
     switch (cap) {
@@ -370,7 +527,7 @@ static uint32_t cap_to_flag(GLenum cap)
 
 void glEnable(GLenum cap)
 {
-    CHECK_CTX();
+    CHECK_CTX_RECORD();
     if (list_record_enable(cap)) return;
 
     uint32_t flag = cap_to_flag(cap);
@@ -389,7 +546,7 @@ void glEnable(GLenum cap)
 
 void glDisable(GLenum cap)
 {
-    CHECK_CTX();
+    CHECK_CTX_RECORD();
     if (list_record_disable(cap)) return;
 
     uint32_t flag = cap_to_flag(cap);
@@ -408,7 +565,8 @@ void glDisable(GLenum cap)
 
 void glClear(GLbitfield mask)
 {
-    CHECK_CTX();
+    CHECK_CTX_RECORD();
+    if (list_record_clear(mask)) return;
     framebuffer_t *fb = &ctx->framebuffer;
 
     /* Determine clear region (scissor or full buffer) */
@@ -430,47 +588,47 @@ void glClear(GLbitfield mask)
         y1 = fb->height;
     }
 
+    /* Tiled rendering records the clear per tile (see tiles.h) */
+    if (ctx->tiles) {
+        unsigned buffers = 0;
+        if (mask & GL_COLOR_BUFFER_BIT) buffers |= TILE_CLEAR_COLOR;
+        if (mask & GL_DEPTH_BUFFER_BIT) buffers |= TILE_CLEAR_DEPTH;
+        if (mask & GL_STENCIL_BUFFER_BIT) buffers |= TILE_CLEAR_STENCIL;
+        tiles_clear(ctx, buffers, x0, y0, x1, y1);
+        return;
+    }
+    if (x0 >= x1 || y0 >= y1) return;
+    int stream = (size_t)(x1 - x0) * (size_t)(y1 - y0) * sizeof(pixel_t) >= FB_STREAM_CLEAR_BYTES;
+
     if (mask & GL_COLOR_BUFFER_BIT) {
-        pixel_t clear_pixel = color_to_rgba32(ctx->clear_color);
-        for (int32_t y = y0; y < y1; y++) {
-            for (int32_t x = x0; x < x1; x++) {
-                fb->color[y * fb->width + x] = clear_pixel;
-            }
-        }
+        framebuffer_clear_color_rect(fb, x0, y0, x1, y1, color_to_rgba32(ctx->clear_color), stream);
     }
     if (mask & GL_DEPTH_BUFFER_BIT) {
-        float clear_depth = (float)ctx->clear_depth;
-        for (int32_t y = y0; y < y1; y++) {
-            for (int32_t x = x0; x < x1; x++) {
-                fb->depth[y * fb->width + x] = clear_depth;
-            }
-        }
+        framebuffer_clear_depth_rect(fb, x0, y0, x1, y1, (float)ctx->clear_depth, stream);
     }
     if (mask & GL_STENCIL_BUFFER_BIT) {
-        uint8_t clear_stencil = (uint8_t)(ctx->stencil_clear & 0xFF);
-        for (int32_t y = y0; y < y1; y++) {
-            for (int32_t x = x0; x < x1; x++) {
-                fb->stencil[y * fb->width + x] = clear_stencil;
-            }
-        }
+        framebuffer_clear_stencil_rect(fb, x0, y0, x1, y1, (uint8_t)(ctx->stencil_clear & 0xFF));
     }
 }
 
 void glClearColor(GLclampf red, GLclampf green, GLclampf blue, GLclampf alpha)
 {
-    CHECK_CTX();
+    CHECK_CTX_RECORD();
+    if (list_record_clear_color(red, green, blue, alpha)) return;
     ctx->clear_color = color(red, green, blue, alpha);
 }
 
 void glClearDepth(GLclampd depth)
 {
-    CHECK_CTX();
+    CHECK_CTX_RECORD();
+    if (list_record_clear_depth(depth)) return;
     ctx->clear_depth = depth;
 }
 
 void glViewport(GLint x, GLint y, GLsizei width, GLsizei height)
 {
-    CHECK_CTX();
+    CHECK_CTX_RECORD();
+    if (list_record_viewport(x, y, width, height)) return;
     ctx->viewport_x = x;
     ctx->viewport_y = y;
     ctx->viewport_w = width;
@@ -494,6 +652,42 @@ static GLfloat *current_matrix(void)
     }
 }
 
+/* The current matrix changed: its derived state must be recomputed */
+static void matrix_changed(void)
+{
+    switch (ctx->matrix_mode) {
+        case GL_PROJECTION: ctx->transform_dirty |= TRANSFORM_DIRTY_PROJECTION; break;
+        case GL_TEXTURE:    ctx->transform_dirty |= TRANSFORM_DIRTY_TEXTURE; break;
+        default:            ctx->transform_dirty |= TRANSFORM_DIRTY_MODELVIEW; break;
+    }
+}
+
+void gl_update_transform(GLState *c)
+{
+    const GLfloat *mv = c->modelview_matrix[c->modelview_stack_depth];
+    if (c->transform_dirty & (TRANSFORM_DIRTY_MODELVIEW | TRANSFORM_DIRTY_PROJECTION)) {
+        mat4_to_array(mat4_mul(mat4_from_array(c->projection_matrix[c->projection_stack_depth]),
+                               mat4_from_array(mv)), c->mvp_matrix);
+    }
+    if (c->transform_dirty & TRANSFORM_DIRTY_MODELVIEW) {
+        mat4_to_array(mat4_normal_matrix(mat4_from_array(mv)), c->normal_matrix);
+        c->transform_class &= ~TRANSFORM_MODELVIEW_AFFINE;
+        if (mv[3] == 0.0f && mv[7] == 0.0f && mv[11] == 0.0f && mv[15] == 1.0f) {
+            c->transform_class |= TRANSFORM_MODELVIEW_AFFINE;
+        }
+    }
+    if (c->transform_dirty & TRANSFORM_DIRTY_TEXTURE) {
+        const GLfloat *tm = c->texture_matrix[c->texture_stack_depth];
+        int identity = 1;
+        for (int i = 0; i < 16; i++) {
+            if (tm[i] != ((i % 5) == 0 ? 1.0f : 0.0f)) identity = 0;
+        }
+        c->transform_class &= ~TRANSFORM_TEXTURE_IDENTITY;
+        if (identity) c->transform_class |= TRANSFORM_TEXTURE_IDENTITY;
+    }
+    c->transform_dirty = 0;
+}
+
 static GLint *current_stack_depth(void)
 {
     switch (ctx->matrix_mode) {
@@ -506,21 +700,22 @@ static GLint *current_stack_depth(void)
 
 void glMatrixMode(GLenum mode)
 {
-    CHECK_CTX();
+    CHECK_CTX_RECORD();
     if (list_record_matrix_mode(mode)) return;
     ctx->matrix_mode = mode;
 }
 
 void glLoadIdentity(void)
 {
-    CHECK_CTX();
+    CHECK_CTX_RECORD();
     if (list_record_load_identity()) return;
     mat4_to_array(mat4_identity(), current_matrix());
+    matrix_changed();
 }
 
 void glPushMatrix(void)
 {
-    CHECK_CTX();
+    CHECK_CTX_RECORD();
     if (list_record_push_matrix()) return;
 
     GLint *depth = current_stack_depth();
@@ -536,7 +731,7 @@ void glPushMatrix(void)
 
 void glPopMatrix(void)
 {
-    CHECK_CTX();
+    CHECK_CTX_RECORD();
     if (list_record_pop_matrix()) return;
 
     GLint *depth = current_stack_depth();
@@ -546,74 +741,82 @@ void glPopMatrix(void)
     }
 
     (*depth)--;
+    matrix_changed();
 }
 
 void glOrtho(GLdouble left, GLdouble right, GLdouble bottom, GLdouble top, GLdouble near, GLdouble far)
 {
-    CHECK_CTX();
+    CHECK_CTX_RECORD();
     if (list_record_ortho(left, right, bottom, top, near, far)) return;
     GLfloat *m = current_matrix();
     mat4_t result = mat4_mul(mat4_from_array(m), mat4_ortho(left, right, bottom, top, near, far));
     mat4_to_array(result, m);
+    matrix_changed();
 }
 
 void glFrustum(GLdouble left, GLdouble right, GLdouble bottom, GLdouble top, GLdouble near, GLdouble far)
 {
-    CHECK_CTX();
+    CHECK_CTX_RECORD();
     if (list_record_frustum(left, right, bottom, top, near, far)) return;
     GLfloat *m = current_matrix();
     mat4_t result = mat4_mul(mat4_from_array(m), mat4_frustum(left, right, bottom, top, near, far));
     mat4_to_array(result, m);
+    matrix_changed();
 }
 
 void glTranslatef(GLfloat x, GLfloat y, GLfloat z)
 {
-    CHECK_CTX();
+    CHECK_CTX_RECORD();
     if (list_record_translatef(x, y, z)) return;
     GLfloat *m = current_matrix();
     mat4_t result = mat4_mul(mat4_from_array(m), mat4_translate(x, y, z));
     mat4_to_array(result, m);
+    matrix_changed();
 }
 
 void glRotatef(GLfloat angle, GLfloat x, GLfloat y, GLfloat z)
 {
-    CHECK_CTX();
+    CHECK_CTX_RECORD();
     if (list_record_rotatef(angle, x, y, z)) return;
     GLfloat *m = current_matrix();
     mat4_t result = mat4_mul(mat4_from_array(m), mat4_rotate(angle, x, y, z));
     mat4_to_array(result, m);
+    matrix_changed();
 }
 
 void glScalef(GLfloat x, GLfloat y, GLfloat z)
 {
-    CHECK_CTX();
+    CHECK_CTX_RECORD();
     if (list_record_scalef(x, y, z)) return;
     GLfloat *m = current_matrix();
     mat4_t result = mat4_mul(mat4_from_array(m), mat4_scale(x, y, z));
     mat4_to_array(result, m);
+    matrix_changed();
 }
 
 void glMultMatrixf(const GLfloat *mult)
 {
-    CHECK_CTX();
+    CHECK_CTX_RECORD();
     if (list_record_mult_matrixf(mult)) return;
     GLfloat *m = current_matrix();
     mat4_t result = mat4_mul(mat4_from_array(m), mat4_from_array(mult));
     mat4_to_array(result, m);
+    matrix_changed();
 }
 
 void glLoadMatrixf(const GLfloat *m)
 {
-    CHECK_CTX();
+    CHECK_CTX_RECORD();
     if (list_record_load_matrixf(m)) return;
     mat4_to_array(mat4_from_array(m), current_matrix());
+    matrix_changed();
 }
 
 /* Vertex specification */
 
 void glBegin(GLenum mode)
 {
-    CHECK_CTX();
+    CHECK_CTX_RECORD();
     if (list_record_begin(mode)) return;
 
     /* Check for nested glBegin */
@@ -634,7 +837,7 @@ void glBegin(GLenum mode)
 
 void glEnd(void)
 {
-    CHECK_CTX();
+    CHECK_CTX_RECORD();
     if (list_record_end()) return;
 
     /* Check for glEnd without glBegin */
@@ -644,7 +847,9 @@ void glEnd(void)
     }
 
     ctx->flags &= ~FLAG_INSIDE_BEGIN_END;
+    flush_staged_vertices(ctx);
 
+    share_read_lock(ctx);  /* Rasterization samples the bound texture */
     switch (ctx->primitive_mode) {
         case GL_POINTS:        flush_points(ctx); break;
         case GL_LINES:         flush_lines(ctx); break;
@@ -657,20 +862,21 @@ void glEnd(void)
         case GL_QUAD_STRIP:    flush_quad_strip(ctx); break;
         case GL_POLYGON:       flush_polygon(ctx); break;
     }
+    share_read_unlock(ctx);
 
     vertex_buffer_clear(ctx);
 }
 
 void glVertex2f(GLfloat x, GLfloat y)
 {
-    CHECK_CTX();
+    CHECK_CTX_RECORD();
     if (list_record_vertex(x, y, 0.0f)) return;
     emit_vertex(x, y, 0.0f, 1.0f);
 }
 
 void glVertex3f(GLfloat x, GLfloat y, GLfloat z)
 {
-    CHECK_CTX();
+    CHECK_CTX_RECORD();
     if (list_record_vertex(x, y, z)) return;
     emit_vertex(x, y, z, 1.0f);
 }
@@ -693,7 +899,7 @@ static inline int is_valid_float(float f)
 
 void glColor3f(GLfloat r, GLfloat g, GLfloat b)
 {
-    CHECK_CTX();
+    CHECK_CTX_RECORD();
     /* Clamp colors to valid range, treat NaN/Inf as 0 */
     if (!is_valid_float(r)) r = 0.0f;
     if (!is_valid_float(g)) g = 0.0f;
@@ -705,10 +911,9 @@ void glColor3f(GLfloat r, GLfloat g, GLfloat b)
     ctx->current_color = color(r, g, b, 1.0f);
 }
 
-void glColor4f(GLfloat r, GLfloat g, GLfloat b, GLfloat a)
+/* Clamp colors to valid range, treat NaN/Inf as 0 (alpha as 1) */
+static color_t valid_color(GLfloat r, GLfloat g, GLfloat b, GLfloat a)
 {
-    CHECK_CTX();
-    /* Clamp colors to valid range, treat NaN/Inf as 0 */
     if (!is_valid_float(r)) r = 0.0f;
     if (!is_valid_float(g)) g = 0.0f;
     if (!is_valid_float(b)) b = 0.0f;
@@ -717,13 +922,20 @@ void glColor4f(GLfloat r, GLfloat g, GLfloat b, GLfloat a)
     if (g < 0.0f) g = 0.0f; else if (g > 1.0f) g = 1.0f;
     if (b < 0.0f) b = 0.0f; else if (b > 1.0f) b = 1.0f;
     if (a < 0.0f) a = 0.0f; else if (a > 1.0f) a = 1.0f;
-    if (list_record_color(r, g, b, a)) return;
-    ctx->current_color = color(r, g, b, a);
+    return color(r, g, b, a);
+}
+
+void glColor4f(GLfloat r, GLfloat g, GLfloat b, GLfloat a)
+{
+    CHECK_CTX_RECORD();
+    color_t c = valid_color(r, g, b, a);
+    if (list_record_color(c.r, c.g, c.b, c.a)) return;
+    ctx->current_color = c;
 }
 
 void glColor3ub(GLubyte r, GLubyte g, GLubyte b)
 {
-    CHECK_CTX();
+    CHECK_CTX_RECORD();
     float rf = r / 255.0f, gf = g / 255.0f, bf = b / 255.0f;
     if (list_record_color(rf, gf, bf, 1.0f)) return;
     ctx->current_color = color(rf, gf, bf, 1.0f);
@@ -731,7 +943,7 @@ void glColor3ub(GLubyte r, GLubyte g, GLubyte b)
 
 void glColor4ub(GLubyte r, GLubyte g, GLubyte b, GLubyte a)
 {
-    CHECK_CTX();
+    CHECK_CTX_RECORD();
     float rf = r / 255.0f, gf = g / 255.0f, bf = b / 255.0f, af = a / 255.0f;
     if (list_record_color(rf, gf, bf, af)) return;
     ctx->current_color = color(rf, gf, bf, af);
@@ -739,14 +951,14 @@ void glColor4ub(GLubyte r, GLubyte g, GLubyte b, GLubyte a)
 
 void glTexCoord2f(GLfloat s, GLfloat t)
 {
-    CHECK_CTX();
+    CHECK_CTX_RECORD();
     if (list_record_texcoord(s, t)) return;
     ctx->current_texcoord = vec2(s, t);
 }
 
 void glNormal3f(GLfloat nx, GLfloat ny, GLfloat nz)
 {
-    CHECK_CTX();
+    CHECK_CTX_RECORD();
     if (list_record_normal(nx, ny, nz)) return;
     ctx->current_normal = vec3(nx, ny, nz);
 }
@@ -760,9 +972,15 @@ void glGenTextures(GLsizei n, GLuint *textures)
         gl_set_error(ctx, GL_INVALID_VALUE);
         return;
     }
+    tiles_sync_objects(ctx);  /* The texture store may move */
+    share_write_lock(ctx);
+    if (ctx->shared->textures.count >= ctx->shared->textures.capacity) {
+        upload_finish(ctx->shared->uploader);  /* Uploads hold texture pointers */
+    }
     for (GLsizei i = 0; i < n; i++) {
-        textures[i] = texture_alloc(&ctx->textures);
+        textures[i] = texture_alloc(&ctx->shared->textures);
     }
+    share_write_unlock(ctx);
 }
 
 void glDeleteTextures(GLsizei n, const GLuint *textures)
@@ -772,17 +990,32 @@ void glDeleteTextures(GLsizei n, const GLuint *textures)
         gl_set_error(ctx, GL_INVALID_VALUE);
         return;
     }
+    tiles_sync_objects(ctx);
+    share_write_lock(ctx);
     for (GLsizei i = 0; i < n; i++) {
         if (textures[i] == ctx->bound_texture_2d) {
             ctx->bound_texture_2d = 0;
         }
-        texture_free(&ctx->textures, textures[i]);
+        texture_t *tex = texture_get(&ctx->shared->textures, textures[i]);
+        if (tex) upload_wait_texture(ctx->shared->uploader, tex);
+        texture_free(&ctx->shared->textures, textures[i]);
+    }
+    share_write_unlock(ctx);
+}
+
+/* Samplers only read textures, as they may run on several threads at once (tile
+ * workers, other contexts of the share group): build mip level 1 while the write
+ * lock is held instead of on first minified sample */
+static void texture_prepare_mipmap(texture_t *tex)
+{
+    if (tex->pixels && tex->min_filter != GL_NEAREST && tex->min_filter != GL_LINEAR) {
+        texture_generate_mip1(tex);
     }
 }
 
 void glBindTexture(GLenum target, GLuint texture)
 {
-    CHECK_CTX();
+    CHECK_CTX_RECORD();
     if (list_record_bind_texture(target, texture)) return;
     if (target != GL_TEXTURE_2D) {
         gl_set_error(ctx, GL_INVALID_ENUM);
@@ -794,6 +1027,7 @@ void glBindTexture(GLenum target, GLuint texture)
 void glTexImage2D(GLenum target, GLint level, GLint internalformat, GLsizei width, GLsizei height, GLint border, GLenum format, GLenum type, const GLvoid *pixels)
 {
     CHECK_CTX();
+    tiles_sync_objects(ctx);  /* Binned triangles may still sample the old image */
 
     /* Only support GL_TEXTURE_2D, level 0, GL_UNSIGNED_BYTE */
     if (target != GL_TEXTURE_2D) {
@@ -809,10 +1043,57 @@ void glTexImage2D(GLenum target, GLint level, GLint internalformat, GLsizei widt
         return;
     }
 
-    texture_t *tex = texture_get(&ctx->textures, ctx->bound_texture_2d);
-    if (!tex) return;
-
     const uint8_t *data = (const uint8_t *)pixels;
+    int32_t pixel_size = texture_format_size(format);
+    size_t size = (size_t)width * (size_t)height * (size_t)(pixel_size > 0 ? pixel_size : 0);
+    texture_t *tex;
+    struct texture_uploader *uploader;
+
+    /* Wait for a pending upload of the texture and for a free upload slot with read
+     * access only, so other contexts keep drawing; the write lock below is held just to
+     * allocate, publish and submit. Another context may start an upload of the same
+     * texture in between: then wait again. */
+    for (;;) {
+        share_read_lock(ctx);
+        tex = texture_get(&ctx->shared->textures, ctx->bound_texture_2d);
+        if (!tex) {
+            share_read_unlock(ctx);
+            return;
+        }
+        uploader = ctx->shared->uploader;
+        upload_wait_texture(uploader, tex);
+        int background = uploader && data && size > 0;
+        uint64_t reservation = background ? upload_reserve(uploader) : 0;
+        share_read_unlock(ctx);
+
+        /* Background upload: keep a copy of the client image and let the upload thread
+         * convert it; level 0 is allocated here so the size is known right away */
+        uint8_t *staging = background ? mtgl_alloc(size) : NULL;
+        if (staging) memcpy(staging, data, size);
+
+        share_write_lock(ctx);
+        tex = texture_get(&ctx->shared->textures, ctx->bound_texture_2d);
+        uploader = ctx->shared->uploader;
+        int reserved = background && upload_reserved(uploader, reservation);
+        if (!tex || !upload_ready(tex)) {
+            if (reserved) upload_cancel(uploader);
+            share_write_unlock(ctx);
+            mtgl_free(staging);
+            if (!tex) return;
+            continue;
+        }
+        if (reserved && staging && texture_storage(tex, width, height) == 0) {
+            if (upload_submit(uploader, tex, staging, format) == 0) {
+                share_write_unlock(ctx);
+                return;
+            }
+        } else if (reserved) {
+            upload_cancel(uploader);
+        }
+        /* Out of memory or the uploader was replaced: convert here */
+        mtgl_free(staging);
+        break;
+    }
 
     switch (format) {
         case GL_RGBA:
@@ -831,19 +1112,12 @@ void glTexImage2D(GLenum target, GLint level, GLint internalformat, GLsizei widt
             gl_set_error(ctx, GL_INVALID_ENUM);
             break;
     }
+    texture_prepare_mipmap(tex);
+    share_write_unlock(ctx);
 }
 
-void glTexParameteri(GLenum target, GLenum pname, GLint param)
+static void texture_parameter(texture_t *tex, GLenum pname, GLint param)
 {
-    CHECK_CTX();
-    if (target != GL_TEXTURE_2D) {
-        gl_set_error(ctx, GL_INVALID_ENUM);
-        return;
-    }
-
-    texture_t *tex = texture_get(&ctx->textures, ctx->bound_texture_2d);
-    if (!tex) return;
-
     switch (pname) {
         case GL_TEXTURE_MIN_FILTER:
             /* Valid min filters: NEAREST, LINEAR, and mipmap variants */
@@ -884,23 +1158,121 @@ void glTexParameteri(GLenum target, GLenum pname, GLint param)
     }
 }
 
+void glTexParameteri(GLenum target, GLenum pname, GLint param)
+{
+    CHECK_CTX();
+    tiles_sync_objects(ctx);
+    if (target != GL_TEXTURE_2D) {
+        gl_set_error(ctx, GL_INVALID_ENUM);
+        return;
+    }
+
+    share_write_lock(ctx);
+    texture_t *tex = texture_get(&ctx->shared->textures, ctx->bound_texture_2d);
+    if (tex) {
+        texture_parameter(tex, pname, param);
+        /* Uploads in flight only write the images, and build mip level 1 anyway */
+        if (upload_ready(tex)) texture_prepare_mipmap(tex);
+    }
+    share_write_unlock(ctx);
+}
+
 /* Misc */
 
 void glFlush(void)
 {
-    CHECK_CTX();
-    /* Software renderer - nothing to flush */
+    CHECK_CTX_RECORD();
+    /* Async mode: hand the recorded commands to the render thread without waiting */
+    if (ctx->queue && queue_recording(ctx)) {
+        queue_submit(ctx);
+        return;
+    }
+    /* Rasterize binned triangles; immediate mode has nothing to flush */
+    tiles_sync(ctx);
 }
 
 void glFinish(void)
 {
     CHECK_CTX();
-    /* Software renderer - nothing to wait for */
+    tiles_sync(ctx);
+}
+
+/* Sync objects */
+
+GLsync glFenceSync(GLenum condition, GLbitfield flags)
+{
+    if (!ctx) return NULL;
+    if (condition != GL_SYNC_GPU_COMMANDS_COMPLETE) {
+        gl_set_error(ctx, GL_INVALID_ENUM);
+        return NULL;
+    }
+    if (flags != 0) {
+        gl_set_error(ctx, GL_INVALID_VALUE);
+        return NULL;
+    }
+
+    GLsync sync = fence_create(ctx);
+    if (!sync) gl_set_error(ctx, GL_OUT_OF_MEMORY);
+    return sync;
+}
+
+GLboolean glIsSync(GLsync sync)
+{
+    return fence_valid(sync) ? GL_TRUE : GL_FALSE;
+}
+
+void glDeleteSync(GLsync sync)
+{
+    if (!sync) return;
+    if (!fence_delete(sync)) gl_set_error(ctx, GL_INVALID_VALUE);
+}
+
+GLenum glClientWaitSync(GLsync sync, GLbitfield flags, GLuint64 timeout)
+{
+    if (!ctx) return GL_WAIT_FAILED;
+    if (flags & ~GL_SYNC_FLUSH_COMMANDS_BIT) {
+        gl_set_error(ctx, GL_INVALID_VALUE);
+        return GL_WAIT_FAILED;
+    }
+    /* The reference keeps the fence alive if another thread deletes it meanwhile */
+    if (!fence_acquire(sync)) {
+        gl_set_error(ctx, GL_INVALID_VALUE);
+        return GL_WAIT_FAILED;
+    }
+
+    /* Fences submit their batch on creation, so GL_SYNC_FLUSH_COMMANDS_BIT has nothing to do */
+    GLenum result;
+    if (fence_wait(sync, 0)) {
+        result = GL_ALREADY_SIGNALED;
+    } else if (timeout == 0) {
+        result = GL_TIMEOUT_EXPIRED;
+    } else {
+        result = fence_wait(sync, timeout) ? GL_CONDITION_SATISFIED : GL_TIMEOUT_EXPIRED;
+    }
+    fence_release(sync);
+    return result;
+}
+
+void glWaitSync(GLsync sync, GLbitfield flags, GLuint64 timeout)
+{
+    if (!ctx) return;
+    if (flags != 0 || timeout != GL_TIMEOUT_IGNORED || !fence_acquire(sync)) {
+        gl_set_error(ctx, GL_INVALID_VALUE);
+        return;
+    }
+
+    /* Async mode: the render thread waits before executing the commands after this
+     * one; the recorded command owns the reference. Otherwise this thread executes
+     * the commands, so it waits now. */
+    list_command_t cmd = { CMD_WAIT_SYNC, .data.wait_sync = { sync } };
+    if (queue_record(ctx, &cmd)) return;
+    fence_wait(sync, GL_TIMEOUT_IGNORED);
+    fence_release(sync);
 }
 
 GLenum glGetError(void)
 {
-    if (!ctx) return GL_NO_ERROR;
+    CHECK_CTX_RET(GL_NO_ERROR);
     GLenum err = ctx->error;
     ctx->error = GL_NO_ERROR;
     return err;
@@ -935,7 +1307,7 @@ static int is_valid_blend_factor(GLenum factor, int is_src)
 
 void glBlendFunc(GLenum sfactor, GLenum dfactor)
 {
-    CHECK_CTX();
+    CHECK_CTX_RECORD();
     if (list_record_blend_func(sfactor, dfactor)) return;
     if (!is_valid_blend_factor(sfactor, 1) || !is_valid_blend_factor(dfactor, 0)) {
         gl_set_error(ctx, GL_INVALID_ENUM);
@@ -947,7 +1319,7 @@ void glBlendFunc(GLenum sfactor, GLenum dfactor)
 
 void glCullFace(GLenum mode)
 {
-    CHECK_CTX();
+    CHECK_CTX_RECORD();
     if (list_record_cull_face(mode)) return;
     if (mode != GL_FRONT && mode != GL_BACK && mode != GL_FRONT_AND_BACK) {
         gl_set_error(ctx, GL_INVALID_ENUM);
@@ -958,7 +1330,7 @@ void glCullFace(GLenum mode)
 
 void glFrontFace(GLenum mode)
 {
-    CHECK_CTX();
+    CHECK_CTX_RECORD();
     if (list_record_front_face(mode)) return;
     if (mode != GL_CW && mode != GL_CCW) {
         gl_set_error(ctx, GL_INVALID_ENUM);
@@ -969,7 +1341,7 @@ void glFrontFace(GLenum mode)
 
 void glDepthFunc(GLenum func)
 {
-    CHECK_CTX();
+    CHECK_CTX_RECORD();
     if (list_record_depth_func(func)) return;
     if (func < GL_NEVER || func > GL_ALWAYS) {
         gl_set_error(ctx, GL_INVALID_ENUM);
@@ -980,7 +1352,7 @@ void glDepthFunc(GLenum func)
 
 void glDepthMask(GLboolean flag)
 {
-    CHECK_CTX();
+    CHECK_CTX_RECORD();
     if (list_record_depth_mask(flag)) return;
     ctx->depth_mask = flag;
 }
@@ -1181,6 +1553,7 @@ void glReadPixels(GLint x, GLint y, GLsizei width, GLsizei height, GLenum format
 {
     CHECK_CTX();
     if (type != GL_UNSIGNED_BYTE || !pixels) return;
+    tiles_sync(ctx);
 
     framebuffer_t *fb = &ctx->framebuffer;
     uint8_t *dst = (uint8_t *)pixels;
@@ -1287,6 +1660,7 @@ void glDrawPixels(GLsizei width, GLsizei height, GLenum format, GLenum type, con
 {
     CHECK_CTX();
     if (type != GL_UNSIGNED_BYTE || !pixels || !ctx->raster_pos_valid) return;
+    tiles_sync(ctx);
 
     framebuffer_t *fb = &ctx->framebuffer;
     const uint8_t *src = (const uint8_t *)pixels;
@@ -1520,7 +1894,9 @@ void glGenBuffers(GLsizei n, GLuint *buffers)
         gl_set_error(ctx, GL_INVALID_VALUE);
         return;
     }
-    buffer_gen(&ctx->buffers, n, buffers);
+    share_write_lock(ctx);
+    buffer_gen(&ctx->shared->buffers, n, buffers);
+    share_write_unlock(ctx);
 }
 
 void glDeleteBuffers(GLsizei n, const GLuint *buffers)
@@ -1538,7 +1914,9 @@ void glDeleteBuffers(GLsizei n, const GLuint *buffers)
             ctx->bound_element_buffer = 0;
         }
     }
-    buffer_delete(&ctx->buffers, n, buffers);
+    share_write_lock(ctx);
+    buffer_delete(&ctx->shared->buffers, n, buffers);
+    share_write_unlock(ctx);
 }
 
 void glBindBuffer(GLenum target, GLuint buffer)
@@ -1578,10 +1956,12 @@ void glBufferData(GLenum target, GLsizeiptr size, const GLvoid *data, GLenum usa
             return;
     }
 
-    buffer_t *buf = buffer_get(&ctx->buffers, buf_id);
+    share_write_lock(ctx);
+    buffer_t *buf = buffer_get(&ctx->shared->buffers, buf_id);
     if (buf) {
         buffer_data(buf, size, data, usage);
     }
+    share_write_unlock(ctx);
 }
 
 void glBufferSubData(GLenum target, GLintptr offset, GLsizeiptr size, const GLvoid *data)
@@ -1605,14 +1985,14 @@ void glBufferSubData(GLenum target, GLintptr offset, GLsizeiptr size, const GLvo
             return;
     }
 
-    buffer_t *buf = buffer_get(&ctx->buffers, buf_id);
+    share_write_lock(ctx);
+    buffer_t *buf = buffer_get(&ctx->shared->buffers, buf_id);
     if (!buf) {
         gl_set_error(ctx, GL_INVALID_OPERATION);
-        return;
-    }
-    if (buffer_sub_data(buf, offset, size, data) != 0) {
+    } else if (buffer_sub_data(buf, offset, size, data) != 0) {
         gl_set_error(ctx, GL_INVALID_VALUE);
     }
+    share_write_unlock(ctx);
 }
 
 /* Vertex arrays */
@@ -1745,7 +2125,7 @@ void glNormalPointer(GLenum type, GLsizei stride, const GLvoid *pointer)
 static const void *get_array_pointer(const array_pointer_t *arr)
 {
     if (ctx->bound_array_buffer) {
-        buffer_t *buf = buffer_get(&ctx->buffers, ctx->bound_array_buffer);
+        buffer_t *buf = buffer_get(&ctx->shared->buffers, ctx->bound_array_buffer);
         if (buf && buf->data) {
             return (const uint8_t *)buf->data + (size_t)arr->pointer;
         }
@@ -1796,9 +2176,247 @@ static void get_array_element(const array_pointer_t *arr, const void *base, GLin
     }
 }
 
-void glDrawArrays(GLenum mode, GLint first, GLsizei count)
+/* Array draws with at least this many vertices are transformed on the render threads */
+#define PARALLEL_VERTEX_MIN   4096
+#define PARALLEL_VERTEX_CHUNK 1024
+
+/* Arrays read by a glDrawArrays/glDrawElements call */
+typedef struct {
+    const void *vertex_base;
+    const void *color_base;     /* NULL when the array is disabled */
+    const void *texcoord_base;
+    const void *normal_base;
+    const void *indices;        /* NULL for glDrawArrays */
+    GLenum index_type;
+    GLint first;
+} array_draw_t;
+
+/* Fetch the attributes of the i-th vertex of a draw. The current color, texcoord and
+ * normal are only replaced for enabled arrays, as glColor/glTexCoord/glNormal would. */
+static inline GLint array_draw_index(const array_draw_t *d, GLsizei i)
+{
+    if (!d->indices) {
+        return d->first + i;
+    } else if (d->index_type == GL_UNSIGNED_SHORT) {
+        return (GLint)((const GLushort *)d->indices)[i];
+    } else if (d->index_type == GL_UNSIGNED_INT) {
+        return (GLint)((const GLuint *)d->indices)[i];
+    }
+    return (GLint)((const GLubyte *)d->indices)[i];
+}
+
+static void fetch_array_vertex(GLState *c, const array_draw_t *d, GLsizei i, float *v,
+                               color_t *col, vec2_t *texcoord, vec3_t *normal)
+{
+    GLint idx = array_draw_index(d, i);
+
+    get_array_element(&c->vertex_pointer, d->vertex_base, idx, v, 4);
+    if (d->color_base) {
+        float cf[4];
+        get_array_element(&c->color_pointer, d->color_base, idx, cf, 4);
+        *col = valid_color(cf[0], cf[1], cf[2], cf[3]);
+    }
+    if (d->texcoord_base) {
+        float t[2];
+        get_array_element(&c->texcoord_pointer, d->texcoord_base, idx, t, 2);
+        *texcoord = vec2(t[0], t[1]);
+    }
+    if (d->normal_base) {
+        float n[3];
+        get_array_element(&c->normal_pointer, d->normal_base, idx, n, 3);
+        *normal = vec3(n[0], n[1], n[2]);
+    }
+}
+
+/* Array indices of vertices [i, i + n) of a draw */
+static void array_draw_indices(const array_draw_t *d, GLsizei i, size_t n, uint32_t *idx)
+{
+    if (!d->indices) {
+        for (size_t k = 0; k < n; k++) idx[k] = (uint32_t)(d->first + i + (GLsizei)k);
+    } else if (d->index_type == GL_UNSIGNED_SHORT) {
+        const GLushort *src = (const GLushort *)d->indices + i;
+        for (size_t k = 0; k < n; k++) idx[k] = src[k];
+    } else if (d->index_type == GL_UNSIGNED_INT) {
+        const GLuint *src = (const GLuint *)d->indices + i;
+        for (size_t k = 0; k < n; k++) idx[k] = src[k];
+    } else {
+        const GLubyte *src = (const GLubyte *)d->indices + i;
+        for (size_t k = 0; k < n; k++) idx[k] = src[k];
+    }
+}
+
+typedef struct {
+    GLState *ctx;
+    const array_draw_t *draw;
+    const array_fetch_t *fetch;
+    vertex_t *out;
+    GLsizei count;
+} vertex_job_t;
+
+/* Transform and light one chunk of a draw into its slots of the vertex buffer, a batch
+ * at a time (worker_func_t) */
+static void process_vertex_chunk(void *arg, uint32_t chunk)
+{
+    const vertex_job_t *job = arg;
+    GLState *c = job->ctx;
+    GLsizei begin = (GLsizei)chunk * PARALLEL_VERTEX_CHUNK;
+    GLsizei end = begin + PARALLEL_VERTEX_CHUNK;
+    if (end > job->count) end = job->count;
+
+    /* Color material only depends on the vertex's own color, so private copies of
+     * the materials give the same result as processing the whole draw in order */
+    material_t front = c->material_front, back = c->material_back;
+    vertex_batch_t batch;
+    uint32_t idx[VERTEX_BATCH_SIZE];
+    array_fetch_prepare(job->fetch, c, &batch);
+
+    for (GLsizei i = begin; i < end; i += VERTEX_BATCH_SIZE) {
+        size_t n = (size_t)(end - i) < VERTEX_BATCH_SIZE ? (size_t)(end - i) : VERTEX_BATCH_SIZE;
+        array_draw_indices(job->draw, i, n, idx);
+        array_fetch_batch(job->fetch, idx, n, &batch);
+        vertex_process_batch(c, &front, &back, &batch, n, &job->out[i]);
+    }
+}
+
+/* Indexed triangles whose indices span fewer than this many vertices per index are
+ * transformed over that range; sparser ones go through the post-transform cache */
+#define ELEMENT_RANGE_FACTOR 2
+
+/* Indexed triangle draws: transform the vertices the indices span once each, in array
+ * order, and list them for primitive assembly through the element buffer. Returns the
+ * non-indexed draw covering the span in *range, or 0 when the indices are too sparse
+ * (see draw_elements_cached). */
+static int draw_elements_range(const array_draw_t *draw, GLsizei count, array_draw_t *range,
+                               GLsizei *range_count)
+{
+    GLint lo = array_draw_index(draw, 0), hi = lo;
+    for (GLsizei i = 1; i < count; i++) {
+        GLint idx = array_draw_index(draw, i);
+        if (idx < lo) lo = idx;
+        if (idx > hi) hi = idx;
+    }
+    if (lo < 0 || (int64_t)hi - lo >= (int64_t)count * ELEMENT_RANGE_FACTOR) return 0;
+
+    uint32_t *elements = element_buffer_reserve(ctx, (size_t)count);
+    if (!elements) return 0;
+    uint32_t base = (uint32_t)(ctx->vertices.count - (size_t)lo);
+    for (GLsizei i = 0; i < count; i++) {
+        elements[i] = base + (uint32_t)array_draw_index(draw, i);
+    }
+    ctx->elements.count = (size_t)count;
+
+    *range = *draw;
+    range->indices = NULL;
+    range->first = lo;
+    *range_count = hi - lo + 1;
+    return 1;
+}
+
+/* Sparse indexed triangle draws (offset sub-meshes of a large array, sparse strips): a
+ * post-transform cache, an open-addressing hash from array index to vertex buffer slot,
+ * gives each distinct index one slot, so shared vertices are still transformed once.
+ * Returns the draw of the distinct indices, in first-use order, in *unique, or 0 when
+ * out of memory. */
+static int draw_elements_cached(const array_draw_t *draw, GLsizei count, array_draw_t *unique,
+                                GLsizei *unique_count)
+{
+    element_buffer_t *eb = &ctx->elements;
+    size_t size = 16;
+    while (size < (size_t)count * 2) size *= 2;
+    if (size > eb->cache_capacity) {
+        element_cache_entry_t *cache = mtgl_realloc(eb->cache, size * sizeof(element_cache_entry_t));
+        if (cache) eb->cache = cache;
+        uint32_t *indices = cache ? mtgl_realloc(eb->unique, size / 2 * sizeof(uint32_t)) : NULL;
+        if (!indices) {
+            gl_set_error(ctx, GL_OUT_OF_MEMORY);
+            return 0;
+        }
+        eb->unique = indices;
+        eb->cache_capacity = size;
+    }
+
+    uint32_t *elements = element_buffer_reserve(ctx, (size_t)count);
+    if (!elements) return 0;
+    memset(eb->cache, 0xff, size * sizeof(element_cache_entry_t));
+    uint32_t base = (uint32_t)ctx->vertices.count, mask = (uint32_t)size - 1, n = 0;
+    for (GLsizei i = 0; i < count; i++) {
+        uint32_t idx = (uint32_t)array_draw_index(draw, i);
+        uint32_t h = (idx * 2654435761u) & mask;
+        while (eb->cache[h].slot != UINT32_MAX && eb->cache[h].index != idx) {
+            h = (h + 1) & mask;
+        }
+        if (eb->cache[h].slot == UINT32_MAX) {
+            eb->cache[h].index = idx;
+            eb->cache[h].slot = n;
+            eb->unique[n++] = idx;
+        }
+        elements[i] = base + eb->cache[h].slot;
+    }
+    ctx->elements.count = (size_t)count;
+
+    *unique = *draw;
+    unique->indices = eb->unique;
+    unique->index_type = GL_UNSIGNED_INT;
+    *unique_count = (GLsizei)n;
+    return 1;
+}
+
+/* Draws that are not recorded (display list compilation, async mode) nor inside
+ * glBegin/glEnd read their arrays with the fetchers of arrays.h and are transformed in
+ * batches straight into the vertex buffer, in chunks on the render threads when large
+ * enough, then assembled in order by glEnd. A negative first (default attributes for
+ * the elements before the array) takes the per-vertex path. Returns 1 if the draw was
+ * handled. */
+static int draw_arrays_batched(GLenum mode, const array_draw_t *draw, GLsizei count)
+{
+    if (ctx->queue || ctx->list_index != 0 || (ctx->flags & FLAG_INSIDE_BEGIN_END) ||
+        mode > GL_POLYGON || (!draw->indices && draw->first < 0)) {
+        return 0;
+    }
+
+    glBegin(mode);
+
+    /* Vertices shared by several triangles are transformed once */
+    array_draw_t range;
+    const array_draw_t *src = draw;
+    GLsizei n = count;
+    if (draw->indices && mode >= GL_TRIANGLES && count > 0 &&
+        (draw_elements_range(draw, count, &range, &n) ||
+         draw_elements_cached(draw, count, &range, &n))) {
+        src = &range;
+    }
+
+    vertex_t *out = count > 0 ? vertex_buffer_reserve(ctx, (size_t)n) : NULL;
+    if (out) {
+        array_fetch_t fetch;
+        array_fetch_init(&fetch, ctx, draw->vertex_base, draw->color_base,
+                         draw->texcoord_base, draw->normal_base);
+        vertex_job_t job = { ctx, src, &fetch, out, n };
+        gl_validate_transform(ctx);
+        uint32_t chunks = (uint32_t)((n + PARALLEL_VERTEX_CHUNK - 1) / PARALLEL_VERTEX_CHUNK);
+        if (ctx->workers && n >= PARALLEL_VERTEX_MIN) {
+            worker_pool_run(ctx->workers, process_vertex_chunk, &job, chunks);
+        } else {
+            for (uint32_t i = 0; i < chunks; i++) process_vertex_chunk(&job, i);
+        }
+        ctx->vertices.count += (size_t)n;
+
+        /* Leave the current attributes and materials as the last vertex set them */
+        float v[4];
+        fetch_array_vertex(ctx, draw, count - 1, v,
+                           &ctx->current_color, &ctx->current_texcoord, &ctx->current_normal);
+        if ((ctx->flags & FLAG_LIGHTING) && (ctx->flags & FLAG_COLOR_MATERIAL)) {
+            vertex_apply_color_material(ctx, &ctx->material_front, &ctx->material_back, ctx->current_color);
+        }
+    } else {
+        ctx->elements.count = 0;
+    }
+    glEnd();
+    return 1;
+}
+
+static void draw_arrays(GLenum mode, GLint first, GLsizei count)
 {
-    CHECK_CTX();
     if (count < 0) {
         gl_set_error(ctx, GL_INVALID_VALUE);
         return;
@@ -1815,6 +2433,10 @@ void glDrawArrays(GLenum mode, GLint first, GLsizei count)
         return;
     }
 
+    array_draw_t draw = { vertex_base, color_base, texcoord_base, normal_base, NULL, 0, first };
+    if (draw_arrays_batched(mode, &draw, count)) return;
+
+    /* Recorded: the vertices are batched when the commands are replayed */
     glBegin(mode);
     for (GLsizei i = 0; i < count; i++) {
         GLint idx = first + i;
@@ -1851,9 +2473,16 @@ void glDrawArrays(GLenum mode, GLint first, GLsizei count)
     glEnd();
 }
 
-void glDrawElements(GLenum mode, GLsizei count, GLenum type, const GLvoid *indices)
+void glDrawArrays(GLenum mode, GLint first, GLsizei count)
+{
+    CHECK_CTX_RECORD();  /* Reads client-side state only; emits recordable commands */
+    share_read_lock(ctx);  /* Buffer objects */
+    draw_arrays(mode, first, count);
+    share_read_unlock(ctx);
+}
+
+static void draw_elements(GLenum mode, GLsizei count, GLenum type, const GLvoid *indices)
 {
-    CHECK_CTX();
     if (count < 0) {
         gl_set_error(ctx, GL_INVALID_VALUE);
         return;
@@ -1876,7 +2505,7 @@ void glDrawElements(GLenum mode, GLsizei count, GLenum type, const GLvoid *indic
     /* Handle element array buffer */
     const void *index_data = indices;
     if (ctx->bound_element_buffer) {
-        buffer_t *buf = buffer_get(&ctx->buffers, ctx->bound_element_buffer);
+        buffer_t *buf = buffer_get(&ctx->shared->buffers, ctx->bound_element_buffer);
         if (buf && buf->data) {
             /* When a buffer is bound, indices is interpreted as a byte offset */
             uintptr_t offset = (uintptr_t)indices;
@@ -1894,6 +2523,10 @@ void glDrawElements(GLenum mode, GLsizei count, GLenum type, const GLvoid *indic
         return;
     }
 
+    array_draw_t draw = { vertex_base, color_base, texcoord_base, normal_base, index_data, type, 0 };
+    if (draw_arrays_batched(mode, &draw, count)) return;
+
+    /* Recorded: the vertices are batched when the commands are replayed */
     glBegin(mode);
     for (GLsizei i = 0; i < count; i++) {
         GLuint idx;
@@ -1940,11 +2573,19 @@ void glDrawElements(GLenum mode, GLsizei count, GLenum type, const GLvoid *indic
     glEnd();
 }
 
+void glDrawElements(GLenum mode, GLsizei count, GLenum type, const GLvoid *indices)
+{
+    CHECK_CTX_RECORD();  /* Reads client-side state only; emits recordable commands */
+    share_read_lock(ctx);  /* Buffer objects */
+    draw_elements(mode, count, type, indices);
+    share_read_unlock(ctx);
+}
+
 /* Lighting functions */
 
 void glLightfv(GLenum light, GLenum pname, const GLfloat *params)
 {
-    CHECK_CTX();
+    CHECK_CTX_RECORD();
     if (list_record_lightfv(light, pname, params)) return;
     if (light < GL_LIGHT0 || light > GL_LIGHT7) {
         gl_set_error(ctx, GL_INVALID_ENUM);
@@ -1997,7 +2638,7 @@ void glLightfv(GLenum light, GLenum pname, const GLfloat *params)
 
 void glLightf(GLenum light, GLenum pname, GLfloat param)
 {
-    CHECK_CTX();
+    CHECK_CTX_RECORD();
     if (list_record_lightf(light, pname, param)) return;
     GLfloat params[4] = {param, param, param, param};
     glLightfv(light, pname, params);
@@ -2017,9 +2658,12 @@ void glLightiv(GLenum light, GLenum pname, const GLint *params)
 
 void glMaterialfv(GLenum face, GLenum pname, const GLfloat *params)
 {
-    CHECK_CTX();
+    CHECK_CTX_RECORD();
     if (list_record_materialfv(face, pname, params)) return;
 
+    /* Vertices already specified are lit with the previous material */
+    flush_staged_vertices(ctx);
+
     /* Validate face parameter */
     if (face != GL_FRONT && face != GL_BACK && face != GL_FRONT_AND_BACK) {
         gl_set_error(ctx, GL_INVALID_ENUM);
@@ -2064,7 +2708,7 @@ void glMaterialfv(GLenum face, GLenum pname, const GLfloat *params)
 
 void glMaterialf(GLenum face, GLenum pname, GLfloat param)
 {
-    CHECK_CTX();
+    CHECK_CTX_RECORD();
     if (list_record_materialf(face, pname, param)) return;
     GLfloat params[4] = {param, param, param, param};
     glMaterialfv(face, pname, params);
@@ -2252,7 +2896,7 @@ void glGetMaterialfv(GLenum face, GLenum pname, GLfloat *params)
 
 void glShadeModel(GLenum mode)
 {
-    CHECK_CTX();
+    CHECK_CTX_RECORD();
     if (list_record_shade_model(mode)) return;
     if (mode != GL_FLAT && mode != GL_SMOOTH && mode != GL_PHONG) {
         gl_set_error(ctx, GL_INVALID_ENUM);
@@ -2272,7 +2916,10 @@ GLuint glGenLists(GLsizei range)
         gl_set_error(ctx, GL_INVALID_VALUE);
         return 0;
     }
-    return list_alloc_range(&ctx->lists, range);
+    share_write_lock(ctx);
+    GLuint first = list_alloc_range(&ctx->shared->lists, range);
+    share_write_unlock(ctx);
+    return first;
 }
 
 void glDeleteLists(GLuint list, GLsizei range)
@@ -2282,9 +2929,11 @@ void glDeleteLists(GLuint list, GLsizei range)
         gl_set_error(ctx, GL_INVALID_VALUE);
         return;
     }
+    share_write_lock(ctx);
     for (GLsizei i = 0; i < range; i++) {
-        list_free(&ctx->lists, list + i);
+        list_free(&ctx->shared->lists, list + i);
     }
+    share_write_unlock(ctx);
 }
 
 void glNewList(GLuint list, GLenum mode)
@@ -2299,13 +2948,17 @@ void glNewList(GLuint list, GLenum mode)
         return;
     }
 
-    display_list_t *dlist = list_get(&ctx->lists, list);
+    share_read_lock(ctx);
+    display_list_t *dlist = list_get(&ctx->shared->lists, list);
+    share_read_unlock(ctx);
     if (!dlist) {
         gl_set_error(ctx, GL_INVALID_VALUE);
         return;
     }
 
-    list_clear(dlist);
+    /* Compile aside: the list keeps its old commands (other contexts may be calling
+     * it) until glEndList replaces them */
+    list_clear(&ctx->list_pending);
     ctx->list_index = list;
     ctx->list_mode = mode;
 }
@@ -2318,129 +2971,164 @@ void glEndList(void)
         return;
     }
 
-    display_list_t *list = list_get(&ctx->lists, ctx->list_index);
+    /* Swap the compiled commands in; the old array is reused for the next list */
+    share_write_lock(ctx);
+    display_list_t *list = list_get(&ctx->shared->lists, ctx->list_index);
     if (list) {
+        display_list_t old = *list;
+        list->commands = ctx->list_pending.commands;
+        list->count = ctx->list_pending.count;
+        list->capacity = ctx->list_pending.capacity;
         list->valid = GL_TRUE;
+        ctx->list_pending.commands = old.commands;
+        ctx->list_pending.capacity = old.capacity;
     }
+    ctx->list_pending.count = 0;
+    share_write_unlock(ctx);
 
     ctx->list_index = 0;
     ctx->list_mode = 0;
 }
 
+/* Execute one recorded command (display lists, async queue) */
+void gl_execute_command(const list_command_t *cmd)
+{
+    switch (cmd->opcode) {
+        case CMD_BEGIN:
+            glBegin(cmd->data.begin.mode);
+            break;
+        case CMD_END:
+            glEnd();
+            break;
+        case CMD_VERTEX:
+            glVertex3f(cmd->data.vertex.x, cmd->data.vertex.y, cmd->data.vertex.z);
+            break;
+        case CMD_COLOR:
+            glColor4f(cmd->data.color.r, cmd->data.color.g, cmd->data.color.b, cmd->data.color.a);
+            break;
+        case CMD_TEXCOORD:
+            glTexCoord2f(cmd->data.texcoord.s, cmd->data.texcoord.t);
+            break;
+        case CMD_NORMAL:
+            glNormal3f(cmd->data.normal.x, cmd->data.normal.y, cmd->data.normal.z);
+            break;
+        case CMD_TRANSLATEF:
+            glTranslatef(cmd->data.translatef.x, cmd->data.translatef.y, cmd->data.translatef.z);
+            break;
+        case CMD_ROTATEF:
+            glRotatef(cmd->data.rotatef.angle, cmd->data.rotatef.x, cmd->data.rotatef.y, cmd->data.rotatef.z);
+            break;
+        case CMD_SCALEF:
+            glScalef(cmd->data.scalef.x, cmd->data.scalef.y, cmd->data.scalef.z);
+            break;
+        case CMD_PUSH_MATRIX:
+            glPushMatrix();
+            break;
+        case CMD_POP_MATRIX:
+            glPopMatrix();
+            break;
+        case CMD_LOAD_IDENTITY:
+            glLoadIdentity();
+            break;
+        case CMD_MULT_MATRIXF:
+            glMultMatrixf(cmd->data.matrix.m);
+            break;
+        case CMD_LOAD_MATRIXF:
+            glLoadMatrixf(cmd->data.matrix.m);
+            break;
+        case CMD_MATRIX_MODE:
+            glMatrixMode(cmd->data.matrix_mode.mode);
+            break;
+        case CMD_ENABLE:
+            glEnable(cmd->data.enable.cap);
+            break;
+        case CMD_DISABLE:
+            glDisable(cmd->data.enable.cap);
+            break;
+        case CMD_BIND_TEXTURE:
+            glBindTexture(cmd->data.bind_texture.target, cmd->data.bind_texture.texture);
+            break;
+        case CMD_BLEND_FUNC:
+            glBlendFunc(cmd->data.blend_func.sfactor, cmd->data.blend_func.dfactor);
+            break;
+        case CMD_DEPTH_FUNC:
+            glDepthFunc(cmd->data.depth_func.func);
+            break;
+        case CMD_DEPTH_MASK:
+            glDepthMask(cmd->data.depth_mask.flag);
+            break;
+        case CMD_CULL_FACE:
+            glCullFace(cmd->data.cull_face.mode);
+            break;
+        case CMD_FRONT_FACE:
+            glFrontFace(cmd->data.front_face.mode);
+            break;
+        case CMD_SHADE_MODEL:
+            glShadeModel(cmd->data.shade_model.mode);
+            break;
+        case CMD_LIGHTF:
+            glLightf(cmd->data.lightf.light, cmd->data.lightf.pname, cmd->data.lightf.param);
+            break;
+        case CMD_LIGHTFV:
+            glLightfv(cmd->data.lightfv.light, cmd->data.lightfv.pname, cmd->data.lightfv.params);
+            break;
+        case CMD_MATERIALF:
+            glMaterialf(cmd->data.materialf.face, cmd->data.materialf.pname, cmd->data.materialf.param);
+            break;
+        case CMD_MATERIALFV:
+            glMaterialfv(cmd->data.materialfv.face, cmd->data.materialfv.pname, cmd->data.materialfv.params);
+            break;
+        case CMD_CALL_LIST:
+            glCallList(cmd->data.call_list.list);
+            break;
+        case CMD_ORTHO:
+            glOrtho(cmd->data.ortho.left, cmd->data.ortho.right,
+                    cmd->data.ortho.bottom, cmd->data.ortho.top,
+                    cmd->data.ortho.near_val, cmd->data.ortho.far_val);
+            break;
+        case CMD_FRUSTUM:
+            glFrustum(cmd->data.frustum.left, cmd->data.frustum.right,
+                      cmd->data.frustum.bottom, cmd->data.frustum.top,
+                      cmd->data.frustum.near_val, cmd->data.frustum.far_val);
+            break;
+        case CMD_CLEAR:
+            glClear(cmd->data.clear.mask);
+            break;
+        case CMD_CLEAR_COLOR:
+            glClearColor(cmd->data.clear_color.r, cmd->data.clear_color.g,
+                         cmd->data.clear_color.b, cmd->data.clear_color.a);
+            break;
+        case CMD_CLEAR_DEPTH:
+            glClearDepth(cmd->data.clear_depth.depth);
+            break;
+        case CMD_VIEWPORT:
+            glViewport(cmd->data.viewport.x, cmd->data.viewport.y,
+                       cmd->data.viewport.width, cmd->data.viewport.height);
+            break;
+        case CMD_WAIT_SYNC:
+            fence_wait(cmd->data.wait_sync.sync, GL_TIMEOUT_IGNORED);
+            fence_release(cmd->data.wait_sync.sync);
+            break;
+        case CMD_COLOR_BUFFER:
+            gl_set_color_buffer(ctx, cmd->data.color_buffer.pixels);
+            break;
+    }
+}
+
 /* Execute a single display list */
 static void execute_list(GLuint list_id)
 {
-    display_list_t *list = list_get(&ctx->lists, list_id);
+    display_list_t *list = list_get(&ctx->shared->lists, list_id);
     if (!list || !list->valid) return;
 
     for (size_t i = 0; i < list->count; i++) {
-        list_command_t *cmd = &list->commands[i];
-
-        switch (cmd->opcode) {
-            case CMD_BEGIN:
-                glBegin(cmd->data.begin.mode);
-                break;
-            case CMD_END:
-                glEnd();
-                break;
-            case CMD_VERTEX:
-                glVertex3f(cmd->data.vertex.x, cmd->data.vertex.y, cmd->data.vertex.z);
-                break;
-            case CMD_COLOR:
-                glColor4f(cmd->data.color.r, cmd->data.color.g, cmd->data.color.b, cmd->data.color.a);
-                break;
-            case CMD_TEXCOORD:
-                glTexCoord2f(cmd->data.texcoord.s, cmd->data.texcoord.t);
-                break;
-            case CMD_NORMAL:
-                glNormal3f(cmd->data.normal.x, cmd->data.normal.y, cmd->data.normal.z);
-                break;
-            case CMD_TRANSLATEF:
-                glTranslatef(cmd->data.translatef.x, cmd->data.translatef.y, cmd->data.translatef.z);
-                break;
-            case CMD_ROTATEF:
-                glRotatef(cmd->data.rotatef.angle, cmd->data.rotatef.x, cmd->data.rotatef.y, cmd->data.rotatef.z);
-                break;
-            case CMD_SCALEF:
-                glScalef(cmd->data.scalef.x, cmd->data.scalef.y, cmd->data.scalef.z);
-                break;
-            case CMD_PUSH_MATRIX:
-                glPushMatrix();
-                break;
-            case CMD_POP_MATRIX:
-                glPopMatrix();
-                break;
-            case CMD_LOAD_IDENTITY:
-                glLoadIdentity();
-                break;
-            case CMD_MULT_MATRIXF:
-                glMultMatrixf(cmd->data.matrix.m);
-                break;
-            case CMD_LOAD_MATRIXF:
-                glLoadMatrixf(cmd->data.matrix.m);
-                break;
-            case CMD_MATRIX_MODE:
-                glMatrixMode(cmd->data.matrix_mode.mode);
-                break;
-            case CMD_ENABLE:
-                glEnable(cmd->data.enable.cap);
-                break;
-            case CMD_DISABLE:
-                glDisable(cmd->data.enable.cap);
-                break;
-            case CMD_BIND_TEXTURE:
-                glBindTexture(cmd->data.bind_texture.target, cmd->data.bind_texture.texture);
-                break;
-            case CMD_BLEND_FUNC:
-                glBlendFunc(cmd->data.blend_func.sfactor, cmd->data.blend_func.dfactor);
-                break;
-            case CMD_DEPTH_FUNC:
-                glDepthFunc(cmd->data.depth_func.func);
-                break;
-            case CMD_DEPTH_MASK:
-                glDepthMask(cmd->data.depth_mask.flag);
-                break;
-            case CMD_CULL_FACE:
-                glCullFace(cmd->data.cull_face.mode);
-                break;
-            case CMD_FRONT_FACE:
-                glFrontFace(cmd->data.front_face.mode);
-                break;
-            case CMD_SHADE_MODEL:
-                glShadeModel(cmd->data.shade_model.mode);
-                break;
-            case CMD_LIGHTF:
-                glLightf(cmd->data.lightf.light, cmd->data.lightf.pname, cmd->data.lightf.param);
-                break;
-            case CMD_LIGHTFV:
-                glLightfv(cmd->data.lightfv.light, cmd->data.lightfv.pname, cmd->data.lightfv.params);
-                break;
-            case CMD_MATERIALF:
-                glMaterialf(cmd->data.materialf.face, cmd->data.materialf.pname, cmd->data.materialf.param);
-                break;
-            case CMD_MATERIALFV:
-                glMaterialfv(cmd->data.materialfv.face, cmd->data.materialfv.pname, cmd->data.materialfv.params);
-                break;
-            case CMD_CALL_LIST:
-                glCallList(cmd->data.call_list.list);
-                break;
-            case CMD_ORTHO:
-                glOrtho(cmd->data.ortho.left, cmd->data.ortho.right,
-                        cmd->data.ortho.bottom, cmd->data.ortho.top,
-                        cmd->data.ortho.near_val, cmd->data.ortho.far_val);
-                break;
-            case CMD_FRUSTUM:
-                glFrustum(cmd->data.frustum.left, cmd->data.frustum.right,
-                          cmd->data.frustum.bottom, cmd->data.frustum.top,
-                          cmd->data.frustum.near_val, cmd->data.frustum.far_val);
-                break;
-        }
+        gl_execute_command(&list->commands[i]);
     }
 }
 
 void glCallList(GLuint list)
 {
-    CHECK_CTX();
+    CHECK_CTX_RECORD();
     if (list_record_call_list(list)) return;
 
     /* Check recursion depth to prevent stack overflow */
@@ -2450,7 +3138,9 @@ void glCallList(GLuint list)
     }
 
     ctx->list_call_depth++;
+    share_read_lock(ctx);  /* Nested calls and draws in the list only count the lock */
     execute_list(list);
+    share_read_unlock(ctx);
     ctx->list_call_depth--;
 }
 
@@ -2494,8 +3184,11 @@ void glListBase(GLuint base)
 GLboolean glIsList(GLuint list)
 {
     CHECK_CTX_RET(GL_FALSE);
-    display_list_t *dlist = list_get(&ctx->lists, list);
-    return (dlist && dlist->valid) ? GL_TRUE : GL_FALSE;
+    share_read_lock(ctx);
+    display_list_t *dlist = list_get(&ctx->shared->lists, list);
+    GLboolean valid = (dlist && dlist->valid) ? GL_TRUE : GL_FALSE;
+    share_read_unlock(ctx);
+    return valid;
 }
 
 /* ============================================================
@@ -3250,16 +3943,51 @@ GLboolean glIsTexture(GLuint texture)
 
     if (texture == 0) return GL_FALSE;
 
-    texture_t *tex = texture_get(&ctx->textures, texture);
+    share_read_lock(ctx);
+    texture_t *tex = texture_get(&ctx->shared->textures, texture);
+    share_read_unlock(ctx);
     return (tex != NULL) ? GL_TRUE : GL_FALSE;
 }
 
+/* A texture is resident once its background upload (if any) has completed.
+ * As in GL, residences is only written when some texture is not resident. */
+GLboolean glAreTexturesResident(GLsizei n, const GLuint *textures, GLboolean *residences)
+{
+    CHECK_CTX_RET(GL_FALSE);
+    if (n < 0) {
+        gl_set_error(ctx, GL_INVALID_VALUE);
+        return GL_FALSE;
+    }
+
+    GLboolean all = GL_TRUE;
+    share_read_lock(ctx);
+    for (GLsizei i = 0; i < n; i++) {
+        texture_t *tex = texture_get(&ctx->shared->textures, textures[i]);
+        if (!tex) {
+            gl_set_error(ctx, GL_INVALID_VALUE);
+            share_read_unlock(ctx);
+            return GL_FALSE;
+        }
+        if (!upload_ready(tex)) all = GL_FALSE;
+    }
+    if (!all) {
+        for (GLsizei i = 0; i < n; i++) {
+            texture_t *tex = texture_get(&ctx->shared->textures, textures[i]);
+            residences[i] = (tex && upload_ready(tex)) ? GL_TRUE : GL_FALSE;
+        }
+    }
+    share_read_unlock(ctx);
+    return all;
+}
+
 GLboolean glIsBuffer(GLuint buffer)
 {
     CHECK_CTX_RET(GL_FALSE);
 
     if (buffer == 0) return GL_FALSE;
 
-    buffer_t *buf = buffer_get(&ctx->buffers, buffer);
+    share_read_lock(ctx);
+    buffer_t *buf = buffer_get(&ctx->shared->buffers, buffer);
+    share_read_unlock(ctx);
     return (buf != NULL) ? GL_TRUE : GL_FALSE;
 }
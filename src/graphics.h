@@ -137,6 +137,16 @@ static inline vec4_t mat4_mul_vec4(mat4_t m, vec4_t v) {
     };
 }
 
+/* Same with the matrix in a GL array, without copying it */
+static inline vec4_t mat4_array_mul_vec4(const float *m, vec4_t v) {
+    return (vec4_t){
+        m[0]*v.x + m[4]*v.y + m[8]*v.z  + m[12]*v.w,
+        m[1]*v.x + m[5]*v.y + m[9]*v.z  + m[13]*v.w,
+        m[2]*v.x + m[6]*v.y + m[10]*v.z + m[14]*v.w,
+        m[3]*v.x + m[7]*v.y + m[11]*v.z + m[15]*v.w
+    };
+}
+
 static inline mat4_t mat4_mul(mat4_t a, mat4_t b) {
     mat4_t result;
     for (int col = 0; col < 4; col++) {
@@ -439,38 +449,47 @@ typedef struct vertex_t {
     vec4_t position;      /* Clip-space position */
     color_t color;        /* Vertex color (lit for Gouraud, unlit for Phong) */
     vec2_t texcoord;
-    vec3_t normal;        /* Object-space normal (for Phong: eye-space) */
     float eye_z;          /* Eye-space Z for fog */
     vec3_t eye_pos;       /* Eye-space position (for Phong shading) */
     vec3_t eye_normal;    /* Eye-space normal (for Phong shading) */
 } vertex_t;
 
-static inline vertex_t vertex_full(vec4_t pos, color_t col, vec2_t tex, vec3_t norm, float ez) {
+/* Vertex attributes read after the vertex stage besides position and color (see
+ * gl_vertex_live); the others are not computed, clipped or set up */
+#define VERTEX_LIVE_TEXCOORD (1 << 0)   /* Texturing */
+#define VERTEX_LIVE_FOG      (1 << 1)   /* eye_z */
+#define VERTEX_LIVE_EYE      (1 << 2)   /* eye_pos, eye_normal: per-fragment or two-sided lighting */
+
+static inline vertex_t vertex_full(vec4_t pos, color_t col, vec2_t tex, float ez) {
     vertex_t v;
     v.position = pos;
     v.color = col;
     v.texcoord = tex;
-    v.normal = norm;
     v.eye_z = ez;
     v.eye_pos = vec3(0, 0, 0);
     v.eye_normal = vec3(0, 0, 1);
     return v;
 }
 
-static inline vertex_t vertex(vec4_t pos, color_t col, vec2_t tex, vec3_t norm) {
-    return vertex_full(pos, col, tex, norm, 0.0f);
+static inline vertex_t vertex(vec4_t pos, color_t col, vec2_t tex) {
+    return vertex_full(pos, col, tex, 0.0f);
 }
 
-/* Interpolate all vertex attributes */
-static inline vertex_t vertex_lerp(vertex_t *a, vertex_t *b, float t) {
-    vertex_t v;
-    v.position   = vec4_lerp(a->position, b->position, t);
-    v.color      = color_lerp(a->color, b->color, t);
-    v.texcoord   = vec2_lerp(a->texcoord, b->texcoord, t);
-    v.normal     = vec3_lerp(a->normal, b->normal, t);
-    v.eye_z      = lerpf(a->eye_z, b->eye_z, t);
-    v.eye_pos    = vec3_lerp(a->eye_pos, b->eye_pos, t);
-    v.eye_normal = vec3_lerp(a->eye_normal, b->eye_normal, t);
+/* Interpolate the live vertex attributes (VERTEX_LIVE_*); the others are copied from a */
+static inline vertex_t vertex_lerp(vertex_t *a, vertex_t *b, float t, uint32_t live) {
+    vertex_t v = *a;
+    v.position = vec4_lerp(a->position, b->position, t);
+    v.color    = color_lerp(a->color, b->color, t);
+    if (live & VERTEX_LIVE_TEXCOORD) {
+        v.texcoord = vec2_lerp(a->texcoord, b->texcoord, t);
+    }
+    if (live & VERTEX_LIVE_FOG) {
+        v.eye_z = lerpf(a->eye_z, b->eye_z, t);
+    }
+    if (live & VERTEX_LIVE_EYE) {
+        v.eye_pos    = vec3_lerp(a->eye_pos, b->eye_pos, t);
+        v.eye_normal = vec3_lerp(a->eye_normal, b->eye_normal, t);
+    }
     return v;
 }
 
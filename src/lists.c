@@ -5,6 +5,7 @@
 
 #include "lists.h"
 #include "mytinygl.h"
+#include "queue.h"
 #include "allocation.h"
 
 #define INITIAL_LIST_CAPACITY 16
@@ -177,20 +178,26 @@ int list_add_command(display_list_t *list, const list_command_t *cmd)
 
 /*
  * Recording helper functions
- * These return 1 if execution should be skipped (GL_COMPILE mode)
+ * These return 1 if execution should be skipped (GL_COMPILE mode, or queued in async mode)
  * Return 0 if should execute (not compiling, or GL_COMPILE_AND_EXECUTE)
  */
 
+/* Commands are recorded while compiling a list, and on the application thread in
+ * async mode. Compiling takes precedence: glNewList drains the queue. */
+static int recording(GLState *ctx)
+{
+    return ctx && (ctx->list_index != 0 || (ctx->queue && queue_recording(ctx)));
+}
+
 /* Helper: record command to current list */
 static int record_cmd(const list_command_t *cmd)
 {
     GLState *ctx = gl_get_current_context();
-    if (!ctx || ctx->list_index == 0) return 0;
+    if (!recording(ctx)) return 0;
+    if (ctx->list_index == 0) return queue_record(ctx, cmd);
 
-    display_list_t *list = list_get(&ctx->lists, ctx->list_index);
-    if (list) {
-        list_add_command(list, cmd);
-    }
+    /* Compiled aside, glEndList publishes the list */
+    list_add_command(&ctx->list_pending, cmd);
 
     /* Return 1 to skip execution if GL_COMPILE only */
     return (ctx->list_mode == GL_COMPILE);
@@ -199,49 +206,49 @@ static int record_cmd(const list_command_t *cmd)
 int list_record_begin(GLenum mode)
 {
     GLState *ctx = gl_get_current_context();
-    if (!ctx || ctx->list_index == 0) return 0;
+    if (!recording(ctx)) return 0;
     return record_cmd(&(list_command_t){ CMD_BEGIN, .data.begin = { mode } });
 }
 
 int list_record_end(void)
 {
     GLState *ctx = gl_get_current_context();
-    if (!ctx || ctx->list_index == 0) return 0;
+    if (!recording(ctx)) return 0;
     return record_cmd(&(list_command_t){ CMD_END });
 }
 
 int list_record_vertex(GLfloat x, GLfloat y, GLfloat z)
 {
     GLState *ctx = gl_get_current_context();
-    if (!ctx || ctx->list_index == 0) return 0;
+    if (!recording(ctx)) return 0;
     return record_cmd(&(list_command_t){ CMD_VERTEX, .data.vertex = { x, y, z } });
 }
 
 int list_record_color(GLfloat r, GLfloat g, GLfloat b, GLfloat a)
 {
     GLState *ctx = gl_get_current_context();
-    if (!ctx || ctx->list_index == 0) return 0;
+    if (!recording(ctx)) return 0;
     return record_cmd(&(list_command_t){ CMD_COLOR, .data.color = { r, g, b, a } });
 }
 
 int list_record_texcoord(GLfloat s, GLfloat t)
 {
     GLState *ctx = gl_get_current_context();
-    if (!ctx || ctx->list_index == 0) return 0;
+    if (!recording(ctx)) return 0;
     return record_cmd(&(list_command_t){ CMD_TEXCOORD, .data.texcoord = { s, t } });
 }
 
 int list_record_normal(GLfloat x, GLfloat y, GLfloat z)
 {
     GLState *ctx = gl_get_current_context();
-    if (!ctx || ctx->list_index == 0) return 0;
+    if (!recording(ctx)) return 0;
     return record_cmd(&(list_command_t){ CMD_NORMAL, .data.normal = { x, y, z } });
 }
 
 int list_record_call_list(GLuint list)
 {
     GLState *ctx = gl_get_current_context();
-    if (!ctx || ctx->list_index == 0) return 0;
+    if (!recording(ctx)) return 0;
     return record_cmd(&(list_command_t){ CMD_CALL_LIST, .data.call_list = { list } });
 }
 
@@ -249,49 +256,49 @@ int list_record_call_list(GLuint list)
 int list_record_translatef(GLfloat x, GLfloat y, GLfloat z)
 {
     GLState *ctx = gl_get_current_context();
-    if (!ctx || ctx->list_index == 0) return 0;
+    if (!recording(ctx)) return 0;
     return record_cmd(&(list_command_t){ CMD_TRANSLATEF, .data.translatef = { x, y, z } });
 }
 
 int list_record_rotatef(GLfloat angle, GLfloat x, GLfloat y, GLfloat z)
 {
     GLState *ctx = gl_get_current_context();
-    if (!ctx || ctx->list_index == 0) return 0;
+    if (!recording(ctx)) return 0;
     return record_cmd(&(list_command_t){ CMD_ROTATEF, .data.rotatef = { angle, x, y, z } });
 }
 
 int list_record_scalef(GLfloat x, GLfloat y, GLfloat z)
 {
     GLState *ctx = gl_get_current_context();
-    if (!ctx || ctx->list_index == 0) return 0;
+    if (!recording(ctx)) return 0;
     return record_cmd(&(list_command_t){ CMD_SCALEF, .data.scalef = { x, y, z } });
 }
 
 int list_record_push_matrix(void)
 {
     GLState *ctx = gl_get_current_context();
-    if (!ctx || ctx->list_index == 0) return 0;
+    if (!recording(ctx)) return 0;
     return record_cmd(&(list_command_t){ CMD_PUSH_MATRIX });
 }
 
 int list_record_pop_matrix(void)
 {
     GLState *ctx = gl_get_current_context();
-    if (!ctx || ctx->list_index == 0) return 0;
+    if (!recording(ctx)) return 0;
     return record_cmd(&(list_command_t){ CMD_POP_MATRIX });
 }
 
 int list_record_load_identity(void)
 {
     GLState *ctx = gl_get_current_context();
-    if (!ctx || ctx->list_index == 0) return 0;
+    if (!recording(ctx)) return 0;
     return record_cmd(&(list_command_t){ CMD_LOAD_IDENTITY });
 }
 
 int list_record_mult_matrixf(const GLfloat *m)
 {
     GLState *ctx = gl_get_current_context();
-    if (!ctx || ctx->list_index == 0) return 0;
+    if (!recording(ctx)) return 0;
     list_command_t cmd = { CMD_MULT_MATRIXF };
     for (int i = 0; i < 16; i++) cmd.data.matrix.m[i] = m[i];
     return record_cmd(&cmd);
@@ -300,7 +307,7 @@ int list_record_mult_matrixf(const GLfloat *m)
 int list_record_load_matrixf(const GLfloat *m)
 {
     GLState *ctx = gl_get_current_context();
-    if (!ctx || ctx->list_index == 0) return 0;
+    if (!recording(ctx)) return 0;
     list_command_t cmd = { CMD_LOAD_MATRIXF };
     for (int i = 0; i < 16; i++) cmd.data.matrix.m[i] = m[i];
     return record_cmd(&cmd);
@@ -309,21 +316,21 @@ int list_record_load_matrixf(const GLfloat *m)
 int list_record_matrix_mode(GLenum mode)
 {
     GLState *ctx = gl_get_current_context();
-    if (!ctx || ctx->list_index == 0) return 0;
+    if (!recording(ctx)) return 0;
     return record_cmd(&(list_command_t){ CMD_MATRIX_MODE, .data.matrix_mode = { mode } });
 }
 
 int list_record_ortho(GLdouble left, GLdouble right, GLdouble bottom, GLdouble top, GLdouble near_val, GLdouble far_val)
 {
     GLState *ctx = gl_get_current_context();
-    if (!ctx || ctx->list_index == 0) return 0;
+    if (!recording(ctx)) return 0;
     return record_cmd(&(list_command_t){ CMD_ORTHO, .data.ortho = { left, right, bottom, top, near_val, far_val } });
 }
 
 int list_record_frustum(GLdouble left, GLdouble right, GLdouble bottom, GLdouble top, GLdouble near_val, GLdouble far_val)
 {
     GLState *ctx = gl_get_current_context();
-    if (!ctx || ctx->list_index == 0) return 0;
+    if (!recording(ctx)) return 0;
     return record_cmd(&(list_command_t){ CMD_FRUSTUM, .data.frustum = { left, right, bottom, top, near_val, far_val } });
 }
 
@@ -331,95 +338,143 @@ int list_record_frustum(GLdouble left, GLdouble right, GLdouble bottom, GLdouble
 int list_record_enable(GLenum cap)
 {
     GLState *ctx = gl_get_current_context();
-    if (!ctx || ctx->list_index == 0) return 0;
+    if (!recording(ctx)) return 0;
     return record_cmd(&(list_command_t){ CMD_ENABLE, .data.enable = { cap } });
 }
 
 int list_record_disable(GLenum cap)
 {
     GLState *ctx = gl_get_current_context();
-    if (!ctx || ctx->list_index == 0) return 0;
+    if (!recording(ctx)) return 0;
     return record_cmd(&(list_command_t){ CMD_DISABLE, .data.enable = { cap } });
 }
 
 int list_record_bind_texture(GLenum target, GLuint texture)
 {
     GLState *ctx = gl_get_current_context();
-    if (!ctx || ctx->list_index == 0) return 0;
+    if (!recording(ctx)) return 0;
     return record_cmd(&(list_command_t){ CMD_BIND_TEXTURE, .data.bind_texture = { target, texture } });
 }
 
 int list_record_blend_func(GLenum sfactor, GLenum dfactor)
 {
     GLState *ctx = gl_get_current_context();
-    if (!ctx || ctx->list_index == 0) return 0;
+    if (!recording(ctx)) return 0;
     return record_cmd(&(list_command_t){ CMD_BLEND_FUNC, .data.blend_func = { sfactor, dfactor } });
 }
 
 int list_record_depth_func(GLenum func)
 {
     GLState *ctx = gl_get_current_context();
-    if (!ctx || ctx->list_index == 0) return 0;
+    if (!recording(ctx)) return 0;
     return record_cmd(&(list_command_t){ CMD_DEPTH_FUNC, .data.depth_func = { func } });
 }
 
 int list_record_depth_mask(GLboolean flag)
 {
     GLState *ctx = gl_get_current_context();
-    if (!ctx || ctx->list_index == 0) return 0;
+    if (!recording(ctx)) return 0;
     return record_cmd(&(list_command_t){ CMD_DEPTH_MASK, .data.depth_mask = { flag } });
 }
 
 int list_record_cull_face(GLenum mode)
 {
     GLState *ctx = gl_get_current_context();
-    if (!ctx || ctx->list_index == 0) return 0;
+    if (!recording(ctx)) return 0;
     return record_cmd(&(list_command_t){ CMD_CULL_FACE, .data.cull_face = { mode } });
 }
 
 int list_record_front_face(GLenum mode)
 {
     GLState *ctx = gl_get_current_context();
-    if (!ctx || ctx->list_index == 0) return 0;
+    if (!recording(ctx)) return 0;
     return record_cmd(&(list_command_t){ CMD_FRONT_FACE, .data.front_face = { mode } });
 }
 
 int list_record_shade_model(GLenum mode)
 {
     GLState *ctx = gl_get_current_context();
-    if (!ctx || ctx->list_index == 0) return 0;
+    if (!recording(ctx)) return 0;
     return record_cmd(&(list_command_t){ CMD_SHADE_MODEL, .data.shade_model = { mode } });
 }
 
+/* Framebuffer commands */
+int list_record_clear(GLbitfield mask)
+{
+    GLState *ctx = gl_get_current_context();
+    if (!recording(ctx)) return 0;
+    return record_cmd(&(list_command_t){ CMD_CLEAR, .data.clear = { mask } });
+}
+
+int list_record_clear_color(GLclampf r, GLclampf g, GLclampf b, GLclampf a)
+{
+    GLState *ctx = gl_get_current_context();
+    if (!recording(ctx)) return 0;
+    return record_cmd(&(list_command_t){ CMD_CLEAR_COLOR, .data.clear_color = { r, g, b, a } });
+}
+
+int list_record_clear_depth(GLclampd depth)
+{
+    GLState *ctx = gl_get_current_context();
+    if (!recording(ctx)) return 0;
+    return record_cmd(&(list_command_t){ CMD_CLEAR_DEPTH, .data.clear_depth = { depth } });
+}
+
+int list_record_viewport(GLint x, GLint y, GLsizei width, GLsizei height)
+{
+    GLState *ctx = gl_get_current_context();
+    if (!recording(ctx)) return 0;
+    return record_cmd(&(list_command_t){ CMD_VIEWPORT, .data.viewport = { x, y, width, height } });
+}
+
 /* Lighting commands */
 int list_record_lightf(GLenum light, GLenum pname, GLfloat param)
 {
     GLState *ctx = gl_get_current_context();
-    if (!ctx || ctx->list_index == 0) return 0;
+    if (!recording(ctx)) return 0;
     return record_cmd(&(list_command_t){ CMD_LIGHTF, .data.lightf = { light, pname, param } });
 }
 
+/* Number of values read from a glLightfv/glMaterialfv params array */
+static int param_count(GLenum pname)
+{
+    switch (pname) {
+        case GL_SPOT_DIRECTION:
+        case GL_COLOR_INDEXES:
+            return 3;
+        case GL_SPOT_EXPONENT:
+        case GL_SPOT_CUTOFF:
+        case GL_CONSTANT_ATTENUATION:
+        case GL_LINEAR_ATTENUATION:
+        case GL_QUADRATIC_ATTENUATION:
+        case GL_SHININESS:
+            return 1;
+        default:
+            return 4;
+    }
+}
+
 int list_record_lightfv(GLenum light, GLenum pname, const GLfloat *params)
 {
     GLState *ctx = gl_get_current_context();
-    if (!ctx || ctx->list_index == 0) return 0;
+    if (!recording(ctx)) return 0;
     list_command_t cmd = { CMD_LIGHTFV, .data.lightfv = { light, pname } };
-    for (int i = 0; i < 4; i++) cmd.data.lightfv.params[i] = params[i];
+    for (int i = 0; i < param_count(pname); i++) cmd.data.lightfv.params[i] = params[i];
     return record_cmd(&cmd);
 }
 
 int list_record_materialf(GLenum face, GLenum pname, GLfloat param)
 {
     GLState *ctx = gl_get_current_context();
-    if (!ctx || ctx->list_index == 0) return 0;
+    if (!recording(ctx)) return 0;
     return record_cmd(&(list_command_t){ CMD_MATERIALF, .data.materialf = { face, pname, param } });
 }
 
 int list_record_materialfv(GLenum face, GLenum pname, const GLfloat *params)
 {
     GLState *ctx = gl_get_current_context();
-    if (!ctx || ctx->list_index == 0) return 0;
+    if (!recording(ctx)) return 0;
     list_command_t cmd = { CMD_MATERIALFV, .data.materialfv = { face, pname } };
-    for (int i = 0; i < 4; i++) cmd.data.materialfv.params[i] = params[i];
+    for (int i = 0; i < param_count(pname); i++) cmd.data.materialfv.params[i] = params[i];
     return record_cmd(&cmd);
 }
@@ -50,6 +50,12 @@ typedef enum {
     CMD_MATERIALF,
     CMD_MATERIALFV,
     CMD_CALL_LIST,
+    CMD_CLEAR,
+    CMD_CLEAR_COLOR,
+    CMD_CLEAR_DEPTH,
+    CMD_VIEWPORT,
+    CMD_WAIT_SYNC,          /* Async queue only, never compiled into a list */
+    CMD_COLOR_BUFFER,       /* Async queue only, never compiled into a list */
 } list_opcode_t;
 
 /* Display list command - variable size depending on opcode */
@@ -81,6 +87,12 @@ typedef struct {
         struct { GLenum face; GLenum pname; GLfloat param; } materialf;
         struct { GLenum face; GLenum pname; GLfloat params[4]; } materialfv;
         struct { GLuint list; } call_list;
+        struct { GLbitfield mask; } clear;
+        struct { GLclampf r, g, b, a; } clear_color;
+        struct { GLclampd depth; } clear_depth;
+        struct { GLint x, y; GLsizei width, height; } viewport;
+        struct { GLsync sync; } wait_sync;      /* Holds a fence reference */
+        struct { uint32_t *pixels; } color_buffer;  /* pixel_t buffer to render into */
     } data;
 } list_command_t;
 
@@ -154,6 +166,12 @@ int list_record_cull_face(GLenum mode);
 int list_record_front_face(GLenum mode);
 int list_record_shade_model(GLenum mode);
 
+/* Framebuffer recording functions */
+int list_record_clear(GLbitfield mask);
+int list_record_clear_color(GLclampf r, GLclampf g, GLclampf b, GLclampf a);
+int list_record_clear_depth(GLclampd depth);
+int list_record_viewport(GLint x, GLint y, GLsizei width, GLsizei height);
+
 /* Lighting recording functions */
 int list_record_lightf(GLenum light, GLenum pname, GLfloat param);
 int list_record_lightfv(GLenum light, GLenum pname, const GLfloat *params);
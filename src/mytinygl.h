@@ -22,6 +22,20 @@
 #define MAX_LIGHTS 8
 #define MAX_LIST_CALL_DEPTH 64
 
+/* Thread-local storage (current context, per-thread lock state) */
+#if defined(_MSC_VER)
+    #define THREAD_LOCAL __declspec(thread)
+#elif defined(__GNUC__) || defined(__clang__)
+    #define THREAD_LOCAL __thread
+#else
+    #define THREAD_LOCAL  /* Fallback: not thread-safe */
+#endif
+
+/* Sub-pixel precision of snapped triangle vertices (28.4 fixed point) */
+#define SUBPIXEL_BITS 4
+#define SUBPIXEL_ONE  (1 << SUBPIXEL_BITS)
+#define SUBPIXEL_HALF (SUBPIXEL_ONE >> 1)
+
 /* State flags */
 #define FLAG_INSIDE_BEGIN_END  (1 << 0)
 #define FLAG_DEPTH_TEST        (1 << 1)
@@ -36,6 +50,16 @@
 #define FLAG_SCISSOR_TEST      (1 << 10)
 #define FLAG_STENCIL_TEST      (1 << 11)
 
+/* Matrices changed since the derived transform state was computed */
+#define TRANSFORM_DIRTY_MODELVIEW  (1 << 0)
+#define TRANSFORM_DIRTY_PROJECTION (1 << 1)
+#define TRANSFORM_DIRTY_TEXTURE    (1 << 2)
+#define TRANSFORM_DIRTY_ALL        (TRANSFORM_DIRTY_MODELVIEW | TRANSFORM_DIRTY_PROJECTION | TRANSFORM_DIRTY_TEXTURE)
+
+/* Classification of the current matrices */
+#define TRANSFORM_MODELVIEW_AFFINE (1 << 0)     /* Bottom row is 0 0 0 1 */
+#define TRANSFORM_TEXTURE_IDENTITY (1 << 1)
+
 /* Client state flags */
 #define CLIENT_VERTEX_ARRAY        (1 << 0)
 #define CLIENT_COLOR_ARRAY         (1 << 1)
@@ -83,6 +107,35 @@ typedef struct {
     size_t capacity;
 } vertex_buffer_t;
 
+/* Post-transform cache entry of a sparse indexed draw: array index -> vertex buffer slot */
+typedef struct {
+    uint32_t index;
+    uint32_t slot;          /* UINT32_MAX = empty */
+} element_cache_entry_t;
+
+/* Element buffer: vertex buffer slots of an indexed primitive, in primitive order */
+typedef struct {
+    uint32_t *data;
+    size_t count;           /* 0 = the primitive is the vertex buffer in order */
+    size_t capacity;
+    element_cache_entry_t *cache;   /* Sparse draws: open-addressing hash, [cache_capacity] */
+    uint32_t *unique;               /* Sparse draws: distinct indices, [cache_capacity / 2] */
+    size_t cache_capacity;
+} element_buffer_t;
+
+/* Post-transform vertex: projected once per vertex during primitive assembly (raster.c) */
+typedef struct {
+    vec4_t ndc;             /* x/w, y/w, z/w and 1/w (valid when ready) */
+    int32_t sx, sy;         /* 28.4 fixed-point window position (valid when ready) */
+    int outcode;            /* Frustum outcode, 0 = inside all planes */
+    int ready;              /* Inside and projected: triangles of ready vertices skip the clipper */
+} post_vertex_t;
+
+typedef struct {
+    post_vertex_t *data;
+    size_t capacity;
+} post_vertex_buffer_t;
+
 typedef struct {
     /* Clear values */
     color_t clear_color;
@@ -106,6 +159,12 @@ typedef struct {
     GLint projection_stack_depth;
     GLint texture_stack_depth;
 
+    /* Derived transform state, recomputed by gl_update_transform after a matrix changed */
+    uint32_t transform_dirty;   /* TRANSFORM_DIRTY_* */
+    uint32_t transform_class;   /* TRANSFORM_MODELVIEW_AFFINE, TRANSFORM_TEXTURE_IDENTITY */
+    GLfloat mvp_matrix[16];     /* Projection * modelview */
+    GLfloat normal_matrix[16];  /* Inverse-transpose of the modelview 3x3 */
+
     /* Primitive assembly */
     GLenum primitive_mode;
 
@@ -161,7 +220,6 @@ typedef struct {
     GLenum polygon_mode_back;
 
     /* Textures */
-    texture_store_t textures;
     GLuint bound_texture_2d;  /* Currently bound GL_TEXTURE_2D */
 
     /* Texture environment */
@@ -195,7 +253,6 @@ typedef struct {
     GLenum shade_model;
 
     /* VBO (OpenGL 1.5) */
-    buffer_store_t buffers;
     GLuint bound_array_buffer;
     GLuint bound_element_buffer;
 
@@ -209,8 +266,11 @@ typedef struct {
     /* Framebuffer */
     framebuffer_t framebuffer;
 
+    /* Textures, buffer objects and display lists (see share.h) */
+    struct share_group *shared;
+
     /* Display lists */
-    list_store_t lists;
+    display_list_t list_pending;    /* List being compiled, published by glEndList */
     GLuint list_base;           /* Base offset for glCallLists */
     GLuint list_index;          /* Currently compiling list (0 = none) */
     GLenum list_mode;           /* GL_COMPILE or GL_COMPILE_AND_EXECUTE */
@@ -218,6 +278,15 @@ typedef struct {
 
     /* Vertex buffer (per-context for thread safety) */
     vertex_buffer_t vertices;
+    post_vertex_buffer_t post_vertices;
+    struct vertex_batch *staged;    /* glVertex calls not transformed yet (see vertex.h) */
+    size_t staged_count;
+    element_buffer_t elements;      /* glDrawElements triangles: each vertex transformed once */
+
+    /* Render threads (NULL = everything runs on the calling thread) */
+    struct worker_pool *workers;    /* Vertex processing and tile rasterization */
+    struct tile_renderer *tiles;    /* Tile-binned rendering */
+    struct command_queue *queue;    /* Async mode: commands run on a render thread */
 
     /* Error state */
     GLenum error;
@@ -227,13 +296,81 @@ typedef struct {
 /* Context management */
 GLState *gl_create_context(int32_t width, int32_t height);
 void gl_destroy_context(GLState *ctx);
+
+/* Create a context sharing the textures, buffer objects and display lists of `share`
+ * (NULL = a new, unshared namespace). The contexts may be used on different threads. */
+GLState *gl_create_context_shared(int32_t width, int32_t height, GLState *share);
 void gl_make_current(GLState *ctx);
 
+/* Restore the default value of every GL state variable. The framebuffer (contents
+ * included), the share group and the render threads are kept. */
+void gl_reset_context(GLState *ctx);
+
+/* Copy the GL state of src into dst, keeping dst's framebuffer, share group and render
+ * threads. Object names refer to dst's share group, so both should share it. */
+void gl_copy_context(GLState *dst, GLState *src);
+
+/* Context pool (see pool.c): a bounded set of same-sized contexts sharing one share
+ * group, handed out to request handlers without allocating. */
+struct context_pool;
+
+/* Up to max_contexts contexts, created on demand, in share's share group (which the pool
+ * keeps alive, so share may be destroyed first); share = NULL starts a new share group.
+ * Returns NULL on failure. */
+struct context_pool *gl_context_pool_create(int32_t width, int32_t height, int max_contexts, GLState *share);
+
+/* All contexts must have been released */
+void gl_context_pool_destroy(struct context_pool *pool);
+
+/* A context in the default state, or a copy of tmpl's state (tmpl != NULL); blocks while
+ * max_contexts are in use. Framebuffer contents are undefined until cleared. tmpl must
+ * belong to the pool's share group, since its texture, buffer and list names are copied.
+ * Returns NULL if tmpl is from another share group or a new context could not be created. */
+GLState *gl_context_pool_acquire(struct context_pool *pool, GLState *tmpl);
+
+/* Return a context to the pool. Returns 0 on success, -1 if ctx was not acquired from
+ * this pool or has already been released. */
+int gl_context_pool_release(struct context_pool *pool, GLState *ctx);
+
+/* Render with `threads` threads (tile-binned rasterization, see tiles.h, and parallel
+ * vertex processing of large array draws); 0 or 1 = immediate mode.
+ * Returns 0 on success, -1 if the worker pool could not be started. */
+int gl_set_render_threads(GLState *ctx, int threads);
+
+/* Pin each render thread to its own CPU (enabled) or let them float again. Call after
+ * gl_set_render_threads. Returns 0 on success, -1 if unsupported (non-Linux) or refused. */
+int gl_set_render_affinity(GLState *ctx, int enabled);
+
+/* NUMA placement for multi-socket hosts (see tiles.h): pin the render threads over the
+ * nodes listed in sysfs, give each screen tile a fixed owner thread and move the
+ * framebuffer pages of the tile to its owner's node. Moves the current color buffer
+ * only: call again after gl_set_color_buffer. Call after gl_set_render_threads.
+ * Returns 0 on success, -1 if unsupported or refused. */
+int gl_set_render_numa(GLState *ctx, int enabled);
+
+/* Render the commands issued from now on into color, a buffer of the framebuffer's size
+ * owned by the caller, e.g. to cycle through a swap chain. Commands issued before still
+ * complete into the previous buffer: binned triangles and pending clears are written
+ * first, and in async mode the switch is queued behind them. The context's own buffer
+ * must be set back before gl_destroy_context, which frees it. */
+void gl_set_color_buffer(GLState *ctx, pixel_t *color);
+
+/* Async mode (see queue.h): GL calls on the application thread are queued and executed
+ * by a render thread; use glFenceSync/glClientWaitSync to wait for a frame.
+ * Call from the thread the context is current on. Returns 0 on success. */
+int gl_set_async(GLState *ctx, int enabled);
+
+/* Background texture uploads (see upload.h) for the share group of ctx: glTexImage2D
+ * returns once the image is copied and `threads` threads convert it and build its mip
+ * level; 0 = convert in glTexImage2D. Returns 0 on success. */
+int gl_set_texture_upload_threads(GLState *ctx, int threads);
+
 /* Get current context */
 GLState *gl_get_current_context(void);
 
 /* Vertex buffer helpers */
 void vertex_buffer_push(GLState *ctx, vertex_t v);
+vertex_t *vertex_buffer_reserve(GLState *ctx, size_t n);
 vertex_t *vertex_buffer_data(GLState *ctx);
 size_t vertex_buffer_count(GLState *ctx);
 void vertex_buffer_clear(GLState *ctx);
@@ -241,9 +378,36 @@ void vertex_buffer_clear(GLState *ctx);
 /* Error handling */
 void gl_set_error(GLState *ctx, GLenum error);
 
+/* Execute a recorded display list / queue command on the current context */
+void gl_execute_command(const list_command_t *cmd);
+
 /* Rasterization functions (raster.c) */
 vec4_t transform_vertex(GLState *ctx, float x, float y, float z, float w);
+
+/* Recompute the derived transform state of the matrices flagged in transform_dirty */
+void gl_update_transform(GLState *ctx);
+
+static inline void gl_validate_transform(GLState *ctx)
+{
+    if (ctx->transform_dirty) gl_update_transform(ctx);
+}
+
+/* Vertex attributes the stages after the vertex transform read under the current
+ * state (VERTEX_LIVE_*). Eye-space position and normal are only interpolated for
+ * per-fragment lighting and for two-sided lighting of back faces. */
+static inline uint32_t gl_vertex_live(const GLState *ctx)
+{
+    uint32_t live = 0;
+    if (ctx->flags & FLAG_TEXTURE_2D) live |= VERTEX_LIVE_TEXCOORD;
+    if (ctx->flags & FLAG_FOG) live |= VERTEX_LIVE_FOG;
+    if ((ctx->flags & FLAG_LIGHTING) &&
+        (ctx->shade_model == GL_PHONG || ctx->light_model_two_side)) {
+        live |= VERTEX_LIVE_EYE;
+    }
+    return live;
+}
 void ndc_to_screen(GLState *ctx, float x, float y, int32_t *sx, int32_t *sy);
+void ndc_to_screen_fixed(GLState *ctx, float x, float y, int32_t *fx, int32_t *fy);
 void flush_points(GLState *ctx);
 void flush_lines(GLState *ctx);
 void flush_line_strip(GLState *ctx);
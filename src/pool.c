@@ -0,0 +1,139 @@
+/*
+ * MyTinyGL - OpenGL 1.x Fixed Function Pipeline
+ * pool.c - Context pool for per-request rendering
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include "mytinygl.h"
+#include "share.h"
+#include "allocation.h"
+#include <pthread.h>
+
+struct context_pool {
+    pthread_mutex_t lock;
+    pthread_cond_t released_cond;   /* A context was returned */
+
+    int32_t width, height;
+    int max_contexts;
+    struct share_group *group;  /* Share group of new contexts, retained (NULL until the first exists) */
+
+    GLState **contexts;         /* Every context created, [created] */
+    int created;
+    GLState **idle;             /* Contexts not in use, [idle_count] */
+    int idle_count;
+};
+
+struct context_pool *gl_context_pool_create(int32_t width, int32_t height, int max_contexts, GLState *share)
+{
+    if (max_contexts < 1) return NULL;
+
+    struct context_pool *pool = mtgl_calloc(1, sizeof(struct context_pool));
+    if (!pool) return NULL;
+
+    pool->contexts = mtgl_calloc((size_t)max_contexts, sizeof(GLState *));
+    pool->idle = mtgl_calloc((size_t)max_contexts, sizeof(GLState *));
+    if (!pool->contexts || !pool->idle) {
+        mtgl_free(pool->contexts);
+        mtgl_free(pool->idle);
+        mtgl_free(pool);
+        return NULL;
+    }
+
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->released_cond, NULL);
+    pool->width = width;
+    pool->height = height;
+    pool->max_contexts = max_contexts;
+
+    /* The group is retained, so share may be destroyed while the pool lives */
+    if (share) {
+        pool->group = share->shared;
+        share_group_retain(pool->group);
+    }
+    return pool;
+}
+
+void gl_context_pool_destroy(struct context_pool *pool)
+{
+    if (!pool) return;
+
+    for (int i = 0; i < pool->created; i++) {
+        gl_destroy_context(pool->contexts[i]);
+    }
+    if (pool->group) share_group_release(pool->group);
+    pthread_mutex_destroy(&pool->lock);
+    pthread_cond_destroy(&pool->released_cond);
+    mtgl_free(pool->contexts);
+    mtgl_free(pool->idle);
+    mtgl_free(pool);
+}
+
+GLState *gl_context_pool_acquire(struct context_pool *pool, GLState *tmpl)
+{
+    if (!pool) return NULL;
+
+    pthread_mutex_lock(&pool->lock);
+
+    /* Object names of the template must mean the same in the pool's share group */
+    if (tmpl && tmpl->shared != pool->group) {
+        pthread_mutex_unlock(&pool->lock);
+        return NULL;
+    }
+
+    while (pool->idle_count == 0 && pool->created == pool->max_contexts) {
+        pthread_cond_wait(&pool->released_cond, &pool->lock);
+    }
+
+    GLState *c;
+    if (pool->idle_count > 0) {
+        c = pool->idle[--pool->idle_count];
+    } else {
+        /* Grow: only happens max_contexts times, so creating under the lock is fine */
+        c = gl_create_context_in_group(pool->width, pool->height, pool->group);
+        if (!c) {
+            pthread_mutex_unlock(&pool->lock);
+            return NULL;
+        }
+        pool->contexts[pool->created++] = c;
+        if (!pool->group) {
+            pool->group = c->shared;
+            share_group_retain(pool->group);
+        }
+    }
+    pthread_mutex_unlock(&pool->lock);
+
+    /* Contexts are reset on the way out so a template can be applied in one step */
+    if (tmpl) {
+        gl_copy_context(c, tmpl);
+    } else {
+        gl_reset_context(c);
+    }
+    return c;
+}
+
+/* Index of c in list[0..count), -1 if absent */
+static int find_context(GLState *const *list, int count, const GLState *c)
+{
+    for (int i = 0; i < count; i++) {
+        if (list[i] == c) return i;
+    }
+    return -1;
+}
+
+int gl_context_pool_release(struct context_pool *pool, GLState *c)
+{
+    if (!pool || !c) return -1;
+
+    pthread_mutex_lock(&pool->lock);
+    /* Only contexts of this pool that are in use: anything else would overrun idle */
+    if (find_context(pool->contexts, pool->created, c) < 0 ||
+        find_context(pool->idle, pool->idle_count, c) >= 0) {
+        pthread_mutex_unlock(&pool->lock);
+        return -1;
+    }
+    pool->idle[pool->idle_count++] = c;
+    pthread_cond_signal(&pool->released_cond);
+    pthread_mutex_unlock(&pool->lock);
+    return 0;
+}
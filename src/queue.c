@@ -0,0 +1,328 @@
+/*
+ * MyTinyGL - OpenGL 1.x Fixed Function Pipeline
+ * queue.c - Asynchronous command queue
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include "queue.h"
+#include "tiles.h"
+#include "share.h"
+#include "upload.h"
+#include "allocation.h"
+#include <pthread.h>
+#include <time.h>
+
+typedef struct {
+    list_command_t *commands;
+    uint32_t count;
+    uint64_t seq;               /* Submission number */
+    GLsync fence;               /* Rasterize binned work and signal it before completing */
+} command_batch_t;
+
+struct command_queue {
+    GLState *ctx;
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t submitted_cond;  /* Render thread: a batch is pending */
+    pthread_cond_t completed_cond;  /* Application: a batch completed */
+
+    command_batch_t batches[QUEUE_BATCHES];
+    uint32_t head;              /* Oldest pending batch (render thread) */
+    uint32_t pending;           /* Batches submitted but not executed */
+    uint32_t record;            /* Batch being recorded (application thread) */
+    uint64_t submitted;         /* Sequence number of the last submitted batch */
+    uint64_t completed;         /* Sequence number of the last executed batch */
+    int shutdown;
+};
+
+struct __GLsync {
+    struct share_group *shared; /* Retained while uploads are waited for, else NULL */
+    uint64_t upload_seq;        /* Texture uploads to wait for (upload.h) */
+    int signaled;               /* Commands before the fence executed */
+    int refs;                   /* Application handle, pending fence batch and waits */
+    struct __GLsync *next;      /* Fences not deleted yet */
+};
+
+/* All fences, under fence_lock; fence_cond is broadcast when one is signaled */
+static pthread_mutex_t fence_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t fence_cond = PTHREAD_COND_INITIALIZER;
+static struct __GLsync *fences = NULL;
+
+static void fence_signal(GLsync sync)
+{
+    pthread_mutex_lock(&fence_lock);
+    sync->signaled = 1;
+    pthread_cond_broadcast(&fence_cond);
+    pthread_mutex_unlock(&fence_lock);
+}
+
+static void *render_thread(void *arg)
+{
+    struct command_queue *q = arg;
+    gl_make_current(q->ctx);
+
+    pthread_mutex_lock(&q->lock);
+    for (;;) {
+        while (q->pending == 0 && !q->shutdown) {
+            pthread_cond_wait(&q->submitted_cond, &q->lock);
+        }
+        if (q->pending == 0) break;
+        command_batch_t *batch = &q->batches[q->head];
+        pthread_mutex_unlock(&q->lock);
+
+        for (uint32_t i = 0; i < batch->count; i++) {
+            gl_execute_command(&batch->commands[i]);
+        }
+        if (batch->fence) {
+            tiles_sync(q->ctx);
+            fence_signal(batch->fence);
+            fence_release(batch->fence);
+        }
+
+        pthread_mutex_lock(&q->lock);
+        q->completed = batch->seq;
+        q->head = (q->head + 1) % QUEUE_BATCHES;
+        q->pending--;
+        pthread_cond_broadcast(&q->completed_cond);
+    }
+    pthread_mutex_unlock(&q->lock);
+    return NULL;
+}
+
+int queue_create(GLState *ctx)
+{
+    struct command_queue *q = mtgl_calloc(1, sizeof(struct command_queue));
+    if (!q) return -1;
+
+    for (int i = 0; i < QUEUE_BATCHES; i++) {
+        q->batches[i].commands = mtgl_alloc(QUEUE_BATCH_COMMANDS * sizeof(list_command_t));
+        if (!q->batches[i].commands) {
+            for (int j = 0; j < i; j++) mtgl_free(q->batches[j].commands);
+            mtgl_free(q);
+            return -1;
+        }
+    }
+
+    q->ctx = ctx;
+    pthread_mutex_init(&q->lock, NULL);
+    pthread_cond_init(&q->submitted_cond, NULL);
+    pthread_cond_init(&q->completed_cond, NULL);
+    if (pthread_create(&q->thread, NULL, render_thread, q) != 0) {
+        pthread_mutex_destroy(&q->lock);
+        pthread_cond_destroy(&q->submitted_cond);
+        pthread_cond_destroy(&q->completed_cond);
+        for (int i = 0; i < QUEUE_BATCHES; i++) mtgl_free(q->batches[i].commands);
+        mtgl_free(q);
+        return -1;
+    }
+
+    ctx->queue = q;
+    return 0;
+}
+
+void queue_destroy(GLState *ctx)
+{
+    struct command_queue *q = ctx->queue;
+    if (!q) return;
+
+    queue_submit(ctx);
+
+    pthread_mutex_lock(&q->lock);
+    q->shutdown = 1;
+    pthread_cond_signal(&q->submitted_cond);
+    pthread_mutex_unlock(&q->lock);
+    pthread_join(q->thread, NULL);
+
+    pthread_mutex_destroy(&q->lock);
+    pthread_cond_destroy(&q->submitted_cond);
+    pthread_cond_destroy(&q->completed_cond);
+    for (int i = 0; i < QUEUE_BATCHES; i++) mtgl_free(q->batches[i].commands);
+    mtgl_free(q);
+    ctx->queue = NULL;
+}
+
+int queue_recording(GLState *ctx)
+{
+    return ctx->queue && !pthread_equal(pthread_self(), ctx->queue->thread);
+}
+
+/* Submit the batch being recorded (even if empty) and wait for a free one */
+static uint64_t submit_batch(struct command_queue *q, GLsync fence)
+{
+    pthread_mutex_lock(&q->lock);
+    command_batch_t *batch = &q->batches[q->record];
+    uint64_t seq = ++q->submitted;
+    batch->seq = seq;
+    batch->fence = fence;
+    q->record = (q->record + 1) % QUEUE_BATCHES;
+    q->pending++;
+    pthread_cond_signal(&q->submitted_cond);
+
+    /* Bounded latency: wait while every batch is pending */
+    while (q->pending == QUEUE_BATCHES) {
+        pthread_cond_wait(&q->completed_cond, &q->lock);
+    }
+    q->batches[q->record].count = 0;
+    pthread_mutex_unlock(&q->lock);
+    return seq;
+}
+
+int queue_record(GLState *ctx, const list_command_t *cmd)
+{
+    if (!queue_recording(ctx)) return 0;
+
+    struct command_queue *q = ctx->queue;
+    if (q->batches[q->record].count == QUEUE_BATCH_COMMANDS) {
+        submit_batch(q, NULL);
+    }
+    command_batch_t *batch = &q->batches[q->record];
+    batch->commands[batch->count++] = *cmd;
+    return 1;
+}
+
+void queue_submit(GLState *ctx)
+{
+    struct command_queue *q = ctx->queue;
+    if (!queue_recording(ctx) || q->batches[q->record].count == 0) return;
+    submit_batch(q, NULL);
+}
+
+void queue_finish(GLState *ctx)
+{
+    if (!queue_recording(ctx)) return;
+
+    struct command_queue *q = ctx->queue;
+    queue_submit(ctx);
+
+    pthread_mutex_lock(&q->lock);
+    while (q->completed != q->submitted) {
+        pthread_cond_wait(&q->completed_cond, &q->lock);
+    }
+    pthread_mutex_unlock(&q->lock);
+}
+
+/* Absolute CLOCK_REALTIME time timeout_ns from now */
+static struct timespec deadline_after(uint64_t timeout_ns)
+{
+    struct timespec deadline;
+    clock_gettime(CLOCK_REALTIME, &deadline);
+    /* Clamp so very long timeouts (GL_TIMEOUT_IGNORED) cannot overflow */
+    uint64_t max_wait = (uint64_t)365 * 24 * 3600 * 1000000000ull;
+    if (timeout_ns > max_wait) timeout_ns = max_wait;
+    uint64_t nsec = (uint64_t)deadline.tv_nsec + timeout_ns % 1000000000ull;
+    deadline.tv_sec += (time_t)(timeout_ns / 1000000000ull + nsec / 1000000000ull);
+    deadline.tv_nsec = (long)(nsec % 1000000000ull);
+    return deadline;
+}
+
+/* Nanoseconds left until deadline, 0 if it has passed */
+static uint64_t time_left(const struct timespec *deadline)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_REALTIME, &now);
+    int64_t left = (int64_t)(deadline->tv_sec - now.tv_sec) * 1000000000ll +
+                   (deadline->tv_nsec - now.tv_nsec);
+    return left > 0 ? (uint64_t)left : 0;
+}
+
+GLsync fence_create(GLState *ctx)
+{
+    GLsync sync = mtgl_calloc(1, sizeof(struct __GLsync));
+    if (!sync) return NULL;
+
+    sync->refs = 1;
+    if (ctx->shared->uploader) {
+        sync->upload_seq = upload_last();
+        sync->shared = ctx->shared;
+        share_group_retain(sync->shared);
+    }
+
+    pthread_mutex_lock(&fence_lock);
+    sync->next = fences;
+    fences = sync;
+    pthread_mutex_unlock(&fence_lock);
+
+    if (queue_recording(ctx)) {
+        /* Signaled by the render thread when it gets past this point */
+        fence_acquire(sync);
+        submit_batch(ctx->queue, sync);
+    } else {
+        /* Commands execute immediately; only binned triangles are outstanding */
+        tiles_sync(ctx);
+        fence_signal(sync);
+    }
+    return sync;
+}
+
+/* Find a fence that has not been deleted; fence_lock held */
+static struct __GLsync **fence_find(GLsync sync)
+{
+    for (struct __GLsync **p = &fences; *p; p = &(*p)->next) {
+        if (*p == sync) return p;
+    }
+    return NULL;
+}
+
+int fence_acquire(GLsync sync)
+{
+    pthread_mutex_lock(&fence_lock);
+    int found = sync && fence_find(sync);
+    if (found) sync->refs++;
+    pthread_mutex_unlock(&fence_lock);
+    return found;
+}
+
+void fence_release(GLsync sync)
+{
+    pthread_mutex_lock(&fence_lock);
+    int last = --sync->refs == 0;
+    pthread_mutex_unlock(&fence_lock);
+    if (!last) return;
+
+    share_group_release(sync->shared);
+    mtgl_free(sync);
+}
+
+int fence_valid(GLsync sync)
+{
+    pthread_mutex_lock(&fence_lock);
+    int found = sync && fence_find(sync);
+    pthread_mutex_unlock(&fence_lock);
+    return found;
+}
+
+int fence_delete(GLsync sync)
+{
+    pthread_mutex_lock(&fence_lock);
+    struct __GLsync **p = sync ? fence_find(sync) : NULL;
+    if (p) *p = sync->next;
+    pthread_mutex_unlock(&fence_lock);
+    if (!p) return 0;
+
+    fence_release(sync);
+    return 1;
+}
+
+int fence_wait(GLsync sync, uint64_t timeout_ns)
+{
+    /* One deadline for the commands and the uploads */
+    struct timespec deadline = deadline_after(timeout_ns);
+
+    pthread_mutex_lock(&fence_lock);
+    if (timeout_ns > 0) {
+        while (!sync->signaled) {
+            if (pthread_cond_timedwait(&fence_cond, &fence_lock, &deadline) != 0) break;
+        }
+    }
+    int done = sync->signaled;
+    pthread_mutex_unlock(&fence_lock);
+    if (!done || !sync->shared) return done;
+
+    /* The read lock keeps the uploader alive */
+    share_group_read_lock(sync->shared);
+    done = upload_wait(sync->shared->uploader, sync->upload_seq,
+                       timeout_ns > 0 ? time_left(&deadline) : 0);
+    share_group_read_unlock(sync->shared);
+    return done;
+}
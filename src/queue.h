@@ -0,0 +1,71 @@
+/*
+ * MyTinyGL - OpenGL 1.x Software Renderer
+ * Copyright (c) 2025 zbufferoverflow (Eliezer Solinger)
+ * https://github.com/zbufferoverflow/MyTinyGL
+ * SPDX-License-Identifier: MIT
+ *
+ * queue.h - Asynchronous command queue
+ *
+ * In async mode (gl_set_async) the application thread does not execute GL
+ * commands that can be compiled into display lists (vertices, matrices,
+ * enables, glClear, ...): they are recorded as list commands into a ring of
+ * batches that a render thread executes in order. Any other GL call first
+ * waits for the render thread to drain the queue (queue_sync), so it sees
+ * the state of all previous commands. Fences (glFenceSync) mark a position
+ * in the queue that the application, or the render thread of another
+ * context (glWaitSync), can wait for without draining it.
+ */
+
+#ifndef MYTINYGL_QUEUE_H
+#define MYTINYGL_QUEUE_H
+
+#include "mytinygl.h"
+
+/* Ring size: the application blocks when this many batches are pending */
+#define QUEUE_BATCHES        4
+#define QUEUE_BATCH_COMMANDS 4096
+
+/* Start/stop the render thread. queue_destroy executes everything still queued. */
+int queue_create(GLState *ctx);
+void queue_destroy(GLState *ctx);
+
+/* True on the application thread of a context in async mode */
+int queue_recording(GLState *ctx);
+
+/* Record a command; returns 1 if recorded, 0 if the caller should execute it */
+int queue_record(GLState *ctx, const list_command_t *cmd);
+
+/* Hand the batch being recorded to the render thread */
+void queue_submit(GLState *ctx);
+
+/* Submit and wait until the render thread has executed everything */
+void queue_finish(GLState *ctx);
+
+/* Fence objects (GLsync). A fence does not refer to its context: the render thread
+ * marks it signaled when it gets past it, so it can be waited on from any thread,
+ * also after its context was destroyed. It is freed once deleted and no longer used
+ * by a wait or by its pending batch. Returns NULL when out of memory. */
+GLsync fence_create(GLState *ctx);
+
+/* Take a reference on a fence that has not been deleted; returns 0 if sync is not one */
+int fence_acquire(GLsync sync);
+void fence_release(GLsync sync);
+
+/* True if sync is a fence that has not been deleted */
+int fence_valid(GLsync sync);
+
+/* Delete a fence (freed after its last use); returns 0 if sync is not one */
+int fence_delete(GLsync sync);
+
+/* Wait for up to timeout_ns nanoseconds until every command before the fence has been
+ * executed and rasterized, and the texture uploads issued before it have completed;
+ * returns 1 if they have. The caller holds a reference. */
+int fence_wait(GLsync sync, uint64_t timeout_ns);
+
+/* Sync point: make the state consistent with all previous commands */
+static inline void queue_sync(GLState *ctx)
+{
+    if (ctx->queue) queue_finish(ctx);
+}
+
+#endif /* MYTINYGL_QUEUE_H */
@@ -8,9 +8,15 @@
 #include "mytinygl.h"
 #include "clipping.h"
 #include "lighting.h"
+#include "tiles.h"
+#include "upload.h"
 #include <string.h>
 #include <math.h>
 
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
 /* Forward declarations for helper functions */
 static inline int depth_test(GLenum func, float incoming, float stored);
 static inline int alpha_test(GLenum func, float incoming, float ref);
@@ -44,15 +50,11 @@ static inline void write_pixel_masked(GLState *ctx, int32_t x, int32_t y, color_
     framebuffer_putpixel(fb, x, y, color_to_rgba32(dst));
 }
 
-/* Transform vertex by modelview and projection matrices */
+/* Transform vertex by the cached projection * modelview matrix */
 vec4_t transform_vertex(GLState *ctx, float x, float y, float z, float w)
 {
-    vec4_t v = vec4(x, y, z, w);
-    mat4_t mv   = mat4_from_array(ctx->modelview_matrix[ctx->modelview_stack_depth]);
-    mat4_t proj = mat4_from_array(ctx->projection_matrix[ctx->projection_stack_depth]);
-    v = mat4_mul_vec4(mv, v);
-    v = mat4_mul_vec4(proj, v);
-    return v;
+    gl_validate_transform(ctx);
+    return mat4_array_mul_vec4(ctx->mvp_matrix, vec4(x, y, z, w));
 }
 
 /* Transform vertex from NDC (-1 to 1) to screen coordinates */
@@ -62,6 +64,13 @@ void ndc_to_screen(GLState *ctx, float x, float y, int32_t *sx, int32_t *sy)
     *sy = (int32_t)((1.0f - y) * 0.5f * ctx->viewport_h + ctx->viewport_y);
 }
 
+/* Transform vertex from NDC to screen coordinates snapped to the sub-pixel grid */
+void ndc_to_screen_fixed(GLState *ctx, float x, float y, int32_t *fx, int32_t *fy)
+{
+    *fx = (int32_t)lrintf(((x + 1.0f) * 0.5f * ctx->viewport_w + ctx->viewport_x) * SUBPIXEL_ONE);
+    *fy = (int32_t)lrintf(((1.0f - y) * 0.5f * ctx->viewport_h + ctx->viewport_y) * SUBPIXEL_ONE);
+}
+
 /* Helper: write a single pixel for line rendering with all tests/blending */
 static void write_line_pixel(GLState *ctx, int32_t px, int32_t py, float depth, color_t c,
                              int depth_enabled, int blend_enabled, int scissor_enabled)
@@ -148,7 +157,7 @@ static void draw_line_full(GLState *ctx, int32_t x0, int32_t y0, float z0, int32
     /* Get bound texture if texturing enabled */
     texture_t *tex = NULL;
     if (texture_enabled && ctx->bound_texture_2d != 0) {
-        tex = texture_get(&ctx->textures, ctx->bound_texture_2d);
+        tex = upload_texture_get(ctx, ctx->bound_texture_2d);
     }
 
     int32_t cur_x = x0, cur_y = y0;
@@ -248,7 +257,7 @@ static void draw_line_segment(GLState *ctx, vertex_t *src0, vertex_t *src1)
     vertex_t v1 = *src1;
 
     /* Clip line to frustum */
-    if (!clip_line(&v0, &v1)) {
+    if (!clip_line(&v0, &v1, gl_vertex_live(ctx))) {
         return;  /* Line fully clipped */
     }
 
@@ -287,6 +296,8 @@ static void draw_line_segment(GLState *ctx, vertex_t *src0, vertex_t *src1)
 /* Flush GL_LINES primitive */
 void flush_lines(GLState *ctx)
 {
+    tiles_sync(ctx);
+
     vertex_t *verts = vertex_buffer_data(ctx);
     size_t count = vertex_buffer_count(ctx);
 
@@ -295,51 +306,6 @@ void flush_lines(GLState *ctx)
     }
 }
 
-/* Edge function for triangle rasterization (returns twice the signed area) */
-static inline float edge_function(float ax, float ay, float bx, float by, float px, float py)
-{
-    return (px - ax) * (by - ay) - (py - ay) * (bx - ax);
-}
-
-/* Rasterize a single triangle with flat color (first vertex) */
-static void rasterize_triangle_flat(GLState *ctx,
-    int32_t x0, int32_t y0,
-    int32_t x1, int32_t y1,
-    int32_t x2, int32_t y2,
-    pixel_t color)
-{
-    /* Bounding box */
-    int32_t minX = x0 < x1 ? (x0 < x2 ? x0 : x2) : (x1 < x2 ? x1 : x2);
-    int32_t minY = y0 < y1 ? (y0 < y2 ? y0 : y2) : (y1 < y2 ? y1 : y2);
-    int32_t maxX = x0 > x1 ? (x0 > x2 ? x0 : x2) : (x1 > x2 ? x1 : x2);
-    int32_t maxY = y0 > y1 ? (y0 > y2 ? y0 : y2) : (y1 > y2 ? y1 : y2);
-
-    /* Clip to viewport */
-    if (minX < ctx->viewport_x) minX = ctx->viewport_x;
-    if (minY < ctx->viewport_y) minY = ctx->viewport_y;
-    if (maxX >= ctx->viewport_x + ctx->viewport_w) maxX = ctx->viewport_x + ctx->viewport_w - 1;
-    if (maxY >= ctx->viewport_y + ctx->viewport_h) maxY = ctx->viewport_y + ctx->viewport_h - 1;
-
-    /* Triangle area (twice) */
-    float area = edge_function(x0, y0, x1, y1, x2, y2);
-    if (area == 0) return; /* Degenerate triangle */
-
-    /* Rasterize */
-    for (int32_t y = minY; y <= maxY; y++) {
-        for (int32_t x = minX; x <= maxX; x++) {
-            float w0 = edge_function(x1, y1, x2, y2, x, y);
-            float w1 = edge_function(x2, y2, x0, y0, x, y);
-            float w2 = edge_function(x0, y0, x1, y1, x, y);
-
-            /* Check if inside triangle (top-left fill rule) */
-            if ((area > 0 && w0 >= 0 && w1 >= 0 && w2 >= 0) ||
-                (area < 0 && w0 <= 0 && w1 <= 0 && w2 <= 0)) {
-                framebuffer_putpixel(&ctx->framebuffer, x, y, color);
-            }
-        }
-    }
-}
-
 /* Depth test comparison - returns 1 if test passes */
 static inline int depth_test(GLenum func, float incoming, float stored)
 {
@@ -447,19 +413,781 @@ static inline void write_stencil_masked(framebuffer_t *fb, int32_t x, int32_t y,
     framebuffer_putstencil(fb, x, y, result);
 }
 
-/* Rasterize a single triangle with per-vertex color, texcoords, depth, fog, and perspective correction */
-static void rasterize_triangle_smooth(GLState *ctx,
-    int32_t x0, int32_t y0, float z0, float w0_inv, color_t c0, vec2_t uv0, float ez0,
-    int32_t x1, int32_t y1, float z1, float w1_inv, color_t c1, vec2_t uv1, float ez1,
-    int32_t x2, int32_t y2, float z2, float w2_inv, color_t c2, vec2_t uv2, float ez2,
-    vec3_t ep0, vec3_t en0, vec3_t ep1, vec3_t en1, vec3_t ep2, vec3_t en2,
-    int is_back_facing)
+/* Interpolated fragment attributes. Each one is a plane over screen space, set up
+ * once per triangle; the fragment loops only add its per-pixel/per-row deltas. */
+enum {
+    ATTR_DEPTH,                         /* Window depth (after the depth range mapping) */
+    ATTR_R, ATTR_G, ATTR_B, ATTR_A,     /* Smooth color */
+    ATTR_ONE_W, ATTR_U_W, ATTR_V_W,     /* Perspective-correct texcoords: 1/w, u/w, v/w */
+    ATTR_U, ATTR_V,                     /* Affine texcoords (GL_FASTEST) */
+    ATTR_FOG,                           /* Eye-space z for fog */
+    ATTR_EYE_X, ATTR_EYE_Y, ATTR_EYE_Z, /* Eye position and normal for per-fragment lighting */
+    ATTR_NX, ATTR_NY, ATTR_NZ,
+    ATTR_COUNT
+};
+
+/* Texture coordinate interpolation, chosen by GL_PERSPECTIVE_CORRECTION_HINT */
+enum {
+    PERSPECTIVE_AFFINE,     /* GL_FASTEST: u, v interpolated linearly in screen space */
+    PERSPECTIVE_EXACT,      /* GL_NICEST: divide by 1/w at every fragment */
+    PERSPECTIVE_SPAN        /* GL_DONT_CARE: exact at the covered ends of each block row, linear in between */
+};
+
+/* Per-triangle interpolation state shared by the fragment paths */
+typedef struct {
+    color_t c2;                 /* Provoking vertex color (flat shading) */
+    texture_t *tex;
+    float tex_lod;
+    int is_back_facing;
+    int depth_enabled;
+    int stencil_enabled;
+    int perspective;            /* PERSPECTIVE_* */
+
+    /* Attribute planes: value = attr[i] + attr_dx[i] * (x - plane_x) + attr_dy[i] * (y - plane_y).
+     * Only the first attr_count entries are stepped; attributes that are not live are 0. */
+    float attr[ATTR_COUNT];
+    float attr_dx[ATTR_COUNT];
+    float attr_dy[ATTR_COUNT];
+    int attr_count;
+    int32_t plane_x, plane_y;
+
+    /* Edge stepping (biased edge values change by eN_dx per pixel and eN_dy per row) */
+    int64_t e0_dx, e1_dx, e2_dx;
+    int64_t e0_dy, e1_dy, e2_dy;
+} triangle_setup_t;
+
+/* Size of the blocks walked by the triangle rasterizer; blocks coincide with HiZ tiles */
+#define RASTER_BLOCK_SIZE FB_HIZ_TILE_SIZE
+
+/* Triangles whose clipped bounding box is at most RASTER_SMALL_TRIANGLE pixels on each
+ * side and whose area is below RASTER_TINY_AREA pixels get their pixel centers tested
+ * before any setup (see rasterize_triangle). Larger ones nearly always cover a center,
+ * and the test would only repeat the coverage work of the shade. */
+#define RASTER_SMALL_TRIANGLE 4
+#define RASTER_TINY_AREA 2
+
+/* Evaluate the live attribute planes at pixel (x, y) */
+static inline void attr_eval(const triangle_setup_t *t, int32_t x, int32_t y, float *v)
+{
+    float fx = (float)(x - t->plane_x), fy = (float)(y - t->plane_y);
+    for (int i = 0; i < t->attr_count; i++) {
+        v[i] = t->attr[i] + t->attr_dx[i] * fx + t->attr_dy[i] * fy;
+    }
+}
+
+/* Set up plane i from the attribute's vertex values, given the barycentric weights at
+ * the plane origin and their per-pixel (dx) and per-row (dy) deltas */
+static inline void attr_plane(triangle_setup_t *t, int i, const double *b,
+                              const double *b_dx, const double *b_dy,
+                              float a0, float a1, float a2)
+{
+    t->attr[i] = (float)(a0 * b[0] + a1 * b[1] + a2 * b[2]);
+    t->attr_dx[i] = (float)(a0 * b_dx[0] + a1 * b_dx[1] + a2 * b_dx[2]);
+    t->attr_dy[i] = (float)(a0 * b_dy[0] + a1 * b_dy[1] + a2 * b_dy[2]);
+    if (i >= t->attr_count) t->attr_count = i + 1;
+}
+
+/* Advance n attribute values by one pixel (or row) */
+static inline void attr_step(float *v, const float *dv, int n)
+{
+    for (int i = 0; i < n; i++) v[i] += dv[i];
+}
+
+/* Below this 1/w the division at a span end is not trusted (see perspective_span) */
+#define PERSPECTIVE_SPAN_MIN_ONE_W 1e-6f
+
+/* First and last covered pixel of the block row [x0, x1] whose biased edge values at
+ * x0 are e0..e2. Returns 0 when the row covers no pixel. */
+static inline int row_coverage(const triangle_setup_t *t, int32_t x0, int32_t x1,
+                               int64_t e0, int64_t e1, int64_t e2, int full,
+                               int32_t *first, int32_t *last)
+{
+    if (full) {
+        *first = x0;
+        *last = x1;
+        return 1;
+    }
+    *first = x1 + 1;
+    *last = x0 - 1;
+    for (int32_t x = x0; x <= x1; x++, e0 += t->e0_dx, e1 += t->e1_dx, e2 += t->e2_dx) {
+        if ((e0 | e1 | e2) >= 0) {
+            if (x < *first) *first = x;
+            *last = x;
+        }
+    }
+    return *first <= *last;
+}
+
+/* Subdivided perspective correction over one block row [x0, x1]: u, v are computed
+ * exactly at its first and last covered pixels and interpolated linearly in between.
+ * Both ends lie inside the triangle, where 1/w is positive; the block corners need not.
+ * Stores the values at x0 into v[ATTR_U], v[ATTR_V] and returns their per-pixel deltas.
+ * Returns 1 when 1/w at an end is too small to divide by: the row then has to divide
+ * at every pixel. */
+static inline int perspective_span(const triangle_setup_t *t, float *v, int32_t x0, int32_t x1,
+                                   int64_t e0, int64_t e1, int64_t e2, int full,
+                                   float *du, float *dv)
+{
+    int32_t first, last;
+    *du = *dv = 0.0f;
+    if (!row_coverage(t, x0, x1, e0, e1, e2, full, &first, &last)) return 0;
+
+    float n0 = (float)(first - x0), n1 = (float)(last - x0);
+    float ow0 = v[ATTR_ONE_W] + t->attr_dx[ATTR_ONE_W] * n0;
+    float ow1 = v[ATTR_ONE_W] + t->attr_dx[ATTR_ONE_W] * n1;
+    if (ow0 <= PERSPECTIVE_SPAN_MIN_ONE_W || ow1 <= PERSPECTIVE_SPAN_MIN_ONE_W) return 1;
+
+    float w0 = 1.0f / ow0, w1 = 1.0f / ow1;
+    float u0 = (v[ATTR_U_W] + t->attr_dx[ATTR_U_W] * n0) * w0;
+    float v0 = (v[ATTR_V_W] + t->attr_dx[ATTR_V_W] * n0) * w0;
+    if (last > first) {
+        float u1 = (v[ATTR_U_W] + t->attr_dx[ATTR_U_W] * n1) * w1;
+        float v1 = (v[ATTR_V_W] + t->attr_dx[ATTR_V_W] * n1) * w1;
+        float inv_n = 1.0f / (float)(last - first);
+        *du = (u1 - u0) * inv_n;
+        *dv = (v1 - v0) * inv_n;
+    }
+    v[ATTR_U] = u0 - *du * n0;
+    v[ATTR_V] = v0 - *dv * n0;
+    return 0;
+}
+
+/* Exact u, v of a pixel in a row perspective_span could not handle */
+static inline void perspective_divide_uv(float *v)
+{
+    float w = 1.0f / v[ATTR_ONE_W];
+    v[ATTR_U] = v[ATTR_U_W] * w;
+    v[ATTR_V] = v[ATTR_V_W] * w;
+}
+
+/* Shade a single covered pixel: stencil, depth, lighting, texturing, fog, blending and write.
+ * v holds the interpolated attributes (see ATTR_*) at the pixel. */
+static inline void shade_fragment(GLState *ctx, const triangle_setup_t *t,
+                                  int32_t x, int32_t y, const float *v)
+{
+    float depth = v[ATTR_DEPTH];
+
+    /* Stencil test (if enabled) */
+    uint8_t stencil_val = 0;
+    if (t->stencil_enabled) {
+        stencil_val = framebuffer_getstencil(&ctx->framebuffer, x, y);
+        if (!stencil_test(ctx->stencil_func, ctx->stencil_ref, ctx->stencil_mask, stencil_val)) {
+            /* Stencil test failed - apply stencil_fail op and skip pixel */
+            uint8_t new_stencil = stencil_op(ctx->stencil_fail, stencil_val, ctx->stencil_ref);
+            write_stencil_masked(&ctx->framebuffer, x, y, new_stencil, ctx->stencil_writemask);
+            return;
+        }
+    }
+
+    /* Depth test (only if GL_DEPTH_TEST enabled) */
+    if (t->depth_enabled) {
+        float stored_depth = framebuffer_getdepth(&ctx->framebuffer, x, y);
+        if (!depth_test(ctx->depth_func, depth, stored_depth)) {
+            /* Depth test failed - apply stencil_zfail op if stencil enabled */
+            if (t->stencil_enabled) {
+                uint8_t new_stencil = stencil_op(ctx->stencil_zfail, stencil_val, ctx->stencil_ref);
+                write_stencil_masked(&ctx->framebuffer, x, y, new_stencil, ctx->stencil_writemask);
+            }
+            return;
+        }
+    }
+
+    /* Both stencil and depth passed - apply stencil_zpass op if stencil enabled */
+    if (t->stencil_enabled) {
+        uint8_t new_stencil = stencil_op(ctx->stencil_zpass, stencil_val, ctx->stencil_ref);
+        write_stencil_masked(&ctx->framebuffer, x, y, new_stencil, ctx->stencil_writemask);
+    }
+
+    /* Interpolate or use flat color */
+    color_t c;
+    if (ctx->shade_model == GL_FLAT) {
+        /* Flat shading: use last vertex color (provoking vertex per OpenGL spec) */
+        c = t->c2;
+    } else {
+        /* Smooth/Phong: interpolated colors */
+        c = color(v[ATTR_R], v[ATTR_G], v[ATTR_B], v[ATTR_A]);
+    }
+
+    /* Per-fragment lighting for GL_PHONG, or two-sided lighting adjustment for Gouraud */
+    if (ctx->flags & FLAG_LIGHTING) {
+        if (ctx->shade_model == GL_PHONG) {
+            /* Phong shading: compute full lighting per-fragment */
+            vec3_t eye_pos    = vec3(v[ATTR_EYE_X], v[ATTR_EYE_Y], v[ATTR_EYE_Z]);
+            vec3_t eye_normal = vec3(v[ATTR_NX], v[ATTR_NY], v[ATTR_NZ]);
+
+            /* For two-sided lighting, flip normal and use back material for back faces */
+            material_t *mat = &ctx->material_front;
+            if (t->is_back_facing && ctx->light_model_two_side) {
+                eye_normal = vec3_scale(eye_normal, -1.0f);
+                mat = &ctx->material_back;
+            }
+
+            /* Compute per-fragment lighting */
+            c = compute_lighting(ctx, eye_pos, eye_normal, mat);
+        } else if (t->is_back_facing && ctx->light_model_two_side) {
+            /* For Gouraud shading with two-sided lighting on back faces,
+             * recompute lighting with flipped normal and back material */
+            vec3_t eye_pos    = vec3(v[ATTR_EYE_X], v[ATTR_EYE_Y], v[ATTR_EYE_Z]);
+            vec3_t eye_normal = vec3(v[ATTR_NX], v[ATTR_NY], v[ATTR_NZ]);
+            eye_normal = vec3_scale(eye_normal, -1.0f);
+            c = compute_lighting(ctx, eye_pos, eye_normal, &ctx->material_back);
+        }
+    }
+
+    /* Texture sampling */
+    if (t->tex && t->tex->pixels) {
+        float s, tc;
+
+        if (t->perspective == PERSPECTIVE_EXACT) {
+            /* Perspective-correct interpolation */
+            float w = 1.0f / v[ATTR_ONE_W];
+            s = v[ATTR_U_W] * w;
+            tc = v[ATTR_V_W] * w;
+        } else {
+            /* Affine (fast) interpolation, or linear within a perspective span */
+            s = v[ATTR_U];
+            tc = v[ATTR_V];
+        }
+
+        /* Sample texture with LOD-based filter selection */
+        uint32_t texel = texture_sample_lod(t->tex, s, tc, t->tex_lod);
+        color_t tex_color = color_from_rgba32(texel);
+
+        /* Alpha test - discard pixel if test fails */
+        if ((ctx->flags & FLAG_ALPHA_TEST) &&
+            !alpha_test(ctx->alpha_func, tex_color.a, ctx->alpha_ref)) {
+            return;
+        }
+
+        /* Apply texture environment mode */
+        switch (ctx->tex_env_mode) {
+            case GL_REPLACE:
+                /* Replace fragment color with texture color */
+                c = tex_color;
+                break;
+            case GL_DECAL:
+                /* Blend based on texture alpha (RGB only, keep fragment alpha) */
+                c = color_lerp_rgb(c, tex_color, tex_color.a);
+                break;
+            case GL_BLEND:
+                /* Blend with texture environment color per channel */
+                c = color_blend_per_channel(c, tex_color, ctx->tex_env_color);
+                break;
+            case GL_ADD:
+                /* Add texture color to fragment color (clamped later) */
+                c = color_add_rgb_mul_a(c, tex_color);
+                break;
+            case GL_MODULATE:
+            default:
+                /* Modulate (multiply) vertex color with texture color */
+                c = color_mul(c, tex_color);
+                break;
+        }
+    }
+
+    /* Apply fog if enabled */
+    if (ctx->flags & FLAG_FOG) {
+        /* Interpolated eye-space z */
+        float fog_coord = v[ATTR_FOG];
+        float f;  /* Fog factor: 1 = no fog, 0 = full fog */
+
+        switch (ctx->fog_mode) {
+            case GL_LINEAR:
+                if (ctx->fog_end != ctx->fog_start) {
+                    f = (ctx->fog_end - fog_coord) / (ctx->fog_end - ctx->fog_start);
+                } else {
+                    f = 1.0f;
+                }
+                break;
+            case GL_EXP:
+                f = expf(-ctx->fog_density * fog_coord);
+                break;
+            case GL_EXP2:
+                {
+                    float d = ctx->fog_density * fog_coord;
+                    f = expf(-d * d);
+                }
+                break;
+            default:
+                f = 1.0f;
+                break;
+        }
+
+        /* Clamp fog factor to [0, 1] */
+        if (f < 0.0f) f = 0.0f;
+        if (f > 1.0f) f = 1.0f;
+
+        /* Blend fragment color with fog color */
+        c = color_lerp_rgb(ctx->fog_color, c, f);
+    }
+
+    /* Write depth after alpha test (only if depth test enabled and passed) */
+    if (t->depth_enabled && ctx->depth_mask) {
+        framebuffer_putdepth(&ctx->framebuffer, x, y, depth);
+    }
+
+    /* Alpha blending */
+    if (ctx->flags & FLAG_BLEND) {
+        pixel_t dst_pixel = framebuffer_getpixel(&ctx->framebuffer, x, y);
+        color_t dst = color_from_rgba32(dst_pixel);
+        c = blend_colors(ctx, c, dst);
+    }
+
+    /* Clamp final color and write with color mask */
+    c = color_clamp(c);
+    write_pixel_masked(ctx, x, y, c);
+}
+
+/* Smallest and largest value of a biased edge function over a w x h pixel rectangle */
+static inline void edge_range(int64_t e, int64_t e_dx, int64_t e_dy, int32_t w, int32_t h,
+                              int64_t *lo, int64_t *hi)
+{
+    int64_t sx = e_dx * (w - 1), sy = e_dy * (h - 1);
+    *lo = e + (sx < 0 ? sx : 0) + (sy < 0 ? sy : 0);
+    *hi = e + (sx > 0 ? sx : 0) + (sy > 0 ? sy : 0);
+}
+
+#ifdef __SSE2__
+/* Depth comparison on 4 lanes, returns all-ones in lanes that pass */
+static inline __m128 depth_test_sse(GLenum func, __m128 incoming, __m128 stored)
+{
+    switch (func) {
+        case GL_NEVER:    return _mm_setzero_ps();
+        case GL_LESS:     return _mm_cmplt_ps(incoming, stored);
+        case GL_EQUAL:    return _mm_cmpeq_ps(incoming, stored);
+        case GL_LEQUAL:   return _mm_cmple_ps(incoming, stored);
+        case GL_GREATER:  return _mm_cmpgt_ps(incoming, stored);
+        case GL_NOTEQUAL: return _mm_cmpneq_ps(incoming, stored);
+        case GL_GEQUAL:   return _mm_cmpge_ps(incoming, stored);
+        case GL_ALWAYS:
+        default:          return _mm_castsi128_ps(_mm_set1_epi32(-1));
+    }
+}
+
+/* Pack 4 lanes of float RGBA into ABGR8888 pixels (same clamp/truncate as color_to_rgba32) */
+static inline __m128i pack_rgba_sse(__m128 r, __m128 g, __m128 b, __m128 a)
+{
+    const __m128 zero = _mm_setzero_ps();
+    const __m128 one = _mm_set1_ps(1.0f);
+    const __m128 scale = _mm_set1_ps(255.0f);
+    __m128i ri = _mm_cvttps_epi32(_mm_mul_ps(_mm_min_ps(_mm_max_ps(r, zero), one), scale));
+    __m128i gi = _mm_cvttps_epi32(_mm_mul_ps(_mm_min_ps(_mm_max_ps(g, zero), one), scale));
+    __m128i bi = _mm_cvttps_epi32(_mm_mul_ps(_mm_min_ps(_mm_max_ps(b, zero), one), scale));
+    __m128i ai = _mm_cvttps_epi32(_mm_mul_ps(_mm_min_ps(_mm_max_ps(a, zero), one), scale));
+    return _mm_or_si128(_mm_or_si128(ri, _mm_slli_epi32(gi, 8)),
+                        _mm_or_si128(_mm_slli_epi32(bi, 16), _mm_slli_epi32(ai, 24)));
+}
+
+/* 4-wide Gouraud fragment loop over one block [x0, x1] x [y0, y1]: coverage, depth
+ * stepping, depth test and color stepping run on 4 horizontally adjacent
+ * pixels; writes are masked per lane. e0..e2 are the biased edge values at (x0, y0).
+ * When full is set the block lies entirely inside the triangle and coverage is not
+ * evaluated. Only valid for untextured, unblended fill with all color channels written
+ * (see select_block_func). */
+static void shade_block_gouraud_sse(GLState *ctx, const triangle_setup_t *t,
+    int32_t x0, int32_t y0, int32_t x1, int32_t y1,
+    int64_t e0_row, int64_t e1_row, int64_t e2_row, int full)
+{
+    framebuffer_t *fb = &ctx->framebuffer;
+    const int32_t w = x1 - x0 + 1, h = y1 - y0 + 1;
+    const __m128i lane = _mm_set_epi32(3, 2, 1, 0);
+    const __m128 lane_f = _mm_set_ps(3.0f, 2.0f, 1.0f, 0.0f);
+
+    /* Coverage only has to test the edges that cross this block. Their values are
+     * bounded by the block extent and fit 32-bit lanes; edges the block lies
+     * entirely inside are replaced by a constant 0 (inside). */
+    int32_t c0 = 0, c0_dx = 0, c0_dy = 0;
+    int32_t c1 = 0, c1_dx = 0, c1_dy = 0;
+    int32_t c2 = 0, c2_dx = 0, c2_dy = 0;
+    if (!full) {
+        int64_t lo, hi;
+        edge_range(e0_row, t->e0_dx, t->e0_dy, w, h, &lo, &hi);
+        if (lo < 0) { c0 = (int32_t)e0_row; c0_dx = (int32_t)t->e0_dx; c0_dy = (int32_t)t->e0_dy; }
+        edge_range(e1_row, t->e1_dx, t->e1_dy, w, h, &lo, &hi);
+        if (lo < 0) { c1 = (int32_t)e1_row; c1_dx = (int32_t)t->e1_dx; c1_dy = (int32_t)t->e1_dy; }
+        edge_range(e2_row, t->e2_dx, t->e2_dy, w, h, &lo, &hi);
+        if (lo < 0) { c2 = (int32_t)e2_row; c2_dx = (int32_t)t->e2_dx; c2_dy = (int32_t)t->e2_dy; }
+    }
+    const __m128i c0_step = _mm_set1_epi32(c0_dx * 4);
+    const __m128i c1_step = _mm_set1_epi32(c1_dx * 4);
+    const __m128i c2_step = _mm_set1_epi32(c2_dx * 4);
+    const __m128i c0_off = _mm_set_epi32(c0_dx * 3, c0_dx * 2, c0_dx, 0);
+    const __m128i c1_off = _mm_set_epi32(c1_dx * 3, c1_dx * 2, c1_dx, 0);
+    const __m128i c2_off = _mm_set_epi32(c2_dx * 3, c2_dx * 2, c2_dx, 0);
+
+    /* Depth and color (attributes ATTR_DEPTH..ATTR_A) are stepped from the block origin;
+     * lane k is offset by k pixels */
+    const int nattr = t->attr_count < ATTR_A + 1 ? t->attr_count : ATTR_A + 1;
+    float row[ATTR_COUNT] = { 0 };
+    attr_eval(t, x0, y0, row);
+    __m128 off[ATTR_A + 1], step[ATTR_A + 1];
+    for (int i = 0; i < ATTR_A + 1; i++) {
+        off[i] = _mm_mul_ps(lane_f, _mm_set1_ps(t->attr_dx[i]));
+        step[i] = _mm_set1_ps(t->attr_dx[i] * 4.0f);
+    }
+    int depth_write = t->depth_enabled && ctx->depth_mask;
+
+    int flat = (ctx->shade_model == GL_FLAT);
+    const __m128i vflat = _mm_set1_epi32((int32_t)color_to_rgba32(color_clamp(t->c2)));
+
+    for (int32_t y = y0; y <= y1; y++, c0 += c0_dy, c1 += c1_dy, c2 += c2_dy) {
+        /* Lane k holds the values at x + k */
+        __m128i e0 = _mm_add_epi32(_mm_set1_epi32(c0), c0_off);
+        __m128i e1 = _mm_add_epi32(_mm_set1_epi32(c1), c1_off);
+        __m128i e2 = _mm_add_epi32(_mm_set1_epi32(c2), c2_off);
+        __m128 depth = _mm_add_ps(_mm_set1_ps(row[ATTR_DEPTH]), off[ATTR_DEPTH]);
+        __m128 r = _mm_add_ps(_mm_set1_ps(row[ATTR_R]), off[ATTR_R]);
+        __m128 g = _mm_add_ps(_mm_set1_ps(row[ATTR_G]), off[ATTR_G]);
+        __m128 b = _mm_add_ps(_mm_set1_ps(row[ATTR_B]), off[ATTR_B]);
+        __m128 a = _mm_add_ps(_mm_set1_ps(row[ATTR_A]), off[ATTR_A]);
+        for (int i = 0; i < nattr; i++) row[i] += t->attr_dy[i];
+        pixel_t *color_row = fb->color + (size_t)y * fb->width;
+        float *depth_row = fb->depth + (size_t)y * fb->width;
+
+        for (int32_t x = x0; x <= x1; x += 4,
+             e0 = _mm_add_epi32(e0, c0_step), e1 = _mm_add_epi32(e1, c1_step), e2 = _mm_add_epi32(e2, c2_step),
+             depth = _mm_add_ps(depth, step[ATTR_DEPTH]),
+             r = _mm_add_ps(r, step[ATTR_R]), g = _mm_add_ps(g, step[ATTR_G]),
+             b = _mm_add_ps(b, step[ATTR_B]), a = _mm_add_ps(a, step[ATTR_A])) {
+            /* Coverage: inside all crossing edges and left of the block's right border */
+            int whole = (x + 3 <= x1);
+            __m128 mask;
+            if (full && whole) {
+                mask = _mm_castsi128_ps(_mm_set1_epi32(-1));
+            } else {
+                __m128i in_box = _mm_cmplt_epi32(lane, _mm_set1_epi32(x1 - x + 1));
+                if (full) {
+                    mask = _mm_castsi128_ps(in_box);
+                } else {
+                    __m128i outside = _mm_or_si128(_mm_or_si128(e0, e1), e2);
+                    mask = _mm_castsi128_ps(_mm_andnot_si128(_mm_srai_epi32(outside, 31), in_box));
+                    if (_mm_movemask_ps(mask) == 0) continue;
+                }
+            }
+
+            float *dp = depth_row + x;
+            /* Depth test */
+            if (t->depth_enabled) {
+                __m128 stored;
+                if (whole) {
+                    stored = _mm_loadu_ps(dp);
+                } else {
+                    float tmp[4] = { 1.0f, 1.0f, 1.0f, 1.0f };
+                    for (int k = 0; x + k <= x1; k++) tmp[k] = dp[k];
+                    stored = _mm_loadu_ps(tmp);
+                }
+                mask = _mm_and_ps(mask, depth_test_sse(ctx->depth_func, depth, stored));
+                int bits = _mm_movemask_ps(mask);
+                if (bits == 0) continue;
+
+                if (depth_write) {
+                    __m128 merged = _mm_or_ps(_mm_and_ps(mask, depth), _mm_andnot_ps(mask, stored));
+                    if (whole) {
+                        _mm_storeu_ps(dp, merged);
+                    } else {
+                        float tmp[4];
+                        _mm_storeu_ps(tmp, merged);
+                        for (int k = 0; k < 4; k++) if (bits & (1 << k)) dp[k] = tmp[k];
+                    }
+                }
+            }
+
+            /* Color */
+            __m128i pixels = flat ? vflat : pack_rgba_sse(r, g, b, a);
+
+            /* Masked color write */
+            pixel_t *cp = color_row + x;
+            __m128i imask = _mm_castps_si128(mask);
+            if (whole) {
+                __m128i dst = _mm_loadu_si128((const __m128i *)cp);
+                dst = _mm_or_si128(_mm_and_si128(imask, pixels), _mm_andnot_si128(imask, dst));
+                _mm_storeu_si128((__m128i *)cp, dst);
+            } else {
+                uint32_t tmp[4];
+                int bits = _mm_movemask_ps(mask);
+                _mm_storeu_si128((__m128i *)tmp, pixels);
+                for (int k = 0; k < 4; k++) if (bits & (1 << k)) cp[k] = tmp[k];
+            }
+        }
+    }
+}
+#endif /* __SSE2__ */
+
+/* Scalar fragment loop over one block [x0, x1] x [y0, y1]; e0..e2 are the biased edge
+ * values at (x0, y0). When full is set the block lies entirely inside the triangle. */
+static void shade_block(GLState *ctx, const triangle_setup_t *t,
+    int32_t x0, int32_t y0, int32_t x1, int32_t y1,
+    int64_t e0_row, int64_t e1_row, int64_t e2_row, int full)
 {
-    /* Bounding box */
-    int32_t minX = x0 < x1 ? (x0 < x2 ? x0 : x2) : (x1 < x2 ? x1 : x2);
-    int32_t minY = y0 < y1 ? (y0 < y2 ? y0 : y2) : (y1 < y2 ? y1 : y2);
-    int32_t maxX = x0 > x1 ? (x0 > x2 ? x0 : x2) : (x1 > x2 ? x1 : x2);
-    int32_t maxY = y0 > y1 ? (y0 > y2 ? y0 : y2) : (y1 > y2 ? y1 : y2);
+    const int n = t->attr_count;
+    float row[ATTR_COUNT];
+    attr_eval(t, x0, y0, row);
+
+    for (int32_t y = y0; y <= y1; y++, e0_row += t->e0_dy, e1_row += t->e1_dy, e2_row += t->e2_dy) {
+        int64_t e0 = e0_row, e1 = e1_row, e2 = e2_row;
+        float v[ATTR_COUNT] = { 0 };
+        for (int i = 0; i < n; i++) {
+            v[i] = row[i];
+            row[i] += t->attr_dy[i];
+        }
+        float du = 0.0f, dv = 0.0f;
+        int divide = 0;
+        if (t->perspective == PERSPECTIVE_SPAN) {
+            divide = perspective_span(t, v, x0, x1, e0, e1, e2, full, &du, &dv);
+        }
+
+        for (int32_t x = x0; x <= x1; x++, e0 += t->e0_dx, e1 += t->e1_dx, e2 += t->e2_dx) {
+            /* Check if inside triangle (all biased edge values non-negative) */
+            if (full || (e0 | e1 | e2) >= 0) {
+                if (divide) perspective_divide_uv(v);
+                shade_fragment(ctx, t, x, y, v);
+            }
+            attr_step(v, t->attr_dx, n);
+            v[ATTR_U] += du;
+            v[ATTR_V] += dv;
+        }
+    }
+}
+
+/* Block shading function: shades the covered pixels of [x0, x1] x [y0, y1] given the
+ * biased edge values at (x0, y0); full means the whole block is inside the triangle */
+typedef void (*raster_block_func_t)(GLState *ctx, const triangle_setup_t *t,
+    int32_t x0, int32_t y0, int32_t x1, int32_t y1,
+    int64_t e0_row, int64_t e1_row, int64_t e2_row, int full);
+
+/* State-specialized variants of shade_block (see raster_span.h) */
+#ifndef __SSE2__
+#define SPAN_NAME shade_block_gouraud
+#define SPAN_DEPTH 0
+#define SPAN_FLAT 0
+#define SPAN_TEX_ENV 0
+#define SPAN_BLEND_OVER 0
+#define SPAN_COLOR_WRITE 1
+#include "raster_span.h"
+
+#define SPAN_NAME shade_block_gouraud_depth
+#define SPAN_DEPTH 1
+#define SPAN_FLAT 0
+#define SPAN_TEX_ENV 0
+#define SPAN_BLEND_OVER 0
+#define SPAN_COLOR_WRITE 1
+#include "raster_span.h"
+
+#define SPAN_NAME shade_block_flat
+#define SPAN_DEPTH 0
+#define SPAN_FLAT 1
+#define SPAN_TEX_ENV 0
+#define SPAN_BLEND_OVER 0
+#define SPAN_COLOR_WRITE 1
+#include "raster_span.h"
+
+#define SPAN_NAME shade_block_flat_depth
+#define SPAN_DEPTH 1
+#define SPAN_FLAT 1
+#define SPAN_TEX_ENV 0
+#define SPAN_BLEND_OVER 0
+#define SPAN_COLOR_WRITE 1
+#include "raster_span.h"
+#endif /* !__SSE2__ */
+
+#define SPAN_NAME shade_block_depth_only
+#define SPAN_DEPTH 1
+#define SPAN_FLAT 0
+#define SPAN_TEX_ENV 0
+#define SPAN_BLEND_OVER 0
+#define SPAN_COLOR_WRITE 0
+#include "raster_span.h"
+
+#define SPAN_NAME shade_block_gouraud_blend
+#define SPAN_DEPTH 0
+#define SPAN_FLAT 0
+#define SPAN_TEX_ENV 0
+#define SPAN_BLEND_OVER 1
+#define SPAN_COLOR_WRITE 1
+#include "raster_span.h"
+
+#define SPAN_NAME shade_block_gouraud_depth_blend
+#define SPAN_DEPTH 1
+#define SPAN_FLAT 0
+#define SPAN_TEX_ENV 0
+#define SPAN_BLEND_OVER 1
+#define SPAN_COLOR_WRITE 1
+#include "raster_span.h"
+
+#define SPAN_NAME shade_block_modulate
+#define SPAN_DEPTH 0
+#define SPAN_FLAT 0
+#define SPAN_TEX_ENV GL_MODULATE
+#define SPAN_BLEND_OVER 0
+#define SPAN_COLOR_WRITE 1
+#include "raster_span.h"
+
+#define SPAN_NAME shade_block_modulate_depth
+#define SPAN_DEPTH 1
+#define SPAN_FLAT 0
+#define SPAN_TEX_ENV GL_MODULATE
+#define SPAN_BLEND_OVER 0
+#define SPAN_COLOR_WRITE 1
+#include "raster_span.h"
+
+#define SPAN_NAME shade_block_modulate_blend
+#define SPAN_DEPTH 0
+#define SPAN_FLAT 0
+#define SPAN_TEX_ENV GL_MODULATE
+#define SPAN_BLEND_OVER 1
+#define SPAN_COLOR_WRITE 1
+#include "raster_span.h"
+
+#define SPAN_NAME shade_block_modulate_depth_blend
+#define SPAN_DEPTH 1
+#define SPAN_FLAT 0
+#define SPAN_TEX_ENV GL_MODULATE
+#define SPAN_BLEND_OVER 1
+#define SPAN_COLOR_WRITE 1
+#include "raster_span.h"
+
+#define SPAN_NAME shade_block_replace
+#define SPAN_DEPTH 0
+#define SPAN_FLAT 0
+#define SPAN_TEX_ENV GL_REPLACE
+#define SPAN_BLEND_OVER 0
+#define SPAN_COLOR_WRITE 1
+#include "raster_span.h"
+
+#define SPAN_NAME shade_block_replace_depth
+#define SPAN_DEPTH 1
+#define SPAN_FLAT 0
+#define SPAN_TEX_ENV GL_REPLACE
+#define SPAN_BLEND_OVER 0
+#define SPAN_COLOR_WRITE 1
+#include "raster_span.h"
+
+#define SPAN_NAME shade_block_replace_blend
+#define SPAN_DEPTH 0
+#define SPAN_FLAT 0
+#define SPAN_TEX_ENV GL_REPLACE
+#define SPAN_BLEND_OVER 1
+#define SPAN_COLOR_WRITE 1
+#include "raster_span.h"
+
+#define SPAN_NAME shade_block_replace_depth_blend
+#define SPAN_DEPTH 1
+#define SPAN_FLAT 0
+#define SPAN_TEX_ENV GL_REPLACE
+#define SPAN_BLEND_OVER 1
+#define SPAN_COLOR_WRITE 1
+#include "raster_span.h"
+
+/* Choose the block shading function for the current state. Called once per draw
+ * (state cannot change between glBegin and glEnd); anything not covered by a
+ * specialized variant uses the generic shade_block. */
+static raster_block_func_t select_block_func(GLState *ctx)
+{
+    GLbitfield flags = ctx->flags;
+    int depth = (flags & FLAG_DEPTH_TEST) != 0;
+
+    /* Stencil, fog, per-fragment or two-sided lighting: generic path */
+    if (flags & (FLAG_STENCIL_TEST | FLAG_FOG)) return shade_block;
+    if ((flags & FLAG_LIGHTING) && (ctx->shade_model == GL_PHONG || ctx->light_model_two_side)) {
+        return shade_block;
+    }
+
+    int mask_all = ctx->color_mask_r && ctx->color_mask_g && ctx->color_mask_b && ctx->color_mask_a;
+    int mask_none = !ctx->color_mask_r && !ctx->color_mask_g && !ctx->color_mask_b && !ctx->color_mask_a;
+    if (mask_none) return depth ? shade_block_depth_only : shade_block;
+    if (!mask_all) return shade_block;
+
+    int blend = (flags & FLAG_BLEND) != 0;
+    if (blend && !(ctx->blend_src == GL_SRC_ALPHA && ctx->blend_dst == GL_ONE_MINUS_SRC_ALPHA)) {
+        return shade_block;
+    }
+
+    texture_t *tex = NULL;
+    if ((flags & FLAG_TEXTURE_2D) && ctx->bound_texture_2d != 0) {
+        tex = upload_texture_get(ctx, ctx->bound_texture_2d);
+    }
+
+    if (tex && tex->pixels) {
+        if (flags & FLAG_ALPHA_TEST) return shade_block;
+        if (ctx->tex_env_mode == GL_REPLACE) {
+            if (blend) return depth ? shade_block_replace_depth_blend : shade_block_replace_blend;
+            return depth ? shade_block_replace_depth : shade_block_replace;
+        }
+        if (ctx->tex_env_mode != GL_MODULATE || ctx->shade_model == GL_FLAT) return shade_block;
+        if (blend) return depth ? shade_block_modulate_depth_blend : shade_block_modulate_blend;
+        return depth ? shade_block_modulate_depth : shade_block_modulate;
+    }
+
+    if (blend) {
+        if (ctx->shade_model == GL_FLAT) return shade_block;
+        return depth ? shade_block_gouraud_depth_blend : shade_block_gouraud_blend;
+    }
+
+#ifdef __SSE2__
+    return shade_block_gouraud_sse;
+#else
+    if (ctx->shade_model == GL_FLAT) return depth ? shade_block_flat_depth : shade_block_flat;
+    return depth ? shade_block_gouraud_depth : shade_block_gouraud;
+#endif
+}
+
+/* HiZ test of a w x h block at (x0b, y0b): nonzero when, with GL_LESS/GL_LEQUAL, the
+ * block's nearest depth is behind its tile's max stored depth. Window depth is linear in
+ * screen space, so its minimum over the block is found at one of the corners. */
+static inline int hiz_block_occluded(const GLState *ctx, const triangle_setup_t *t, double depth_min_tri,
+                                     int32_t x0b, int32_t y0b, int32_t w, int32_t h)
+{
+    const framebuffer_t *fb = &ctx->framebuffer;
+    float hiz = fb->hiz[(y0b >> FB_HIZ_TILE_SHIFT) * fb->hiz_width + (x0b >> FB_HIZ_TILE_SHIFT)];
+    double a = t->attr[ATTR_DEPTH];
+    double sx = (double)t->attr_dx[ATTR_DEPTH] * (x0b - t->plane_x);
+    double sy = (double)t->attr_dy[ATTR_DEPTH] * (y0b - t->plane_y);
+    double dx = t->attr_dx[ATTR_DEPTH], dy = t->attr_dy[ATTR_DEPTH];
+    double dmin = a + sx + sy + (dx < 0 ? dx * (w - 1) : 0.0) + (dy < 0 ? dy * (h - 1) : 0.0);
+    if (dmin < depth_min_tri) dmin = depth_min_tri;
+    /* Margin for the single precision evaluation and stepping of the depth plane */
+    float block_min = (float)(dmin - 1e-5 * (fabs(a) + fabs(sx) + fabs(sy) + 1.0));
+    return ctx->depth_func == GL_LESS ? block_min >= hiz : block_min > hiz;
+}
+
+/* Rasterize a single triangle with per-vertex color, texcoords, depth, fog, and perspective correction.
+ * Vertex positions are in 28.4 fixed point (see ndc_to_screen_fixed); pixels are sampled at
+ * their centers and edges shared by two triangles are owned by exactly one of them (top-left rule).
+ * Only pixels inside [clip_x0, clip_x1] x [clip_y0, clip_y1] (within the framebuffer) are
+ * touched. Blocks are aligned to RASTER_BLOCK_SIZE and attribute planes are anchored at the
+ * unclipped bounding box, so a clip rectangle aligned to blocks (a tile) produces exactly the
+ * pixels the full-screen call would produce inside it. */
+static void rasterize_triangle(GLState *ctx, raster_block_func_t shade, const raster_triangle_t *tri,
+                               int32_t clip_x0, int32_t clip_y0, int32_t clip_x1, int32_t clip_y1)
+{
+    const raster_vertex_t *rv0 = &tri->v[0], *rv1 = &tri->v[1], *rv2 = &tri->v[2];
+    int32_t x0 = rv0->x, y0 = rv0->y, x1 = rv1->x, y1 = rv1->y, x2 = rv2->x, y2 = rv2->y;
+    float z0 = rv0->z, z1 = rv1->z, z2 = rv2->z;
+    float w0_inv = rv0->w_inv, w1_inv = rv1->w_inv, w2_inv = rv2->w_inv;
+    color_t c0 = rv0->color, c1 = rv1->color, c2 = rv2->color;
+    vec2_t uv0 = rv0->texcoord, uv1 = rv1->texcoord, uv2 = rv2->texcoord;
+    float ez0 = rv0->eye_z, ez1 = rv1->eye_z, ez2 = rv2->eye_z;
+    vec3_t ep0 = rv0->eye_pos, ep1 = rv1->eye_pos, ep2 = rv2->eye_pos;
+    vec3_t en0 = rv0->eye_normal, en1 = rv1->eye_normal, en2 = rv2->eye_normal;
+    int is_back_facing = tri->is_back_facing;
+
+    /* Triangle area (twice, in sub-pixel units squared) */
+    int64_t area = (int64_t)(x2 - x0) * (y1 - y0) - (int64_t)(y2 - y0) * (x1 - x0);
+    if (area == 0) return; /* Degenerate triangle */
+
+    /* Bounding box of covered pixel centers (center of pixel x is at x * SUBPIXEL_ONE + SUBPIXEL_HALF) */
+    int32_t fminX = x0 < x1 ? (x0 < x2 ? x0 : x2) : (x1 < x2 ? x1 : x2);
+    int32_t fminY = y0 < y1 ? (y0 < y2 ? y0 : y2) : (y1 < y2 ? y1 : y2);
+    int32_t fmaxX = x0 > x1 ? (x0 > x2 ? x0 : x2) : (x1 > x2 ? x1 : x2);
+    int32_t fmaxY = y0 > y1 ? (y0 > y2 ? y0 : y2) : (y1 > y2 ? y1 : y2);
+    int32_t minX = (fminX - SUBPIXEL_HALF + SUBPIXEL_ONE - 1) >> SUBPIXEL_BITS;
+    int32_t minY = (fminY - SUBPIXEL_HALF + SUBPIXEL_ONE - 1) >> SUBPIXEL_BITS;
+    int32_t maxX = (fmaxX - SUBPIXEL_HALF) >> SUBPIXEL_BITS;
+    int32_t maxY = (fmaxY - SUBPIXEL_HALF) >> SUBPIXEL_BITS;
+
+    /* Attribute planes are anchored at the unclipped bounding box, so interpolated values
+     * do not depend on the viewport/scissor clipping below */
+    int32_t plane_x = minX, plane_y = minY;
 
     /* Clip to viewport */
     if (minX < ctx->viewport_x) minX = ctx->viewport_x;
@@ -476,39 +1204,101 @@ static void rasterize_triangle_smooth(GLState *ctx,
         if (maxY >= ctx->scissor_y + (int32_t)ctx->scissor_h) maxY = ctx->scissor_y + ctx->scissor_h - 1;
     }
 
+    /* Clip rectangle (the block functions access the buffers directly, so it never
+     * extends past the framebuffer) */
+    if (minX < clip_x0) minX = clip_x0;
+    if (minY < clip_y0) minY = clip_y0;
+    if (maxX > clip_x1) maxX = clip_x1;
+    if (maxY > clip_y1) maxY = clip_y1;
+
     /* Early exit if clipped away */
     if (minX > maxX || minY > maxY) return;
 
-    /* Triangle area (twice) */
-    float area = edge_function(x0, y0, x1, y1, x2, y2);
-    if (fabsf(area) < 0.5f) return; /* Degenerate triangle (less than half a pixel) */
+    /* Triangle setup: integer edge equations E(x, y) = A * x + B * y + C, one per edge,
+     * evaluated at the first pixel center and stepped by A per pixel and B per row.
+     * Edges are oriented so that the interior is positive regardless of winding. */
+    int64_t A0 = y2 - y1, B0 = x1 - x2;
+    int64_t A1 = y0 - y2, B1 = x2 - x0;
+    int64_t A2 = y1 - y0, B2 = x0 - x1;
+    if (area < 0) {
+        A0 = -A0; B0 = -B0;
+        A1 = -A1; B1 = -B1;
+        A2 = -A2; B2 = -B2;
+    }
 
-    float inv_area = 1.0f / area;
-    int depth_enabled = ctx->flags & FLAG_DEPTH_TEST;
-    int stencil_enabled = ctx->flags & FLAG_STENCIL_TEST;
+    /* Top-left fill rule: pixels exactly on an edge belong to the triangle only if the
+     * edge is a top edge (horizontal, interior below) or a left edge (interior to the right).
+     * Other edges get a bias of -1 so that E == 0 counts as outside. */
+    int64_t bias0 = (A0 > 0 || (A0 == 0 && B0 > 0)) ? 0 : -1;
+    int64_t bias1 = (A1 > 0 || (A1 == 0 && B1 > 0)) ? 0 : -1;
+    int64_t bias2 = (A2 > 0 || (A2 == 0 && B2 > 0)) ? 0 : -1;
+
+    int64_t px = ((int64_t)minX << SUBPIXEL_BITS) + SUBPIXEL_HALF;
+    int64_t py = ((int64_t)minY << SUBPIXEL_BITS) + SUBPIXEL_HALF;
+    int64_t e0_row = A0 * (px - x1) + B0 * (py - y1) + bias0;
+    int64_t e1_row = A1 * (px - x2) + B1 * (py - y2) + bias1;
+    int64_t e2_row = A2 * (px - x0) + B2 * (py - y0) + bias2;
+    int64_t e0_dx = A0 * SUBPIXEL_ONE, e0_dy = B0 * SUBPIXEL_ONE;
+    int64_t e1_dx = A1 * SUBPIXEL_ONE, e1_dy = B1 * SUBPIXEL_ONE;
+    int64_t e2_dx = A2 * SUBPIXEL_ONE, e2_dy = B2 * SUBPIXEL_ONE;
+
+    /* Small triangles: drop those that cover no pixel center of the bounding box before any
+     * attribute, LOD or HiZ setup. The corner ranges reject or accept the box for free; the
+     * per-pixel test only runs for tiny partially covered boxes, where a miss is likely. */
+    if (maxX - minX < RASTER_SMALL_TRIANGLE && maxY - minY < RASTER_SMALL_TRIANGLE) {
+        int32_t w = maxX - minX + 1, h = maxY - minY + 1;
+        int64_t lo0, hi0, lo1, hi1, lo2, hi2;
+        edge_range(e0_row, e0_dx, e0_dy, w, h, &lo0, &hi0);
+        edge_range(e1_row, e1_dx, e1_dy, w, h, &lo1, &hi1);
+        edge_range(e2_row, e2_dx, e2_dy, w, h, &lo2, &hi2);
+        if ((hi0 | hi1 | hi2) < 0) return;
+        /* area is twice the triangle area, in sub-pixel units squared */
+        int64_t tiny_area = (int64_t)2 * RASTER_TINY_AREA * SUBPIXEL_ONE * SUBPIXEL_ONE;
+        int covered = (lo0 | lo1 | lo2) >= 0 || (area < 0 ? -area : area) >= tiny_area;
+        int64_t r0 = e0_row, r1 = e1_row, r2 = e2_row;
+        for (int32_t y = minY; y <= maxY && !covered; y++, r0 += e0_dy, r1 += e1_dy, r2 += e2_dy) {
+            int64_t c0 = r0, c1 = r1, c2 = r2;
+            for (int32_t x = minX; x <= maxX; x++, c0 += e0_dx, c1 += e1_dx, c2 += e2_dx) {
+                if ((c0 | c1 | c2) >= 0) {
+                    covered = 1;
+                    break;
+                }
+            }
+        }
+        if (!covered) return;
+    }
+
+    triangle_setup_t t;
+    t.c2 = c2;
+    t.is_back_facing = is_back_facing;
+    t.depth_enabled = ctx->flags & FLAG_DEPTH_TEST;
+    t.stencil_enabled = ctx->flags & FLAG_STENCIL_TEST;
     int texture_enabled = ctx->flags & FLAG_TEXTURE_2D;
 
-    /* Perspective correction: GL_FASTEST = affine, GL_NICEST/GL_DONT_CARE = perspective correct */
-    int perspective_correct = (ctx->perspective_correction_hint != GL_FASTEST);
+    /* Perspective correction: GL_FASTEST = affine, GL_NICEST = exact per fragment,
+     * GL_DONT_CARE = exact at the covered ends of each block row (perspective_span) */
+    switch (ctx->perspective_correction_hint) {
+        case GL_FASTEST: t.perspective = PERSPECTIVE_AFFINE; break;
+        case GL_NICEST:  t.perspective = PERSPECTIVE_EXACT;  break;
+        default:         t.perspective = PERSPECTIVE_SPAN;   break;
+    }
 
     /* Get bound texture if texturing enabled */
     texture_t *tex = NULL;
     if (texture_enabled && ctx->bound_texture_2d != 0) {
-        tex = texture_get(&ctx->textures, ctx->bound_texture_2d);
+        tex = upload_texture_get(ctx, ctx->bound_texture_2d);
     }
-
-    /* Pre-compute perspective-corrected UV values (u/w, v/w) */
-    float u0_w = uv0.x * w0_inv, v0_w = uv0.y * w0_inv;
-    float u1_w = uv1.x * w1_inv, v1_w = uv1.y * w1_inv;
-    float u2_w = uv2.x * w2_inv, v2_w = uv2.y * w2_inv;
+    t.tex = tex;
 
     /* Compute approximate LOD for texture filtering.
      * LOD = log2(texels_per_pixel). LOD > 0 means minification.
-     * We estimate this using the ratio of UV area to screen area. */
+     * We estimate this using the ratio of UV area to screen area.
+     * When the min and mag filters are the same (neither can then be a mipmap
+     * filter) the sampler ignores the LOD and it is left at 0. */
     float tex_lod = 0.0f;
-    if (tex && tex->pixels) {
+    if (tex && tex->pixels && tex->min_filter != tex->mag_filter) {
         /* Compute screen-space triangle area (already have it as 'area', but that's 2x) */
-        float screen_area = fabsf(area) * 0.5f;
+        float screen_area = (float)(area < 0 ? -area : area) * (0.5f / (SUBPIXEL_ONE * SUBPIXEL_ONE));
 
         /* Compute UV-space triangle area (scaled to texel space) */
         float du1 = (uv1.x - uv0.x) * tex->width;
@@ -520,205 +1310,136 @@ static void rasterize_triangle_smooth(GLState *ctx,
         /* Avoid division by zero */
         if (screen_area > 0.0f) {
             float texels_per_pixel = texel_area / screen_area;
-            /* LOD = log2(texels_per_pixel) for proper mipmap level selection */
-            if (texels_per_pixel > 0.0f) {
+            /* LOD = log2(texels_per_pixel) for proper mipmap level selection;
+             * magnification (ratio <= 1) clamps to 0 without the log */
+            if (texels_per_pixel > 1.0f) {
                 tex_lod = log2f(texels_per_pixel) * 0.5f;  /* 0.5 because area ratio, not length ratio */
-                if (tex_lod < 0.0f) tex_lod = 0.0f;  /* Clamp to 0 for magnification */
             }
         }
     }
+    t.tex_lod = tex_lod;
+
+    t.e0_dx = e0_dx; t.e1_dx = e1_dx; t.e2_dx = e2_dx;
+    t.e0_dy = e0_dy; t.e1_dy = e1_dy; t.e2_dy = e2_dy;
+
+    /* Attribute planes. The unbiased edge functions divided by |area| are the barycentric
+     * weights of the vertex opposite each edge; they are evaluated in double at the plane
+     * origin together with their per-pixel and per-row deltas. */
+    double ia = 1.0 / (double)(area < 0 ? -area : area);
+    int64_t ox = ((int64_t)plane_x << SUBPIXEL_BITS) + SUBPIXEL_HALF;
+    int64_t oy = ((int64_t)plane_y << SUBPIXEL_BITS) + SUBPIXEL_HALF;
+    const double bary[3] = {
+        (double)(A0 * (ox - x1) + B0 * (oy - y1)) * ia,
+        (double)(A1 * (ox - x2) + B1 * (oy - y2)) * ia,
+        (double)(A2 * (ox - x0) + B2 * (oy - y0)) * ia
+    };
+    const double bary_dx[3] = { (double)e0_dx * ia, (double)e1_dx * ia, (double)e2_dx * ia };
+    const double bary_dy[3] = { (double)e0_dy * ia, (double)e1_dy * ia, (double)e2_dy * ia };
+
+    memset(t.attr, 0, sizeof(t.attr));
+    memset(t.attr_dx, 0, sizeof(t.attr_dx));
+    memset(t.attr_dy, 0, sizeof(t.attr_dy));
+    t.plane_x = plane_x;
+    t.plane_y = plane_y;
+    t.attr_count = ATTR_DEPTH + 1;
+
+    /* Depth is always set up (also used by the HiZ test): NDC z in [-1, 1] mapped to the depth range */
+    float depth_scale = 0.5f * (ctx->depth_far - ctx->depth_near);
+    float d0 = (z0 + 1.0f) * depth_scale + ctx->depth_near;
+    float d1 = (z1 + 1.0f) * depth_scale + ctx->depth_near;
+    float d2 = (z2 + 1.0f) * depth_scale + ctx->depth_near;
+    attr_plane(&t, ATTR_DEPTH, bary, bary_dx, bary_dy, d0, d1, d2);
+
+    /* Only attributes the current state reads are interpolated */
+    int lighting = (ctx->flags & FLAG_LIGHTING) != 0;
+    int phong = lighting && ctx->shade_model == GL_PHONG;
+    int textured = tex && tex->pixels;
+    if (ctx->shade_model != GL_FLAT && !phong && !(textured && ctx->tex_env_mode == GL_REPLACE)) {
+        attr_plane(&t, ATTR_R, bary, bary_dx, bary_dy, c0.r, c1.r, c2.r);
+        attr_plane(&t, ATTR_G, bary, bary_dx, bary_dy, c0.g, c1.g, c2.g);
+        attr_plane(&t, ATTR_B, bary, bary_dx, bary_dy, c0.b, c1.b, c2.b);
+        attr_plane(&t, ATTR_A, bary, bary_dx, bary_dy, c0.a, c1.a, c2.a);
+    }
+    if (!textured) t.perspective = PERSPECTIVE_AFFINE;
+    if (textured && t.perspective != PERSPECTIVE_AFFINE) {
+        attr_plane(&t, ATTR_ONE_W, bary, bary_dx, bary_dy, w0_inv, w1_inv, w2_inv);
+        attr_plane(&t, ATTR_U_W, bary, bary_dx, bary_dy, uv0.x * w0_inv, uv1.x * w1_inv, uv2.x * w2_inv);
+        attr_plane(&t, ATTR_V_W, bary, bary_dx, bary_dy, uv0.y * w0_inv, uv1.y * w1_inv, uv2.y * w2_inv);
+        /* Spans write their linear u, v into ATTR_U/ATTR_V (see perspective_span) */
+        if (t.perspective == PERSPECTIVE_SPAN) t.attr_count = ATTR_V + 1;
+    } else if (textured) {
+        attr_plane(&t, ATTR_U, bary, bary_dx, bary_dy, uv0.x, uv1.x, uv2.x);
+        attr_plane(&t, ATTR_V, bary, bary_dx, bary_dy, uv0.y, uv1.y, uv2.y);
+    }
+    if (ctx->flags & FLAG_FOG) {
+        attr_plane(&t, ATTR_FOG, bary, bary_dx, bary_dy, ez0, ez1, ez2);
+    }
+    if (phong || (lighting && is_back_facing && ctx->light_model_two_side)) {
+        attr_plane(&t, ATTR_EYE_X, bary, bary_dx, bary_dy, ep0.x, ep1.x, ep2.x);
+        attr_plane(&t, ATTR_EYE_Y, bary, bary_dx, bary_dy, ep0.y, ep1.y, ep2.y);
+        attr_plane(&t, ATTR_EYE_Z, bary, bary_dx, bary_dy, ep0.z, ep1.z, ep2.z);
+        attr_plane(&t, ATTR_NX, bary, bary_dx, bary_dy, en0.x, en1.x, en2.x);
+        attr_plane(&t, ATTR_NY, bary, bary_dx, bary_dy, en0.y, en1.y, en2.y);
+        attr_plane(&t, ATTR_NZ, bary, bary_dx, bary_dy, en0.z, en1.z, en2.z);
+    }
 
-    /* Rasterize */
-    for (int32_t y = minY; y <= maxY; y++) {
-        for (int32_t x = minX; x <= maxX; x++) {
-            float e0 = edge_function(x1, y1, x2, y2, x, y);
-            float e1 = edge_function(x2, y2, x0, y0, x, y);
-            float e2 = edge_function(x0, y0, x1, y1, x, y);
-
-            /* Check if inside triangle */
-            if ((area > 0 && e0 >= 0 && e1 >= 0 && e2 >= 0) ||
-                (area < 0 && e0 <= 0 && e1 <= 0 && e2 <= 0)) {
-                /* Barycentric coordinates */
-                float b0 = e0 * inv_area;
-                float b1 = e1 * inv_area;
-                float b2 = e2 * inv_area;
-
-                /* Interpolate depth (NDC z is in [-1, 1], map to depth range) */
-                float z = b0 * z0 + b1 * z1 + b2 * z2;
-                float depth = (z + 1.0f) * 0.5f * (ctx->depth_far - ctx->depth_near) + ctx->depth_near;
-
-                /* Stencil test (if enabled) */
-                uint8_t stencil_val = 0;
-                if (stencil_enabled) {
-                    stencil_val = framebuffer_getstencil(&ctx->framebuffer, x, y);
-                    if (!stencil_test(ctx->stencil_func, ctx->stencil_ref, ctx->stencil_mask, stencil_val)) {
-                        /* Stencil test failed - apply stencil_fail op and skip pixel */
-                        uint8_t new_stencil = stencil_op(ctx->stencil_fail, stencil_val, ctx->stencil_ref);
-                        write_stencil_masked(&ctx->framebuffer, x, y, new_stencil, ctx->stencil_writemask);
-                        continue;
-                    }
-                }
-
-                /* Depth test (only if GL_DEPTH_TEST enabled) */
-                if (depth_enabled) {
-                    float stored_depth = framebuffer_getdepth(&ctx->framebuffer, x, y);
-                    if (!depth_test(ctx->depth_func, depth, stored_depth)) {
-                        /* Depth test failed - apply stencil_zfail op if stencil enabled */
-                        if (stencil_enabled) {
-                            uint8_t new_stencil = stencil_op(ctx->stencil_zfail, stencil_val, ctx->stencil_ref);
-                            write_stencil_masked(&ctx->framebuffer, x, y, new_stencil, ctx->stencil_writemask);
-                        }
-                        continue;
-                    }
-                }
-
-                /* Both stencil and depth passed - apply stencil_zpass op if stencil enabled */
-                if (stencil_enabled) {
-                    uint8_t new_stencil = stencil_op(ctx->stencil_zpass, stencil_val, ctx->stencil_ref);
-                    write_stencil_masked(&ctx->framebuffer, x, y, new_stencil, ctx->stencil_writemask);
-                }
-
-                /* Interpolate or use flat color */
-                color_t c;
-                if (ctx->shade_model == GL_FLAT) {
-                    /* Flat shading: use last vertex color (provoking vertex per OpenGL spec) */
-                    c = c2;
-                } else {
-                    /* Smooth/Phong: interpolate colors */
-                    c = color_bary(c0, c1, c2, b0, b1, b2);
-                }
-
-                /* Per-fragment lighting for GL_PHONG, or two-sided lighting adjustment for Gouraud */
-                if (ctx->flags & FLAG_LIGHTING) {
-                    if (ctx->shade_model == GL_PHONG) {
-                        /* Phong shading: compute full lighting per-fragment */
-                        vec3_t eye_pos    = vec3_bary(ep0, ep1, ep2, b0, b1, b2);
-                        vec3_t eye_normal = vec3_bary(en0, en1, en2, b0, b1, b2);
-
-                        /* For two-sided lighting, flip normal and use back material for back faces */
-                        material_t *mat = &ctx->material_front;
-                        if (is_back_facing && ctx->light_model_two_side) {
-                            eye_normal = vec3_scale(eye_normal, -1.0f);
-                            mat = &ctx->material_back;
-                        }
-
-                        /* Compute per-fragment lighting */
-                        c = compute_lighting(ctx, eye_pos, eye_normal, mat);
-                    } else if (is_back_facing && ctx->light_model_two_side) {
-                        /* For Gouraud shading with two-sided lighting on back faces,
-                         * recompute lighting with flipped normal and back material */
-                        vec3_t eye_pos    = vec3_bary(ep0, ep1, ep2, b0, b1, b2);
-                        vec3_t eye_normal = vec3_bary(en0, en1, en2, b0, b1, b2);
-                        eye_normal = vec3_scale(eye_normal, -1.0f);
-                        c = compute_lighting(ctx, eye_pos, eye_normal, &ctx->material_back);
-                    }
-                }
-
-                /* Texture sampling */
-                if (tex && tex->pixels) {
-                    float u, v;
-
-                    if (perspective_correct) {
-                        /* Perspective-correct interpolation */
-                        float u_over_w = b0 * u0_w + b1 * u1_w + b2 * u2_w;
-                        float v_over_w = b0 * v0_w + b1 * v1_w + b2 * v2_w;
-                        float one_over_w = b0 * w0_inv + b1 * w1_inv + b2 * w2_inv;
-                        float w = 1.0f / one_over_w;
-                        u = u_over_w * w;
-                        v = v_over_w * w;
-                    } else {
-                        /* Affine (fast) interpolation */
-                        u = b0 * uv0.x + b1 * uv1.x + b2 * uv2.x;
-                        v = b0 * uv0.y + b1 * uv1.y + b2 * uv2.y;
-                    }
-
-                    /* Sample texture with LOD-based filter selection */
-                    uint32_t texel = texture_sample_lod(tex, u, v, tex_lod);
-                    color_t tex_color = color_from_rgba32(texel);
-
-                    /* Alpha test - discard pixel if test fails */
-                    if ((ctx->flags & FLAG_ALPHA_TEST) &&
-                        !alpha_test(ctx->alpha_func, tex_color.a, ctx->alpha_ref)) {
-                        continue;
-                    }
-
-                    /* Apply texture environment mode */
-                    switch (ctx->tex_env_mode) {
-                        case GL_REPLACE:
-                            /* Replace fragment color with texture color */
-                            c = tex_color;
-                            break;
-                        case GL_DECAL:
-                            /* Blend based on texture alpha (RGB only, keep fragment alpha) */
-                            c = color_lerp_rgb(c, tex_color, tex_color.a);
-                            break;
-                        case GL_BLEND:
-                            /* Blend with texture environment color per channel */
-                            c = color_blend_per_channel(c, tex_color, ctx->tex_env_color);
-                            break;
-                        case GL_ADD:
-                            /* Add texture color to fragment color (clamped later) */
-                            c = color_add_rgb_mul_a(c, tex_color);
-                            break;
-                        case GL_MODULATE:
-                        default:
-                            /* Modulate (multiply) vertex color with texture color */
-                            c = color_mul(c, tex_color);
-                            break;
-                    }
-                }
-
-                /* Apply fog if enabled */
-                if (ctx->flags & FLAG_FOG) {
-                    /* Interpolate eye-space z for fog */
-                    float fog_coord = b0 * ez0 + b1 * ez1 + b2 * ez2;
-                    float f;  /* Fog factor: 1 = no fog, 0 = full fog */
-
-                    switch (ctx->fog_mode) {
-                        case GL_LINEAR:
-                            if (ctx->fog_end != ctx->fog_start) {
-                                f = (ctx->fog_end - fog_coord) / (ctx->fog_end - ctx->fog_start);
-                            } else {
-                                f = 1.0f;
-                            }
-                            break;
-                        case GL_EXP:
-                            f = expf(-ctx->fog_density * fog_coord);
-                            break;
-                        case GL_EXP2:
-                            {
-                                float d = ctx->fog_density * fog_coord;
-                                f = expf(-d * d);
-                            }
-                            break;
-                        default:
-                            f = 1.0f;
-                            break;
-                    }
-
-                    /* Clamp fog factor to [0, 1] */
-                    if (f < 0.0f) f = 0.0f;
-                    if (f > 1.0f) f = 1.0f;
-
-                    /* Blend fragment color with fog color */
-                    c = color_lerp_rgb(ctx->fog_color, c, f);
-                }
-
-                /* Write depth after alpha test (only if depth test enabled and passed) */
-                if (depth_enabled && ctx->depth_mask) {
-                    framebuffer_putdepth(&ctx->framebuffer, x, y, depth);
-                }
-
-                /* Alpha blending */
-                if (ctx->flags & FLAG_BLEND) {
-                    pixel_t dst_pixel = framebuffer_getpixel(&ctx->framebuffer, x, y);
-                    color_t dst = color_from_rgba32(dst_pixel);
-                    c = blend_colors(ctx, c, dst);
-                }
+    /* Hierarchical Z: with GL_LESS/GL_LEQUAL a block whose nearest depth is behind the
+     * tile's max stored depth cannot produce a fragment. Not used with stencil, where
+     * depth-failing fragments still update the stencil buffer. */
+    framebuffer_t *fb = &ctx->framebuffer;
+    int hiz_test = t.depth_enabled && !t.stencil_enabled &&
+                   (ctx->depth_func == GL_LESS || ctx->depth_func == GL_LEQUAL);
+    int hiz_write = t.depth_enabled && ctx->depth_mask;
+    double depth_min_tri = d0 < d1 ? (d0 < d2 ? d0 : d2) : (d1 < d2 ? d1 : d2);
+
+    /* A clipped bounding box inside one block (small triangles, or the part of a triangle
+     * inside a tile's block) is shaded with a single call and no walk. It is the one block
+     * the walk would visit, so the pixels are the same in immediate and tiled mode. */
+    const int32_t block_mask = ~(RASTER_BLOCK_SIZE - 1);
+    if (((minX ^ maxX) & block_mask) == 0 && ((minY ^ maxY) & block_mask) == 0) {
+        int32_t w = maxX - minX + 1, h = maxY - minY + 1;
+        int64_t lo0, hi0, lo1, hi1, lo2, hi2;
+        edge_range(e0_row, e0_dx, e0_dy, w, h, &lo0, &hi0);
+        edge_range(e1_row, e1_dx, e1_dy, w, h, &lo1, &hi1);
+        edge_range(e2_row, e2_dx, e2_dy, w, h, &lo2, &hi2);
+        if ((hi0 | hi1 | hi2) < 0) return;
+        if (hiz_test && hiz_block_occluded(ctx, &t, depth_min_tri, minX, minY, w, h)) return;
+        shade(ctx, &t, minX, minY, maxX, maxY, e0_row, e1_row, e2_row, (lo0 | lo1 | lo2) >= 0);
+        if (hiz_write) framebuffer_hiz_update_tile(fb, minX >> FB_HIZ_TILE_SHIFT, minY >> FB_HIZ_TILE_SHIFT);
+        return;
+    }
 
-                /* Clamp final color and write with color mask */
-                c = color_clamp(c);
-                write_pixel_masked(ctx, x, y, c);
+    /* Walk the bounding box in screen-aligned blocks. Blocks entirely outside an edge are
+     * skipped, blocks entirely inside all edges are shaded without per-pixel coverage tests. */
+    for (int32_t by = minY & block_mask; by <= maxY; by += RASTER_BLOCK_SIZE) {
+        int32_t y0b = by < minY ? minY : by;
+        int32_t y1b = by + RASTER_BLOCK_SIZE - 1 > maxY ? maxY : by + RASTER_BLOCK_SIZE - 1;
+
+        for (int32_t bx = minX & block_mask; bx <= maxX; bx += RASTER_BLOCK_SIZE) {
+            int32_t x0b = bx < minX ? minX : bx;
+            int32_t x1b = bx + RASTER_BLOCK_SIZE - 1 > maxX ? maxX : bx + RASTER_BLOCK_SIZE - 1;
+            int32_t w = x1b - x0b + 1, h = y1b - y0b + 1;
+
+            /* Edge values at the block's first pixel */
+            int64_t e0 = e0_row + (x0b - minX) * e0_dx + (y0b - minY) * e0_dy;
+            int64_t e1 = e1_row + (x0b - minX) * e1_dx + (y0b - minY) * e1_dy;
+            int64_t e2 = e2_row + (x0b - minX) * e2_dx + (y0b - minY) * e2_dy;
+
+            /* Trivial reject / accept from the block corners */
+            int64_t lo0, hi0, lo1, hi1, lo2, hi2;
+            edge_range(e0, e0_dx, e0_dy, w, h, &lo0, &hi0);
+            edge_range(e1, e1_dx, e1_dy, w, h, &lo1, &hi1);
+            edge_range(e2, e2_dx, e2_dy, w, h, &lo2, &hi2);
+            if ((hi0 | hi1 | hi2) < 0) continue;
+            int full = (lo0 | lo1 | lo2) >= 0;
+
+            if (hiz_test && hiz_block_occluded(ctx, &t, depth_min_tri, x0b, y0b, w, h)) continue;
+
+            shade(ctx, &t, x0b, y0b, x1b, y1b, e0, e1, e2, full);
+
+            /* Tighten the tile bound after writing depth */
+            if (hiz_write) {
+                framebuffer_hiz_update_tile(fb, bx >> FB_HIZ_TILE_SHIFT, by >> FB_HIZ_TILE_SHIFT);
             }
         }
     }
@@ -843,6 +1564,13 @@ static void draw_point_at_screen(GLState *ctx, int32_t x, int32_t y, float z, co
     write_pixel_masked(ctx, x, y, c);
 }
 
+/* Entry point for the tile workers: rasterize a binned triangle with a state snapshot */
+void raster_triangle_rect(GLState *state, tile_shade_func_t shade, const raster_triangle_t *tri,
+                          int32_t x0, int32_t y0, int32_t x1, int32_t y1)
+{
+    rasterize_triangle(state, (raster_block_func_t)shade, tri, x0, y0, x1, y1);
+}
+
 /* Draw a triangle as wireframe (3 edges) */
 static void draw_triangle_wireframe(GLState *ctx, vertex_t *c0, vertex_t *c1, vertex_t *c2)
 {
@@ -897,107 +1625,221 @@ static void draw_triangle_points(GLState *ctx, vertex_t *c0, vertex_t *c1, verte
     draw_point_at_screen(ctx, x2, y2, c2->position.z, col2, c2->eye_z);
 }
 
-/* Render a single triangle with clipping and rasterization */
-static void render_triangle(GLState *ctx, vertex_t *v0, vertex_t *v1, vertex_t *v2)
+/* Cull and draw one triangle. p0..p2 hold the projected positions of v0..v2; all other
+ * attributes are read from the vertices. The point and line polygon modes draw from
+ * the vertices themselves, so they must already hold NDC positions when those modes
+ * are active. */
+static void draw_triangle(GLState *ctx, raster_block_func_t shade,
+                          const vertex_t *v0, const post_vertex_t *p0,
+                          const vertex_t *v1, const post_vertex_t *p1,
+                          const vertex_t *v2, const post_vertex_t *p2)
+{
+    int32_t x0 = p0->sx, y0 = p0->sy;
+    int32_t x1 = p1->sx, y1 = p1->sy;
+    int32_t x2 = p2->sx, y2 = p2->sy;
+
+    /* Backface culling - compute signed area in screen space (sub-pixel units) */
+    float signed_area = (float)((int64_t)(x1 - x0) * (y2 - y0)
+                              - (int64_t)(x2 - x0) * (y1 - y0));
+    if (should_cull(ctx, signed_area)) return;
+
+    /* Determine if this is a back-facing triangle for two-sided lighting.
+     * In screen space with Y pointing down (flipped from NDC):
+     * negative area = CCW in original NDC, positive area = CW in original NDC */
+    int is_back_facing;
+    if (ctx->front_face == GL_CCW) {
+        is_back_facing = (signed_area >= 0);  /* CW in NDC = back facing */
+    } else {
+        is_back_facing = (signed_area < 0);   /* CCW in NDC = back facing when front is CW */
+    }
+
+    /* Get polygon mode for this face */
+    GLenum poly_mode = is_back_facing ? ctx->polygon_mode_back : ctx->polygon_mode_front;
+
+    if (poly_mode == GL_POINT) {
+        /* Draw triangle vertices as points (immediately, after any binned triangles) */
+        tiles_sync(ctx);
+        draw_triangle_points(ctx, (vertex_t *)v0, (vertex_t *)v1, (vertex_t *)v2);
+    } else if (poly_mode == GL_LINE) {
+        /* Draw triangle edges as lines */
+        tiles_sync(ctx);
+        draw_triangle_wireframe(ctx, (vertex_t *)v0, (vertex_t *)v1, (vertex_t *)v2);
+    } else {
+        /* GL_FILL - Use smooth shading (Gouraud) with depth, textures, fog, and perspective correction */
+        raster_triangle_t tri;
+        const vertex_t *v[3] = { v0, v1, v2 };
+        const post_vertex_t *p[3] = { p0, p1, p2 };
+        for (int i = 0; i < 3; i++) {
+            tri.v[i].x = p[i]->sx;
+            tri.v[i].y = p[i]->sy;
+            tri.v[i].z = p[i]->ndc.z;
+            tri.v[i].w_inv = p[i]->ndc.w;
+            tri.v[i].color = v[i]->color;
+        }
+        /* Attributes that are not live are never set up, leave them out of the bin */
+        uint32_t live = gl_vertex_live(ctx);
+        for (int i = 0; i < 3; i++) {
+            if (live & VERTEX_LIVE_TEXCOORD) tri.v[i].texcoord = v[i]->texcoord;
+            if (live & VERTEX_LIVE_FOG) tri.v[i].eye_z = v[i]->eye_z;
+            if (live & VERTEX_LIVE_EYE) {
+                tri.v[i].eye_pos = v[i]->eye_pos;
+                tri.v[i].eye_normal = v[i]->eye_normal;
+            }
+        }
+        tri.is_back_facing = is_back_facing;
+
+        if (ctx->tiles) {
+            tiles_bin_triangle(ctx, (tile_shade_func_t)shade, &tri);
+        } else {
+            rasterize_triangle(ctx, shade, &tri, 0, 0,
+                               ctx->framebuffer.width - 1, ctx->framebuffer.height - 1);
+        }
+    }
+}
+
+/* Clip a triangle that crosses the frustum and draw the resulting polygon */
+static void clip_and_draw_triangle(GLState *ctx, raster_block_func_t shade,
+                                   const vertex_t *v0, const vertex_t *v1, const vertex_t *v2)
 {
     vertex_t triangle[3] = { *v0, *v1, *v2 };
     vertex_t clipped[MAX_CLIP_VERTS];
+    post_vertex_t projected[MAX_CLIP_VERTS];
 
     /* Clip triangle against frustum (in clip space, before perspective divide) */
-    int clip_count = clip_triangle(triangle, clipped);
+    int clip_count = clip_triangle(triangle, clipped, gl_vertex_live(ctx));
     if (clip_count < 3) return;
 
-    /* Perspective divide for all clipped vertices */
+    /* Perspective divide and screen mapping for all clipped vertices */
     for (int j = 0; j < clip_count; j++) {
         perspective_divide(&clipped[j]);
+        projected[j].ndc = clipped[j].position;
+        ndc_to_screen_fixed(ctx, clipped[j].position.x, clipped[j].position.y,
+                            &projected[j].sx, &projected[j].sy);
     }
 
     /* Triangulate the clipped polygon (fan from first vertex) */
     for (int j = 1; j + 1 < clip_count; j++) {
-        int32_t x0, y0, x1, y1, x2, y2;
-        ndc_to_screen(ctx, clipped[0].position.x, clipped[0].position.y, &x0, &y0);
-        ndc_to_screen(ctx, clipped[j].position.x, clipped[j].position.y, &x1, &y1);
-        ndc_to_screen(ctx, clipped[j+1].position.x, clipped[j+1].position.y, &x2, &y2);
-
-        /* Backface culling - compute signed area in screen space */
-        float signed_area = (float)(x1 - x0) * (float)(y2 - y0)
-                          - (float)(x2 - x0) * (float)(y1 - y0);
-        if (should_cull(ctx, signed_area)) continue;
-
-        /* Determine if this is a back-facing triangle for two-sided lighting.
-         * In screen space with Y pointing down (flipped from NDC):
-         * negative area = CCW in original NDC, positive area = CW in original NDC */
-        int is_back_facing;
-        if (ctx->front_face == GL_CCW) {
-            is_back_facing = (signed_area >= 0);  /* CW in NDC = back facing */
-        } else {
-            is_back_facing = (signed_area < 0);   /* CCW in NDC = back facing when front is CW */
-        }
+        draw_triangle(ctx, shade, &clipped[0], &projected[0],
+                      &clipped[j], &projected[j],
+                      &clipped[j+1], &projected[j+1]);
+    }
+}
 
-        /* Get polygon mode for this face */
-        GLenum poly_mode = is_back_facing ? ctx->polygon_mode_back : ctx->polygon_mode_front;
+/* Primitive assembly: project every vertex of the current primitive once (outcode,
+ * perspective divide, screen mapping) so that strips, fans and quads do not repeat
+ * that work for shared vertices. Vertices are only marked ready in fill mode; the
+ * point/line polygon modes always go through the clipper, which hands them divided
+ * vertices. Returns NULL when out of memory. */
+static post_vertex_t *post_transform(GLState *ctx, const vertex_t *verts, size_t count)
+{
+    post_vertex_buffer_t *pb = &ctx->post_vertices;
+    if (count > pb->capacity) {
+        size_t new_capacity = pb->capacity ? pb->capacity : INITIAL_VERTEX_CAPACITY;
+        while (new_capacity < count) new_capacity *= 2;
+        post_vertex_t *new_data = mtgl_realloc(pb->data, new_capacity * sizeof(post_vertex_t));
+        if (!new_data) {
+            gl_set_error(ctx, GL_OUT_OF_MEMORY);
+            return NULL;
+        }
+        pb->data = new_data;
+        pb->capacity = new_capacity;
+    }
 
-        if (poly_mode == GL_POINT) {
-            /* Draw triangle vertices as points */
-            draw_triangle_points(ctx, &clipped[0], &clipped[j], &clipped[j+1]);
-        } else if (poly_mode == GL_LINE) {
-            /* Draw triangle edges as lines */
-            draw_triangle_wireframe(ctx, &clipped[0], &clipped[j], &clipped[j+1]);
-        } else {
-            /* GL_FILL - Use smooth shading (Gouraud) with depth, textures, fog, and perspective correction */
-            rasterize_triangle_smooth(ctx,
-                x0, y0, clipped[0].position.z, clipped[0].position.w, clipped[0].color, clipped[0].texcoord, clipped[0].eye_z,
-                x1, y1, clipped[j].position.z, clipped[j].position.w, clipped[j].color, clipped[j].texcoord, clipped[j].eye_z,
-                x2, y2, clipped[j+1].position.z, clipped[j+1].position.w, clipped[j+1].color, clipped[j+1].texcoord, clipped[j+1].eye_z,
-                clipped[0].eye_pos, clipped[0].eye_normal,
-                clipped[j].eye_pos, clipped[j].eye_normal,
-                clipped[j+1].eye_pos, clipped[j+1].eye_normal,
-                is_back_facing);
+    int fill = ctx->polygon_mode_front == GL_FILL && ctx->polygon_mode_back == GL_FILL;
+    for (size_t i = 0; i < count; i++) {
+        const vec4_t *p = &verts[i].position;
+        post_vertex_t *pv = &pb->data[i];
+        pv->outcode = compute_outcode((vec4_t *)p);
+        pv->ready = fill && pv->outcode == 0 && p->w >= 1e-6f;
+        if (pv->ready) {
+            float inv_w = 1.0f / p->w;
+            pv->ndc = vec4(p->x * inv_w, p->y * inv_w, p->z * inv_w, inv_w);
+            ndc_to_screen_fixed(ctx, pv->ndc.x, pv->ndc.y, &pv->sx, &pv->sy);
         }
     }
+    return pb->data;
+}
+
+/* Vertices in the current primitive. Indexed primitives (glDrawElements) have each
+ * vertex transformed once and list them through the element buffer. */
+static inline size_t primitive_count(GLState *ctx)
+{
+    return ctx->elements.count ? ctx->elements.count : vertex_buffer_count(ctx);
+}
+
+/* Render triangle (i0, i1, i2) of the current primitive: rejected if all vertices are
+ * outside one frustum plane, drawn from the post-transform buffer if all are inside,
+ * and clipped otherwise */
+static void render_triangle(GLState *ctx, raster_block_func_t shade, const vertex_t *verts,
+                            const post_vertex_t *pv, size_t i0, size_t i1, size_t i2)
+{
+    if (ctx->elements.count) {
+        const uint32_t *elements = ctx->elements.data;
+        i0 = elements[i0];
+        i1 = elements[i1];
+        i2 = elements[i2];
+    }
+    const post_vertex_t *p0 = &pv[i0], *p1 = &pv[i1], *p2 = &pv[i2];
+
+    if (p0->outcode & p1->outcode & p2->outcode) return;
+
+    if (p0->ready && p1->ready && p2->ready) {
+        draw_triangle(ctx, shade, &verts[i0], p0, &verts[i1], p1, &verts[i2], p2);
+    } else {
+        clip_and_draw_triangle(ctx, shade, &verts[i0], &verts[i1], &verts[i2]);
+    }
 }
 
 /* Flush GL_TRIANGLES primitive */
 void flush_triangles(GLState *ctx)
 {
+    raster_block_func_t shade = select_block_func(ctx);
     vertex_t *verts = vertex_buffer_data(ctx);
-    size_t count = vertex_buffer_count(ctx);
+    size_t count = primitive_count(ctx);
+    post_vertex_t *pv = post_transform(ctx, verts, vertex_buffer_count(ctx));
+    if (!pv) return;
 
     for (size_t i = 0; i + 2 < count; i += 3) {
-        render_triangle(ctx, &verts[i], &verts[i+1], &verts[i+2]);
+        render_triangle(ctx, shade, verts, pv, i, i+1, i+2);
     }
 }
 
 /* Flush GL_QUADS primitive (each quad split into 2 triangles) */
 void flush_quads(GLState *ctx)
 {
+    raster_block_func_t shade = select_block_func(ctx);
     vertex_t *verts = vertex_buffer_data(ctx);
-    size_t count = vertex_buffer_count(ctx);
+    size_t count = primitive_count(ctx);
+    post_vertex_t *pv = post_transform(ctx, verts, vertex_buffer_count(ctx));
+    if (!pv) return;
 
     for (size_t i = 0; i + 3 < count; i += 4) {
         /* Quad vertices: 0, 1, 2, 3
          * Triangle 1: 0, 1, 2
          * Triangle 2: 0, 2, 3
          */
-        render_triangle(ctx, &verts[i], &verts[i+1], &verts[i+2]);
-        render_triangle(ctx, &verts[i], &verts[i+2], &verts[i+3]);
+        render_triangle(ctx, shade, verts, pv, i, i+1, i+2);
+        render_triangle(ctx, shade, verts, pv, i, i+2, i+3);
     }
 }
 
 /* Flush GL_TRIANGLE_STRIP primitive */
 void flush_triangle_strip(GLState *ctx)
 {
+    raster_block_func_t shade = select_block_func(ctx);
     vertex_t *verts = vertex_buffer_data(ctx);
-    size_t count = vertex_buffer_count(ctx);
+    size_t count = primitive_count(ctx);
 
     if (count < 3) return;
+    post_vertex_t *pv = post_transform(ctx, verts, vertex_buffer_count(ctx));
+    if (!pv) return;
 
     for (size_t i = 0; i + 2 < count; i++) {
         /* Alternate winding order for each triangle */
         if (i % 2 == 0) {
-            render_triangle(ctx, &verts[i], &verts[i+1], &verts[i+2]);
+            render_triangle(ctx, shade, verts, pv, i, i+1, i+2);
         } else {
-            render_triangle(ctx, &verts[i+1], &verts[i], &verts[i+2]);
+            render_triangle(ctx, shade, verts, pv, i+1, i, i+2);
         }
     }
 }
@@ -1005,20 +1847,25 @@ void flush_triangle_strip(GLState *ctx)
 /* Flush GL_TRIANGLE_FAN primitive */
 void flush_triangle_fan(GLState *ctx)
 {
+    raster_block_func_t shade = select_block_func(ctx);
     vertex_t *verts = vertex_buffer_data(ctx);
-    size_t count = vertex_buffer_count(ctx);
+    size_t count = primitive_count(ctx);
 
     if (count < 3) return;
+    post_vertex_t *pv = post_transform(ctx, verts, vertex_buffer_count(ctx));
+    if (!pv) return;
 
     /* First vertex is the center, fan out from there */
     for (size_t i = 1; i + 1 < count; i++) {
-        render_triangle(ctx, &verts[0], &verts[i], &verts[i+1]);
+        render_triangle(ctx, shade, verts, pv, 0, i, i+1);
     }
 }
 
 /* Flush GL_POINTS primitive with support for point_size */
 void flush_points(GLState *ctx)
 {
+    tiles_sync(ctx);
+
     vertex_t *verts = vertex_buffer_data(ctx);
     size_t count = vertex_buffer_count(ctx);
     framebuffer_t *fb = &ctx->framebuffer;
@@ -1038,7 +1885,7 @@ void flush_points(GLState *ctx)
     /* Get bound texture if texturing enabled */
     texture_t *tex = NULL;
     if (texture_enabled && ctx->bound_texture_2d != 0) {
-        tex = texture_get(&ctx->textures, ctx->bound_texture_2d);
+        tex = upload_texture_get(ctx, ctx->bound_texture_2d);
     }
 
     for (size_t i = 0; i < count; i++) {
@@ -1166,6 +2013,8 @@ void flush_points(GLState *ctx)
 /* Flush GL_LINE_STRIP primitive */
 void flush_line_strip(GLState *ctx)
 {
+    tiles_sync(ctx);
+
     vertex_t *verts = vertex_buffer_data(ctx);
     size_t count = vertex_buffer_count(ctx);
 
@@ -1179,6 +2028,8 @@ void flush_line_strip(GLState *ctx)
 /* Flush GL_LINE_LOOP primitive */
 void flush_line_loop(GLState *ctx)
 {
+    tiles_sync(ctx);
+
     vertex_t *verts = vertex_buffer_data(ctx);
     size_t count = vertex_buffer_count(ctx);
 
@@ -1198,24 +2049,30 @@ void flush_line_loop(GLState *ctx)
 /* Flush GL_POLYGON primitive (same as triangle fan) */
 void flush_polygon(GLState *ctx)
 {
+    raster_block_func_t shade = select_block_func(ctx);
     vertex_t *verts = vertex_buffer_data(ctx);
-    size_t count = vertex_buffer_count(ctx);
+    size_t count = primitive_count(ctx);
 
     if (count < 3) return;
+    post_vertex_t *pv = post_transform(ctx, verts, vertex_buffer_count(ctx));
+    if (!pv) return;
 
     /* Triangulate as fan from first vertex */
     for (size_t i = 1; i + 1 < count; i++) {
-        render_triangle(ctx, &verts[0], &verts[i], &verts[i+1]);
+        render_triangle(ctx, shade, verts, pv, 0, i, i+1);
     }
 }
 
 /* Flush GL_QUAD_STRIP primitive */
 void flush_quad_strip(GLState *ctx)
 {
+    raster_block_func_t shade = select_block_func(ctx);
     vertex_t *verts = vertex_buffer_data(ctx);
-    size_t count = vertex_buffer_count(ctx);
+    size_t count = primitive_count(ctx);
 
     if (count < 4) return;
+    post_vertex_t *pv = post_transform(ctx, verts, vertex_buffer_count(ctx));
+    if (!pv) return;
 
     /* Each pair of vertices with the next pair forms a quad
      * Vertices: 0,1,2,3,4,5,...
@@ -1225,7 +2082,7 @@ void flush_quad_strip(GLState *ctx)
      */
     for (size_t i = 0; i + 3 < count; i += 2) {
         /* Split quad into two triangles with correct winding */
-        render_triangle(ctx, &verts[i], &verts[i+1], &verts[i+3]);
-        render_triangle(ctx, &verts[i], &verts[i+3], &verts[i+2]);
+        render_triangle(ctx, shade, verts, pv, i, i+1, i+3);
+        render_triangle(ctx, shade, verts, pv, i, i+3, i+2);
     }
 }
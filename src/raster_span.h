@@ -0,0 +1,131 @@
+/*
+ * MyTinyGL - OpenGL 1.x Fixed Function Pipeline
+ * raster_span.h - State-specialized triangle block loops
+ *
+ * This file is a template: it is included several times from raster.c, each
+ * time generating one block function with the same signature as shade_block().
+ * Define before inclusion:
+ *
+ *   SPAN_NAME         name of the generated function
+ *   SPAN_DEPTH        1 = depth test with ctx->depth_func, write if ctx->depth_mask
+ *   SPAN_FLAT         1 = flat shading (provoking vertex color), 0 = Gouraud
+ *   SPAN_TEX_ENV      0 = untextured, GL_MODULATE or GL_REPLACE
+ *   SPAN_BLEND_OVER   1 = blending with GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA
+ *   SPAN_COLOR_WRITE  1 = write color (all channels), 0 = depth only
+ *
+ * Everything not listed (stencil, fog, alpha test, per-fragment lighting,
+ * partial color masks) is handled by the generic shade_block() only.
+ * All macros are undefined again at the end of this file.
+ */
+
+/* Per-pixel attribute stepping; textured variants also step the span's linear u, v */
+#if SPAN_TEX_ENV
+#define SPAN_STEP (attr_step(v, t->attr_dx, SPAN_ATTRS), v[ATTR_U] += du, v[ATTR_V] += dv)
+#else
+#define SPAN_STEP attr_step(v, t->attr_dx, SPAN_ATTRS)
+#endif
+
+/* Number of leading attribute planes (see ATTR_*) this variant steps */
+#if SPAN_TEX_ENV
+#define SPAN_ATTRS (ATTR_V + 1)
+#elif SPAN_COLOR_WRITE && !SPAN_FLAT
+#define SPAN_ATTRS (ATTR_A + 1)
+#else
+#define SPAN_ATTRS (ATTR_DEPTH + 1)
+#endif
+
+static void SPAN_NAME(GLState *ctx, const triangle_setup_t *t,
+    int32_t x0, int32_t y0, int32_t x1, int32_t y1,
+    int64_t e0_row, int64_t e1_row, int64_t e2_row, int full)
+{
+    framebuffer_t *fb = &ctx->framebuffer;
+#if SPAN_DEPTH
+    const GLenum depth_func = ctx->depth_func;
+    const int depth_write = ctx->depth_mask;
+#endif
+#if SPAN_COLOR_WRITE && SPAN_FLAT && !SPAN_TEX_ENV && !SPAN_BLEND_OVER
+    const pixel_t flat_pixel = color_to_rgba32(color_clamp(t->c2));
+#endif
+    float row[ATTR_COUNT];
+    attr_eval(t, x0, y0, row);
+
+    for (int32_t y = y0; y <= y1; y++, e0_row += t->e0_dy, e1_row += t->e1_dy, e2_row += t->e2_dy) {
+        int64_t e0 = e0_row, e1 = e1_row, e2 = e2_row;
+        float v[SPAN_ATTRS];
+        for (int i = 0; i < SPAN_ATTRS; i++) {
+            v[i] = row[i];
+            row[i] += t->attr_dy[i];
+        }
+#if SPAN_TEX_ENV
+        float du = 0.0f, dv = 0.0f;
+        int divide = t->perspective == PERSPECTIVE_EXACT;
+        if (t->perspective == PERSPECTIVE_SPAN) {
+            divide = perspective_span(t, v, x0, x1, e0, e1, e2, full, &du, &dv);
+        }
+#endif
+#if SPAN_COLOR_WRITE
+        pixel_t *color_row = fb->color + (size_t)y * fb->width;
+#endif
+#if SPAN_DEPTH
+        float *depth_row = fb->depth + (size_t)y * fb->width;
+#endif
+
+        for (int32_t x = x0; x <= x1; x++, e0 += t->e0_dx, e1 += t->e1_dx, e2 += t->e2_dx,
+             SPAN_STEP) {
+            if (!full && (e0 | e1 | e2) < 0) continue;
+
+#if SPAN_DEPTH
+            float depth = v[ATTR_DEPTH];
+            if (!depth_test(depth_func, depth, depth_row[x])) continue;
+            if (depth_write) depth_row[x] = depth;
+#endif
+
+#if SPAN_COLOR_WRITE
+#if SPAN_FLAT && !SPAN_TEX_ENV && !SPAN_BLEND_OVER
+            color_row[x] = flat_pixel;
+#else
+#if SPAN_FLAT
+            color_t c = t->c2;
+#elif SPAN_TEX_ENV != GL_REPLACE
+            color_t c = color(v[ATTR_R], v[ATTR_G], v[ATTR_B], v[ATTR_A]);
+#else
+            color_t c;
+#endif
+
+#if SPAN_TEX_ENV
+            float s, tc;
+            if (divide) {
+                float w = 1.0f / v[ATTR_ONE_W];
+                s = v[ATTR_U_W] * w;
+                tc = v[ATTR_V_W] * w;
+            } else {
+                s = v[ATTR_U];
+                tc = v[ATTR_V];
+            }
+            color_t tex_color = color_from_rgba32(texture_sample_lod(t->tex, s, tc, t->tex_lod));
+#if SPAN_TEX_ENV == GL_REPLACE
+            c = tex_color;
+#else
+            c = color_mul(c, tex_color);
+#endif
+#endif /* SPAN_TEX_ENV */
+
+#if SPAN_BLEND_OVER
+            color_t dst = color_from_rgba32(color_row[x]);
+            c = color_add(color_scale(c, c.a), color_scale(dst, 1.0f - c.a));
+#endif
+            color_row[x] = color_to_rgba32(color_clamp(c));
+#endif
+#endif /* SPAN_COLOR_WRITE */
+        }
+    }
+}
+
+#undef SPAN_ATTRS
+#undef SPAN_STEP
+#undef SPAN_NAME
+#undef SPAN_DEPTH
+#undef SPAN_FLAT
+#undef SPAN_TEX_ENV
+#undef SPAN_BLEND_OVER
+#undef SPAN_COLOR_WRITE
@@ -0,0 +1,127 @@
+/*
+ * MyTinyGL - OpenGL 1.x Fixed Function Pipeline
+ * share.c - Object namespaces shared between contexts
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include "share.h"
+#include "upload.h"
+#include "allocation.h"
+#include <pthread.h>
+
+typedef struct {
+    struct share_group objects;     /* First member: contexts point here */
+    pthread_rwlock_t lock;
+    int refs;                       /* Contexts in the group and fences waiting on its uploads */
+} group_t;
+
+/* Groups this thread holds for reading, with their nesting depth (only the outermost
+ * level of each group locks). A thread can hold several groups at once, e.g. a fence
+ * wait or a shared context used during another group's draw. */
+#define SHARE_MAX_READ_GROUPS 4
+
+typedef struct {
+    group_t *group;
+    int depth;
+} read_hold_t;
+
+static THREAD_LOCAL read_hold_t read_holds[SHARE_MAX_READ_GROUPS];
+
+static inline group_t *group_of(GLState *ctx)
+{
+    return (group_t *)ctx->shared;
+}
+
+struct share_group *share_group_create(void)
+{
+    group_t *group = mtgl_calloc(1, sizeof(group_t));
+    if (!group) return NULL;
+
+    /* The default (reader-preferring on glibc) lock is required: a thread reading
+     * may wait for another reader, e.g. a full async queue for its render thread */
+    if (pthread_rwlock_init(&group->lock, NULL) != 0) {
+        mtgl_free(group);
+        return NULL;
+    }
+    texture_store_init(&group->objects.textures);
+    buffer_store_init(&group->objects.buffers);
+    list_store_init(&group->objects.lists);
+    group->refs = 1;
+    return &group->objects;
+}
+
+void share_group_retain(struct share_group *objects)
+{
+    __sync_fetch_and_add(&((group_t *)objects)->refs, 1);
+}
+
+void share_group_release(struct share_group *objects)
+{
+    group_t *group = (group_t *)objects;
+    if (!group || __sync_sub_and_fetch(&group->refs, 1) > 0) return;
+
+    upload_destroy(&group->objects);
+    list_store_free(&group->objects.lists);
+    buffer_store_free(&group->objects.buffers);
+    texture_store_free(&group->objects.textures);
+    pthread_rwlock_destroy(&group->lock);
+    mtgl_free(group);
+}
+
+/* Entry of group in this thread's read holds, or NULL */
+static read_hold_t *read_hold_find(group_t *group)
+{
+    for (int i = 0; i < SHARE_MAX_READ_GROUPS; i++) {
+        if (read_holds[i].group == group) return &read_holds[i];
+    }
+    return NULL;
+}
+
+void share_group_read_lock(struct share_group *objects)
+{
+    group_t *group = (group_t *)objects;
+    read_hold_t *hold = read_hold_find(group);
+    if (hold) {
+        hold->depth++;
+        return;
+    }
+
+    /* With no free entry the lock is taken untracked; POSIX read locks may be taken
+     * recursively, and the matching unlock finds no entry either */
+    pthread_rwlock_rdlock(&group->lock);
+    hold = read_hold_find(NULL);
+    if (hold) {
+        hold->group = group;
+        hold->depth = 1;
+    }
+}
+
+void share_group_read_unlock(struct share_group *objects)
+{
+    group_t *group = (group_t *)objects;
+    read_hold_t *hold = read_hold_find(group);
+    if (hold && --hold->depth > 0) return;
+    if (hold) hold->group = NULL;
+    pthread_rwlock_unlock(&group->lock);
+}
+
+void share_read_lock(GLState *ctx)
+{
+    share_group_read_lock(ctx->shared);
+}
+
+void share_read_unlock(GLState *ctx)
+{
+    share_group_read_unlock(ctx->shared);
+}
+
+void share_write_lock(GLState *ctx)
+{
+    pthread_rwlock_wrlock(&group_of(ctx)->lock);
+}
+
+void share_write_unlock(GLState *ctx)
+{
+    pthread_rwlock_unlock(&group_of(ctx)->lock);
+}
@@ -0,0 +1,57 @@
+/*
+ * MyTinyGL - OpenGL 1.x Software Renderer
+ * Copyright (c) 2025 zbufferoverflow (Eliezer Solinger)
+ * https://github.com/zbufferoverflow/MyTinyGL
+ * SPDX-License-Identifier: MIT
+ *
+ * share.h - Object namespaces shared between contexts
+ *
+ * Textures, buffer objects and display lists live in a share group. Every
+ * context has one; gl_create_context_shared makes a context join the group
+ * of another, and the group is freed with its last context.
+ *
+ * Contexts of a group may run on different threads. Drawing (and any other
+ * read of shared objects) holds the group's lock for reading, so draws on
+ * several threads run concurrently. Creating, deleting or modifying objects
+ * (glTexImage2D, glBufferData, glEndList, ...) takes it for writing, which
+ * waits for draws in progress on other threads and is therefore atomic with
+ * respect to them. A draw on one context sees the changes another context
+ * made before the draw is rasterized; as in OpenGL, ordering them across
+ * threads is up to the application (glFinish, fences).
+ */
+
+#ifndef MYTINYGL_SHARE_H
+#define MYTINYGL_SHARE_H
+
+#include "mytinygl.h"
+
+/* Object stores; the lock and reference count are private to share.c */
+struct share_group {
+    texture_store_t textures;
+    buffer_store_t buffers;
+    list_store_t lists;
+    struct texture_uploader *uploader;  /* Background texture uploads (NULL = synchronous) */
+};
+
+/* Group lifetime (NULL on allocation failure) */
+struct share_group *share_group_create(void);
+void share_group_retain(struct share_group *group);
+void share_group_release(struct share_group *group);
+
+/* A new context in group, retaining it, or in a new group (group = NULL); see
+ * gl_create_context_shared. Defined in gl_api.c. */
+GLState *gl_create_context_in_group(int32_t width, int32_t height, struct share_group *group);
+
+/* Read access for the calling thread; nests per group, so draws may call draws (display
+ * lists), and a thread may hold several groups at once */
+void share_read_lock(GLState *ctx);
+void share_read_unlock(GLState *ctx);
+void share_group_read_lock(struct share_group *group);
+void share_group_read_unlock(struct share_group *group);
+
+/* Exclusive access, for creating, deleting and modifying objects. Must not be taken
+ * while the calling thread holds read access to the same group. */
+void share_write_lock(GLState *ctx);
+void share_write_unlock(GLState *ctx);
+
+#endif /* MYTINYGL_SHARE_H */
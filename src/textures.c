@@ -51,6 +51,7 @@ static void texture_init_slot(texture_t *tex)
     tex->mag_filter = GL_NEAREST;
     tex->wrap_s = GL_REPEAT;
     tex->wrap_t = GL_REPEAT;
+    tex->upload_pending = 0;
     tex->allocated = 1;
 }
 
@@ -137,53 +138,62 @@ static void texture_invalidate_mipmap(texture_t *tex)
     tex->mip1_height = 0;
 }
 
-/* Upload RGBA data (no conversion needed) */
-int texture_upload_rgba(texture_t *tex, int32_t width, int32_t height, const uint8_t *data)
+/* Bytes per pixel of an upload format, 0 if unsupported */
+int32_t texture_format_size(uint32_t format)
 {
-    if (width <= 0 || height <= 0) return -1;
-    if (width > MYTGL_MAX_TEXTURE_SIZE || height > MYTGL_MAX_TEXTURE_SIZE) return -1;
-
-    size_t pixel_count = (size_t)width * (size_t)height;
-
-    /* Allocate new buffer - don't use realloc to avoid leak on failure */
-    uint32_t *new_pixels = mtgl_alloc(pixel_count * sizeof(uint32_t));
-    if (!new_pixels) return -1;
-
-    /* Free old pixels after successful allocation */
-    if (tex->pixels) {
-        mtgl_free(tex->pixels);
+    switch (format) {
+        case GL_RGBA:            return 4;
+        case GL_RGB:             return 3;
+        case GL_LUMINANCE:       return 1;
+        case GL_LUMINANCE_ALPHA: return 2;
+        default:                 return 0;
     }
+}
 
-    /* Invalidate mipmap - base texture is changing */
-    texture_invalidate_mipmap(tex);
-
-    tex->pixels = new_pixels;
-    tex->width = width;
-    tex->height = height;
+/* Convert rows [y0, y1) of tightly packed upload data to RGBA32 */
+void texture_convert_rows(uint32_t *dst, const uint8_t *src, uint32_t format, int32_t width,
+                          int32_t y0, int32_t y1)
+{
+    size_t begin = (size_t)y0 * (size_t)width;
+    size_t end = (size_t)y1 * (size_t)width;
 
-    /* Copy RGBA bytes to RGBA32 */
-    for (size_t i = 0; i < pixel_count; i++) {
-        tex->pixels[i] = rgba_bytes_to_rgba32(
-            data[i * 4 + 0],
-            data[i * 4 + 1],
-            data[i * 4 + 2],
-            data[i * 4 + 3]);
+    switch (format) {
+        case GL_RGBA:
+            for (size_t i = begin; i < end; i++) {
+                dst[i] = rgba_bytes_to_rgba32(src[i * 4 + 0], src[i * 4 + 1], src[i * 4 + 2], src[i * 4 + 3]);
+            }
+            break;
+        case GL_RGB:
+            for (size_t i = begin; i < end; i++) {
+                dst[i] = rgb_bytes_to_rgba32(src[i * 3 + 0], src[i * 3 + 1], src[i * 3 + 2]);
+            }
+            break;
+        case GL_LUMINANCE:
+            for (size_t i = begin; i < end; i++) {
+                dst[i] = luminance_to_rgba32(src[i]);
+            }
+            break;
+        case GL_LUMINANCE_ALPHA:
+            for (size_t i = begin; i < end; i++) {
+                dst[i] = luminance_alpha_to_rgba32(src[i * 2 + 0], src[i * 2 + 1]);
+            }
+            break;
     }
-
-    return 0;
 }
 
-/* Upload RGB data (convert to RGBA with alpha=255) */
-int texture_upload_rgb(texture_t *tex, int32_t width, int32_t height, const uint8_t *data)
+/* Replace level 0 with an uninitialized width x height image (mip1 is dropped) */
+int texture_storage(texture_t *tex, int32_t width, int32_t height)
 {
     if (width <= 0 || height <= 0) return -1;
     if (width > MYTGL_MAX_TEXTURE_SIZE || height > MYTGL_MAX_TEXTURE_SIZE) return -1;
 
     size_t pixel_count = (size_t)width * (size_t)height;
 
+    /* Allocate new buffer - don't use realloc to avoid leak on failure */
     uint32_t *new_pixels = mtgl_alloc(pixel_count * sizeof(uint32_t));
     if (!new_pixels) return -1;
 
+    /* Free old pixels after successful allocation */
     if (tex->pixels) {
         mtgl_free(tex->pixels);
     }
@@ -194,78 +204,38 @@ int texture_upload_rgb(texture_t *tex, int32_t width, int32_t height, const uint
     tex->pixels = new_pixels;
     tex->width = width;
     tex->height = height;
-
-    /* Convert RGB to RGBA32 */
-    for (size_t i = 0; i < pixel_count; i++) {
-        tex->pixels[i] = rgb_bytes_to_rgba32(
-            data[i * 3 + 0],
-            data[i * 3 + 1],
-            data[i * 3 + 2]);
-    }
-
     return 0;
 }
 
-/* Upload luminance data (convert to RGBA: L,L,L,255) */
-int texture_upload_luminance(texture_t *tex, int32_t width, int32_t height, const uint8_t *data)
+static int texture_upload(texture_t *tex, int32_t width, int32_t height, uint32_t format, const uint8_t *data)
 {
-    if (width <= 0 || height <= 0) return -1;
-    if (width > MYTGL_MAX_TEXTURE_SIZE || height > MYTGL_MAX_TEXTURE_SIZE) return -1;
-
-    size_t pixel_count = (size_t)width * (size_t)height;
-
-    uint32_t *new_pixels = mtgl_alloc(pixel_count * sizeof(uint32_t));
-    if (!new_pixels) return -1;
-
-    if (tex->pixels) {
-        mtgl_free(tex->pixels);
-    }
-
-    /* Invalidate mipmap - base texture is changing */
-    texture_invalidate_mipmap(tex);
+    if (texture_storage(tex, width, height) != 0) return -1;
+    texture_convert_rows(tex->pixels, data, format, width, 0, height);
+    return 0;
+}
 
-    tex->pixels = new_pixels;
-    tex->width = width;
-    tex->height = height;
+/* Upload RGBA data (no conversion needed) */
+int texture_upload_rgba(texture_t *tex, int32_t width, int32_t height, const uint8_t *data)
+{
+    return texture_upload(tex, width, height, GL_RGBA, data);
+}
 
-    /* Convert Luminance to RGBA32 */
-    for (size_t i = 0; i < pixel_count; i++) {
-        tex->pixels[i] = luminance_to_rgba32(data[i]);
-    }
+/* Upload RGB data (convert to RGBA with alpha=255) */
+int texture_upload_rgb(texture_t *tex, int32_t width, int32_t height, const uint8_t *data)
+{
+    return texture_upload(tex, width, height, GL_RGB, data);
+}
 
-    return 0;
+/* Upload luminance data (convert to RGBA: L,L,L,255) */
+int texture_upload_luminance(texture_t *tex, int32_t width, int32_t height, const uint8_t *data)
+{
+    return texture_upload(tex, width, height, GL_LUMINANCE, data);
 }
 
 /* Upload luminance+alpha data (convert to RGBA: L,L,L,A) */
 int texture_upload_luminance_alpha(texture_t *tex, int32_t width, int32_t height, const uint8_t *data)
 {
-    if (width <= 0 || height <= 0) return -1;
-    if (width > MYTGL_MAX_TEXTURE_SIZE || height > MYTGL_MAX_TEXTURE_SIZE) return -1;
-
-    size_t pixel_count = (size_t)width * (size_t)height;
-
-    uint32_t *new_pixels = mtgl_alloc(pixel_count * sizeof(uint32_t));
-    if (!new_pixels) return -1;
-
-    if (tex->pixels) {
-        mtgl_free(tex->pixels);
-    }
-
-    /* Invalidate mipmap - base texture is changing */
-    texture_invalidate_mipmap(tex);
-
-    tex->pixels = new_pixels;
-    tex->width = width;
-    tex->height = height;
-
-    /* Convert Luminance+Alpha to RGBA32 */
-    for (size_t i = 0; i < pixel_count; i++) {
-        tex->pixels[i] = luminance_alpha_to_rgba32(
-            data[i * 2 + 0],
-            data[i * 2 + 1]);
-    }
-
-    return 0;
+    return texture_upload(tex, width, height, GL_LUMINANCE_ALPHA, data);
 }
 
 /* Helper to get texel with wrapping */
@@ -306,13 +276,9 @@ static inline uint32_t bilinear_filter(uint32_t c00, uint32_t c10, uint32_t c01,
     return color_to_rgba32(result);
 }
 
-/* Generate mip level 1 (quarter resolution) lazily using box filter
- * Returns 0 on success, -1 on failure */
-static int texture_generate_mip1(texture_t *tex)
+/* Allocate mip level 1 (quarter resolution); returns 0 on success, -1 on failure */
+int texture_alloc_mip1(texture_t *tex)
 {
-    /* Already generated */
-    if (tex->mip1_pixels) return 0;
-
     /* Need base texture */
     if (!tex->pixels || tex->width < 2 || tex->height < 2) return -1;
 
@@ -326,9 +292,14 @@ static int texture_generate_mip1(texture_t *tex)
         tex->mip1_height = 0;
         return -1;
     }
+    return 0;
+}
 
+/* Box filter rows [y0, y1) of mip level 1 from level 0 */
+void texture_build_mip1_rows(texture_t *tex, int32_t y0, int32_t y1)
+{
     /* Box filter: average 2x2 blocks */
-    for (int32_t y = 0; y < tex->mip1_height; y++) {
+    for (int32_t y = y0; y < y1; y++) {
         for (int32_t x = 0; x < tex->mip1_width; x++) {
             int32_t sx = x * 2;
             int32_t sy = y * 2;
@@ -349,7 +320,17 @@ static int texture_generate_mip1(texture_t *tex)
             tex->mip1_pixels[y * tex->mip1_width + x] = color_to_rgba32(col);
         }
     }
+}
+
+/* Generate mip level 1 (quarter resolution) lazily using box filter
+ * Returns 0 on success, -1 on failure */
+int texture_generate_mip1(texture_t *tex)
+{
+    /* Already generated */
+    if (tex->mip1_pixels) return 0;
 
+    if (texture_alloc_mip1(tex) != 0) return -1;
+    texture_build_mip1_rows(tex, 0, tex->mip1_height);
     return 0;
 }
 
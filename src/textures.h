@@ -34,6 +34,9 @@ typedef struct {
     int32_t wrap_s;
     int32_t wrap_t;
 
+    /* Background upload in flight: the images are not ready (see upload.h) */
+    uint32_t upload_pending;
+
     /* Allocation tracking */
     uint8_t allocated;
 } texture_t;
@@ -60,11 +63,25 @@ int texture_upload_rgb(texture_t *tex, int32_t width, int32_t height, const uint
 int texture_upload_luminance(texture_t *tex, int32_t width, int32_t height, const uint8_t *data);
 int texture_upload_luminance_alpha(texture_t *tex, int32_t width, int32_t height, const uint8_t *data);
 
+/* Upload in steps (background uploads, see upload.h): allocate level 0, then convert
+ * tightly packed rows [y0, y1) of a GL_RGBA/RGB/LUMINANCE/LUMINANCE_ALPHA image */
+int32_t texture_format_size(uint32_t format);
+int texture_storage(texture_t *tex, int32_t width, int32_t height);
+void texture_convert_rows(uint32_t *dst, const uint8_t *src, uint32_t format, int32_t width,
+                          int32_t y0, int32_t y1);
+
 /* Texture sampling */
 uint32_t texture_sample(const texture_t *tex, float u, float v);
 uint32_t texture_sample_lod(const texture_t *tex, float u, float v, float lod);
 uint32_t texture_sample_nearest(const texture_t *tex, int32_t x, int32_t y);
 
+/* Build mip level 1 now instead of on first minified sample (returns 0 on success) */
+int texture_generate_mip1(texture_t *tex);
+
+/* Same in steps: allocate, then box filter rows [y0, y1) of mip level 1 */
+int texture_alloc_mip1(texture_t *tex);
+void texture_build_mip1_rows(texture_t *tex, int32_t y0, int32_t y1);
+
 /* Utility */
 void texture_clear(texture_t *tex);
 
@@ -0,0 +1,623 @@
+/*
+ * MyTinyGL - OpenGL 1.x Fixed Function Pipeline
+ * tiles.c - Tile-binned (sort-middle) multi-threaded rasterization
+ */
+
+#define _GNU_SOURCE
+
+#include "tiles.h"
+#include "share.h"
+#include "workers.h"
+#include "allocation.h"
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#if defined(__linux__)
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+/* Triangle queued for rasterization, with the state it was drawn with */
+typedef struct {
+    raster_triangle_t tri;
+    tile_shade_func_t shade;
+    uint32_t state;             /* Index into tile_renderer.states */
+} binned_triangle_t;
+
+/* Values of the pending clears */
+typedef struct {
+    pixel_t color;
+    float depth;
+    uint8_t stencil;
+} clear_values_t;
+
+/* Triangles overlapping one tile, in submission order */
+typedef struct {
+    uint32_t *tris;
+    uint32_t count;
+    uint32_t capacity;
+} tile_bin_t;
+
+struct tile_renderer {
+    /* Tile grid over the framebuffer */
+    int32_t tiles_x, tiles_y;
+    int32_t fb_width, fb_height;
+    tile_bin_t *bins;
+
+    /* Binned work since the last flush */
+    binned_triangle_t *tris;
+    uint32_t tri_count, tri_capacity;
+    GLState **states;           /* Render state snapshots (allocations are reused) */
+    uint32_t state_count, state_alloc, state_capacity;
+
+    /* Non-empty tiles of the current flush, most expensive first */
+    uint32_t *active;
+    uint64_t *order_keys;
+    uint32_t active_count;
+
+    /* Rasterization time of each tile (ns) the last time it had triangles */
+    uint32_t *cost;
+
+    /* Thread owning each tile with NUMA placement (NULL without) */
+    uint8_t *home;
+
+    /* Lazy clears: TILE_CLEAR_* buffers each tile still has to clear to clear_values */
+    uint8_t *cleared;
+    int clears_pending;         /* Some tile may have a bit set */
+    clear_values_t clear_values;
+    framebuffer_t *fb;          /* The context's */
+
+    struct worker_pool *workers;    /* Owned by the context */
+};
+
+/* Render state compared to decide whether a draw can share the previous snapshot:
+ * the viewport and everything from the enable flags up to the buffer bindings.
+ * Matrices, current attributes and client arrays are consumed before binning. */
+static int state_equal(const GLState *a, const GLState *b)
+{
+    const size_t vp_begin = offsetof(GLState, viewport_x);
+    const size_t vp_end = offsetof(GLState, current_color);
+    const size_t rs_begin = offsetof(GLState, flags);
+    const size_t rs_end = offsetof(GLState, bound_array_buffer);
+    return memcmp((const char *)a + vp_begin, (const char *)b + vp_begin, vp_end - vp_begin) == 0 &&
+           memcmp((const char *)a + rs_begin, (const char *)b + rs_begin, rs_end - rs_begin) == 0 &&
+           memcmp(&a->framebuffer, &b->framebuffer, sizeof(framebuffer_t)) == 0;
+}
+
+static uint64_t now_ns(void)
+{
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return (uint64_t)t.tv_sec * 1000000000ull + (uint64_t)t.tv_nsec;
+}
+
+/* Pixel rect [x0, x1) x [y0, y1) of a tile */
+static void tile_rect(const struct tile_renderer *tr, uint32_t index,
+                      int32_t *x0, int32_t *y0, int32_t *x1, int32_t *y1)
+{
+    *x0 = (int32_t)(index % (uint32_t)tr->tiles_x) << TILE_SHIFT;
+    *y0 = (int32_t)(index / (uint32_t)tr->tiles_x) << TILE_SHIFT;
+    *x1 = *x0 + TILE_SIZE < tr->fb_width ? *x0 + TILE_SIZE : tr->fb_width;
+    *y1 = *y0 + TILE_SIZE < tr->fb_height ? *y0 + TILE_SIZE : tr->fb_height;
+}
+
+static void clear_rect(struct tile_renderer *tr, unsigned buffers, const clear_values_t *values,
+                       int32_t x0, int32_t y0, int32_t x1, int32_t y1, int stream)
+{
+    if (buffers & TILE_CLEAR_COLOR) framebuffer_clear_color_rect(tr->fb, x0, y0, x1, y1, values->color, stream);
+    if (buffers & TILE_CLEAR_DEPTH) framebuffer_clear_depth_rect(tr->fb, x0, y0, x1, y1, values->depth, stream);
+    if (buffers & TILE_CLEAR_STENCIL) framebuffer_clear_stencil_rect(tr->fb, x0, y0, x1, y1, values->stencil);
+}
+
+static void write_clears(struct tile_renderer *tr, uint32_t index, unsigned buffers,
+                         const clear_values_t *values)
+{
+    int32_t x0, y0, x1, y1;
+    tile_rect(tr, index, &x0, &y0, &x1, &y1);
+    clear_rect(tr, buffers, values, x0, y0, x1, y1, 0);
+}
+
+/* Run func over tiles on the pool: on their owner thread with NUMA placement */
+static void run_tiles(struct tile_renderer *tr, worker_func_t func, void *arg,
+                      const uint32_t *tiles, uint32_t count)
+{
+    if (tr->home) {
+        worker_pool_run_homed(tr->workers, func, arg, tiles, tr->home, count, 1);
+    } else {
+        worker_pool_run_ordered(tr->workers, func, arg, tiles, count);
+    }
+}
+
+/* Rasterize the triangles of one non-empty tile (worker_func_t, item = tile index) */
+static void render_tile(void *arg, uint32_t index)
+{
+    struct tile_renderer *tr = arg;
+    const tile_bin_t *bin = &tr->bins[index];
+    int32_t tx = (int32_t)(index % (uint32_t)tr->tiles_x);
+    int32_t ty = (int32_t)(index / (uint32_t)tr->tiles_x);
+    int32_t x0 = tx << TILE_SHIFT, y0 = ty << TILE_SHIFT;
+    int32_t x1 = x0 + TILE_SIZE - 1, y1 = y0 + TILE_SIZE - 1;
+    if (x1 >= tr->fb_width) x1 = tr->fb_width - 1;
+    if (y1 >= tr->fb_height) y1 = tr->fb_height - 1;
+
+    uint64_t start = now_ns();
+    if (tr->cleared[index]) {
+        write_clears(tr, index, tr->cleared[index], &tr->clear_values);
+        tr->cleared[index] = 0;
+    }
+    for (uint32_t i = 0; i < bin->count; i++) {
+        const binned_triangle_t *bt = &tr->tris[bin->tris[i]];
+        raster_triangle_rect(tr->states[bt->state], bt->shade, &bt->tri, x0, y0, x1, y1);
+    }
+    uint64_t elapsed = now_ns() - start;
+    tr->cost[index] = elapsed < UINT32_MAX ? (uint32_t)elapsed : UINT32_MAX;
+}
+
+/* Descending; keys hold the cost above the inverted tile index */
+static int compare_keys(const void *a, const void *b)
+{
+    uint64_t ka = *(const uint64_t *)a, kb = *(const uint64_t *)b;
+    return (ka < kb) - (ka > kb);
+}
+
+int tiles_create(GLState *ctx)
+{
+    struct tile_renderer *tr = mtgl_calloc(1, sizeof(struct tile_renderer));
+    if (!tr) return -1;
+
+    tr->fb_width = ctx->framebuffer.width;
+    tr->fb_height = ctx->framebuffer.height;
+    tr->tiles_x = (tr->fb_width + TILE_SIZE - 1) >> TILE_SHIFT;
+    tr->tiles_y = (tr->fb_height + TILE_SIZE - 1) >> TILE_SHIFT;
+    size_t tile_count = (size_t)tr->tiles_x * tr->tiles_y;
+    tr->bins = mtgl_calloc(tile_count, sizeof(tile_bin_t));
+    tr->active = mtgl_alloc(tile_count * sizeof(uint32_t));
+    tr->order_keys = mtgl_alloc(tile_count * sizeof(uint64_t));
+    tr->cost = mtgl_calloc(tile_count, sizeof(uint32_t));
+    tr->cleared = mtgl_calloc(tile_count, 1);
+    if (!tr->bins || !tr->active || !tr->order_keys || !tr->cost || !tr->cleared) {
+        mtgl_free(tr->bins);
+        mtgl_free(tr->active);
+        mtgl_free(tr->order_keys);
+        mtgl_free(tr->cost);
+        mtgl_free(tr->cleared);
+        mtgl_free(tr);
+        return -1;
+    }
+
+    tr->workers = ctx->workers;
+    tr->fb = &ctx->framebuffer;
+    ctx->tiles = tr;
+    return 0;
+}
+
+void tiles_destroy(GLState *ctx)
+{
+    struct tile_renderer *tr = ctx->tiles;
+    if (!tr) return;
+
+    tiles_flush(ctx);
+    tiles_resolve(ctx);
+
+    size_t tile_count = (size_t)tr->tiles_x * tr->tiles_y;
+    for (size_t i = 0; i < tile_count; i++) {
+        mtgl_free(tr->bins[i].tris);
+    }
+    for (uint32_t i = 0; i < tr->state_alloc; i++) {
+        mtgl_free(tr->states[i]);
+    }
+    mtgl_free(tr->states);
+    mtgl_free(tr->bins);
+    mtgl_free(tr->active);
+    mtgl_free(tr->order_keys);
+    mtgl_free(tr->cost);
+    mtgl_free(tr->home);
+    mtgl_free(tr->cleared);
+    mtgl_free(tr->tris);
+    mtgl_free(tr);
+    ctx->tiles = NULL;
+}
+
+/* Index of the snapshot for the current state, taking a new one if it changed.
+ * Returns -1 when out of memory. */
+static int64_t snapshot_state(struct tile_renderer *tr, GLState *ctx)
+{
+    if (tr->state_count > 0 && state_equal(tr->states[tr->state_count - 1], ctx)) {
+        return tr->state_count - 1;
+    }
+
+    if (tr->state_count == tr->state_alloc) {
+        if (tr->state_alloc == tr->state_capacity) {
+            uint32_t new_capacity = tr->state_capacity ? tr->state_capacity * 2 : 16;
+            GLState **new_states = mtgl_realloc(tr->states, new_capacity * sizeof(GLState *));
+            if (!new_states) return -1;
+            tr->states = new_states;
+            tr->state_capacity = new_capacity;
+        }
+        tr->states[tr->state_alloc] = mtgl_alloc(sizeof(GLState));
+        if (!tr->states[tr->state_alloc]) return -1;
+        tr->state_alloc++;
+    }
+    memcpy(tr->states[tr->state_count], ctx, sizeof(GLState));
+    return tr->state_count++;
+}
+
+static int bin_push(tile_bin_t *bin, uint32_t tri)
+{
+    if (bin->count == bin->capacity) {
+        uint32_t new_capacity = bin->capacity ? bin->capacity * 2 : 64;
+        uint32_t *new_tris = mtgl_realloc(bin->tris, new_capacity * sizeof(uint32_t));
+        if (!new_tris) return -1;
+        bin->tris = new_tris;
+        bin->capacity = new_capacity;
+    }
+    bin->tris[bin->count++] = tri;
+    return 0;
+}
+
+void tiles_bin_triangle(GLState *ctx, tile_shade_func_t shade, const raster_triangle_t *tri)
+{
+    struct tile_renderer *tr = ctx->tiles;
+
+    /* Tile range from the pixel bounding box, limited to the viewport and scissor box */
+    int32_t fminX = tri->v[0].x, fmaxX = tri->v[0].x, fminY = tri->v[0].y, fmaxY = tri->v[0].y;
+    for (int i = 1; i < 3; i++) {
+        if (tri->v[i].x < fminX) fminX = tri->v[i].x;
+        if (tri->v[i].x > fmaxX) fmaxX = tri->v[i].x;
+        if (tri->v[i].y < fminY) fminY = tri->v[i].y;
+        if (tri->v[i].y > fmaxY) fmaxY = tri->v[i].y;
+    }
+    int32_t minX = (fminX - SUBPIXEL_HALF + SUBPIXEL_ONE - 1) >> SUBPIXEL_BITS;
+    int32_t minY = (fminY - SUBPIXEL_HALF + SUBPIXEL_ONE - 1) >> SUBPIXEL_BITS;
+    int32_t maxX = (fmaxX - SUBPIXEL_HALF) >> SUBPIXEL_BITS;
+    int32_t maxY = (fmaxY - SUBPIXEL_HALF) >> SUBPIXEL_BITS;
+    if (minX < ctx->viewport_x) minX = ctx->viewport_x;
+    if (minY < ctx->viewport_y) minY = ctx->viewport_y;
+    if (maxX >= ctx->viewport_x + ctx->viewport_w) maxX = ctx->viewport_x + ctx->viewport_w - 1;
+    if (maxY >= ctx->viewport_y + ctx->viewport_h) maxY = ctx->viewport_y + ctx->viewport_h - 1;
+    if (ctx->flags & FLAG_SCISSOR_TEST) {
+        if (minX < ctx->scissor_x) minX = ctx->scissor_x;
+        if (minY < ctx->scissor_y) minY = ctx->scissor_y;
+        if (maxX >= ctx->scissor_x + (int32_t)ctx->scissor_w) maxX = ctx->scissor_x + ctx->scissor_w - 1;
+        if (maxY >= ctx->scissor_y + (int32_t)ctx->scissor_h) maxY = ctx->scissor_y + ctx->scissor_h - 1;
+    }
+    if (minX < 0) minX = 0;
+    if (minY < 0) minY = 0;
+    if (maxX >= tr->fb_width) maxX = tr->fb_width - 1;
+    if (maxY >= tr->fb_height) maxY = tr->fb_height - 1;
+    if (minX > maxX || minY > maxY) return;
+
+    if (tr->tri_count >= TILES_MAX_TRIANGLES) tiles_flush(ctx);
+
+    int64_t state = snapshot_state(tr, ctx);
+    if (state < 0) goto immediate;
+
+    if (tr->tri_count == tr->tri_capacity) {
+        uint32_t new_capacity = tr->tri_capacity ? tr->tri_capacity * 2 : 1024;
+        binned_triangle_t *new_tris = mtgl_realloc(tr->tris, new_capacity * sizeof(binned_triangle_t));
+        if (!new_tris) goto immediate;
+        tr->tris = new_tris;
+        tr->tri_capacity = new_capacity;
+    }
+
+    uint32_t index = tr->tri_count;
+    for (int32_t ty = minY >> TILE_SHIFT; ty <= maxY >> TILE_SHIFT; ty++) {
+        for (int32_t tx = minX >> TILE_SHIFT; tx <= maxX >> TILE_SHIFT; tx++) {
+            if (bin_push(&tr->bins[ty * tr->tiles_x + tx], index) < 0) {
+                /* Out of memory: drop the partial binning and draw right away */
+                for (int32_t uy = minY >> TILE_SHIFT; uy <= maxY >> TILE_SHIFT; uy++) {
+                    for (int32_t ux = minX >> TILE_SHIFT; ux <= maxX >> TILE_SHIFT; ux++) {
+                        tile_bin_t *bin = &tr->bins[uy * tr->tiles_x + ux];
+                        if (bin->count > 0 && bin->tris[bin->count - 1] == index) bin->count--;
+                    }
+                }
+                goto immediate;
+            }
+        }
+    }
+    tr->tris[index].tri = *tri;
+    tr->tris[index].shade = shade;
+    tr->tris[index].state = (uint32_t)state;
+    tr->tri_count++;
+    return;
+
+immediate:
+    gl_set_error(ctx, GL_OUT_OF_MEMORY);
+    tiles_flush(ctx);
+    tiles_resolve(ctx);
+    raster_triangle_rect(ctx, shade, tri, 0, 0, tr->fb_width - 1, tr->fb_height - 1);
+}
+
+void tiles_flush(GLState *ctx)
+{
+    struct tile_renderer *tr = ctx->tiles;
+    if (!tr || tr->tri_count == 0) return;
+
+    /* Start the tiles that were the most expensive last time first, so a slow tile
+     * does not begin when the others are done; cheap tiles fill the gaps (stolen) */
+    size_t tile_count = (size_t)tr->tiles_x * tr->tiles_y;
+    tr->active_count = 0;
+    for (size_t i = 0; i < tile_count; i++) {
+        if (tr->bins[i].count > 0) {
+            tr->order_keys[tr->active_count++] = ((uint64_t)tr->cost[i] << 32) | (UINT32_MAX - (uint32_t)i);
+        }
+    }
+    qsort(tr->order_keys, tr->active_count, sizeof(uint64_t), compare_keys);
+    for (uint32_t i = 0; i < tr->active_count; i++) {
+        tr->active[i] = UINT32_MAX - (uint32_t)tr->order_keys[i];
+    }
+    share_read_lock(ctx);
+    run_tiles(tr, render_tile, tr, tr->active, tr->active_count);
+    share_read_unlock(ctx);
+
+    for (uint32_t i = 0; i < tr->active_count; i++) {
+        tr->bins[tr->active[i]].count = 0;
+    }
+    tr->tri_count = 0;
+    tr->state_count = 0;
+}
+
+/* Large framebuffers are cleared around the cache */
+static int stream_clears(const struct tile_renderer *tr)
+{
+    return (size_t)tr->fb_width * tr->fb_height * sizeof(pixel_t) >= FB_STREAM_CLEAR_BYTES;
+}
+
+/* Write the pending clears of one row of tiles (worker_func_t, item = index of its first
+ * tile). Runs of tiles are cleared row by row of pixels: going tile by tile would touch
+ * a page per pixel row and tile. */
+static void resolve_row(void *arg, uint32_t first)
+{
+    struct tile_renderer *tr = arg;
+    uint8_t *cleared = tr->cleared + first;
+    int32_t y0 = (int32_t)(first / (uint32_t)tr->tiles_x) << TILE_SHIFT;
+    int32_t y1 = y0 + TILE_SIZE < tr->fb_height ? y0 + TILE_SIZE : tr->fb_height;
+
+    for (unsigned buffer = TILE_CLEAR_COLOR; buffer <= TILE_CLEAR_STENCIL; buffer <<= 1) {
+        int32_t tx = 0;
+        while (tx < tr->tiles_x) {
+            if (!(cleared[tx] & buffer)) {
+                tx++;
+                continue;
+            }
+            int32_t start = tx;
+            while (tx < tr->tiles_x && (cleared[tx] & buffer)) tx++;
+            int32_t x1 = tx << TILE_SHIFT < tr->fb_width ? tx << TILE_SHIFT : tr->fb_width;
+            clear_rect(tr, buffer, &tr->clear_values, start << TILE_SHIFT, y0, x1, y1, stream_clears(tr));
+        }
+    }
+    memset(cleared, 0, (size_t)tr->tiles_x);
+}
+
+void tiles_resolve(GLState *ctx)
+{
+    struct tile_renderer *tr = ctx->tiles;
+    if (!tr || !tr->clears_pending) return;
+
+    uint32_t count = 0;
+    for (int32_t ty = 0; ty < tr->tiles_y; ty++) {
+        uint32_t first = (uint32_t)(ty * tr->tiles_x);
+        for (int32_t tx = 0; tx < tr->tiles_x; tx++) {
+            if (tr->cleared[first + tx]) {
+                tr->active[count++] = first;
+                break;
+            }
+        }
+    }
+    run_tiles(tr, resolve_row, tr, tr->active, count);
+    tr->clears_pending = 0;
+}
+
+/* A glClear being applied to the tiles */
+typedef struct {
+    struct tile_renderer *tr;
+    unsigned buffers;
+    unsigned changed;           /* Buffers whose pending clears had other values */
+    clear_values_t values;
+    int32_t x0, y0, x1, y1;
+} clear_job_t;
+
+static int tile_covered(const clear_job_t *job, uint32_t index)
+{
+    int32_t x0, y0, x1, y1;
+    tile_rect(job->tr, index, &x0, &y0, &x1, &y1);
+    return x0 >= job->x0 && y0 >= job->y0 && x1 <= job->x1 && y1 <= job->y1;
+}
+
+/* Tile not covered by the clear (worker_func_t): write its pending clears of the old
+ * values, then clear its part of the rect */
+static void clear_tile(void *arg, uint32_t index)
+{
+    clear_job_t *job = arg;
+    struct tile_renderer *tr = job->tr;
+    unsigned old = tr->cleared[index] & job->changed;
+    if (old) {
+        write_clears(tr, index, old, &tr->clear_values);
+        tr->cleared[index] &= (uint8_t)~old;
+    }
+
+    int32_t x0, y0, x1, y1;
+    tile_rect(tr, index, &x0, &y0, &x1, &y1);
+    if (x0 < job->x0) x0 = job->x0;
+    if (y0 < job->y0) y0 = job->y0;
+    if (x1 > job->x1) x1 = job->x1;
+    if (y1 > job->y1) y1 = job->y1;
+    if (x0 >= x1 || y0 >= y1) return;
+
+    /* A pending clear of the same value already covers the rect */
+    clear_rect(tr, job->buffers & ~tr->cleared[index], &job->values, x0, y0, x1, y1, 0);
+}
+
+void tiles_clear(GLState *ctx, unsigned buffers, int32_t x0, int32_t y0, int32_t x1, int32_t y1)
+{
+    struct tile_renderer *tr = ctx->tiles;
+
+    /* Triangles binned so far are drawn before the clear */
+    tiles_flush(ctx);
+    if (buffers == 0 || x0 >= x1 || y0 >= y1) return;
+
+    clear_job_t job = { tr, buffers, 0, { color_to_rgba32(ctx->clear_color), (float)ctx->clear_depth,
+                                          (uint8_t)(ctx->stencil_clear & 0xFF) }, x0, y0, x1, y1 };
+    if (tr->clears_pending) {
+        if (job.values.color != tr->clear_values.color) job.changed |= TILE_CLEAR_COLOR;
+        if (memcmp(&job.values.depth, &tr->clear_values.depth, sizeof(float)) != 0) job.changed |= TILE_CLEAR_DEPTH;
+        if (job.values.stencil != tr->clear_values.stencil) job.changed |= TILE_CLEAR_STENCIL;
+        job.changed &= buffers;
+    }
+
+    /* Tiles the rect covers just take the new clear; the others are visited if they
+     * overlap the rect or hold a pending clear it changes */
+    int32_t tx0 = x0 >> TILE_SHIFT, ty0 = y0 >> TILE_SHIFT;
+    int32_t tx1 = (x1 - 1) >> TILE_SHIFT, ty1 = (y1 - 1) >> TILE_SHIFT;
+    size_t tile_count = (size_t)tr->tiles_x * tr->tiles_y;
+    uint32_t count = 0;
+    for (size_t i = 0; i < tile_count; i++) {
+        int32_t tx = (int32_t)(i % (size_t)tr->tiles_x), ty = (int32_t)(i / (size_t)tr->tiles_x);
+        int overlaps = tx >= tx0 && tx <= tx1 && ty >= ty0 && ty <= ty1;
+        if (overlaps && tile_covered(&job, (uint32_t)i)) continue;
+        if (overlaps || (tr->cleared[i] & job.changed)) tr->active[count++] = (uint32_t)i;
+    }
+    run_tiles(tr, clear_tile, &job, tr->active, count);
+
+    if (buffers & TILE_CLEAR_COLOR) tr->clear_values.color = job.values.color;
+    if (buffers & TILE_CLEAR_DEPTH) tr->clear_values.depth = job.values.depth;
+    if (buffers & TILE_CLEAR_STENCIL) tr->clear_values.stencil = job.values.stencil;
+    for (int32_t ty = ty0; ty <= ty1; ty++) {
+        for (int32_t tx = tx0; tx <= tx1; tx++) {
+            uint32_t index = (uint32_t)(ty * tr->tiles_x + tx);
+            if (tile_covered(&job, index)) {
+                tr->cleared[index] |= (uint8_t)buffers;
+                tr->clears_pending = 1;
+            }
+        }
+    }
+}
+
+/* Framebuffer contents saved while their pages are moved */
+typedef struct {
+    struct tile_renderer *tr;
+    framebuffer_t *fb;
+    const pixel_t *color;
+    const float *depth;
+    const uint8_t *stencil;
+    const float *hiz;
+} placement_t;
+
+/* Write back the rows of one tile: the first touch of released pages puts them on the
+ * node of the thread doing it (worker_func_t, item = tile index) */
+static void place_tile(void *arg, uint32_t index)
+{
+    placement_t *p = arg;
+    framebuffer_t *fb = p->fb;
+    int32_t x0 = (int32_t)(index % (uint32_t)p->tr->tiles_x) << TILE_SHIFT;
+    int32_t y0 = (int32_t)(index / (uint32_t)p->tr->tiles_x) << TILE_SHIFT;
+    int32_t x1 = x0 + TILE_SIZE < fb->width ? x0 + TILE_SIZE : fb->width;
+    int32_t y1 = y0 + TILE_SIZE < fb->height ? y0 + TILE_SIZE : fb->height;
+    size_t w = (size_t)(x1 - x0);
+
+    for (int32_t y = y0; y < y1; y++) {
+        size_t at = (size_t)y * fb->width + x0;
+        memcpy(fb->color + at, p->color + at, w * sizeof(pixel_t));
+        memcpy(fb->depth + at, p->depth + at, w * sizeof(float));
+        memcpy(fb->stencil + at, p->stencil + at, w);
+    }
+    for (int32_t y = y0 >> FB_HIZ_TILE_SHIFT; y < (y1 + FB_HIZ_TILE_SIZE - 1) >> FB_HIZ_TILE_SHIFT; y++) {
+        size_t at = (size_t)y * fb->hiz_width + (x0 >> FB_HIZ_TILE_SHIFT);
+        size_t hw = (size_t)((x1 + FB_HIZ_TILE_SIZE - 1) >> FB_HIZ_TILE_SHIFT) - (x0 >> FB_HIZ_TILE_SHIFT);
+        memcpy(fb->hiz + at, p->hiz + at, hw * sizeof(float));
+    }
+}
+
+/* Return the whole pages of a buffer to the kernel; the next touch allocates them again */
+static void release_pages(void *buffer, size_t size)
+{
+#if defined(__linux__)
+    uintptr_t page = (uintptr_t)sysconf(_SC_PAGESIZE);
+    uintptr_t begin = ((uintptr_t)buffer + page - 1) & ~(page - 1);
+    uintptr_t end = ((uintptr_t)buffer + size) & ~(page - 1);
+    if (end > begin) madvise((void *)begin, end - begin, MADV_DONTNEED);
+#else
+    (void)buffer;
+    (void)size;
+#endif
+}
+
+static void *save_buffer(const void *buffer, size_t size)
+{
+    void *copy = mtgl_alloc(size);
+    if (copy) memcpy(copy, buffer, size);
+    return copy;
+}
+
+int tiles_place_framebuffer(GLState *ctx)
+{
+    struct tile_renderer *tr = ctx->tiles;
+    if (!tr || !tr->home) return -1;
+    tiles_flush(ctx);
+
+    framebuffer_t *fb = &ctx->framebuffer;
+    size_t pixels = (size_t)fb->width * fb->height;
+    size_t hiz_size = (size_t)fb->hiz_width * fb->hiz_height * sizeof(float);
+    placement_t p = { tr, fb, save_buffer(fb->color, pixels * sizeof(pixel_t)),
+                      save_buffer(fb->depth, pixels * sizeof(float)),
+                      save_buffer(fb->stencil, pixels), save_buffer(fb->hiz, hiz_size) };
+    int result = -1;
+    if (p.color && p.depth && p.stencil && p.hiz) {
+        release_pages(fb->color, pixels * sizeof(pixel_t));
+        release_pages(fb->depth, pixels * sizeof(float));
+        release_pages(fb->stencil, pixels);
+        release_pages(fb->hiz, hiz_size);
+        worker_pool_run_homed(tr->workers, place_tile, &p, NULL, tr->home,
+                              (uint32_t)tr->tiles_x * tr->tiles_y, 0);
+        result = 0;
+    }
+    mtgl_free((void *)p.color);
+    mtgl_free((void *)p.depth);
+    mtgl_free((void *)p.stencil);
+    mtgl_free((void *)p.hiz);
+    return result;
+}
+
+int tiles_set_numa(GLState *ctx, int enabled)
+{
+    struct tile_renderer *tr = ctx->tiles;
+    if (!tr) return -1;
+    tiles_flush(ctx);
+    mtgl_free(tr->home);
+    tr->home = NULL;
+    if (!enabled) return 0;
+
+    /* Nodes that have workers, each with its threads */
+    int threads = worker_pool_threads(tr->workers);
+    int nodes[WORKERS_MAX_THREADS];
+    int node_threads[WORKERS_MAX_THREADS][WORKERS_MAX_THREADS];
+    int node_sizes[WORKERS_MAX_THREADS];
+    int node_count = 0;
+    for (int t = 1; t < threads; t++) {
+        int node = worker_pool_thread_node(tr->workers, t);
+        if (node < 0) continue;
+        int n = 0;
+        while (n < node_count && nodes[n] != node) n++;
+        if (n == node_count) {
+            nodes[node_count] = node;
+            node_sizes[node_count++] = 0;
+        }
+        node_threads[n][node_sizes[n]++] = t;
+    }
+    if (node_count == 0) return -1;
+
+    size_t tile_count = (size_t)tr->tiles_x * tr->tiles_y;
+    tr->home = mtgl_alloc(tile_count);
+    if (!tr->home) return -1;
+
+    /* Each node owns a band of tile rows, so its pages are contiguous in every buffer;
+     * the node's threads take the tiles of a row in turn */
+    for (int32_t ty = 0; ty < tr->tiles_y; ty++) {
+        int n = (int)((int64_t)ty * node_count / tr->tiles_y);
+        for (int32_t tx = 0; tx < tr->tiles_x; tx++) {
+            tr->home[ty * tr->tiles_x + tx] = (uint8_t)node_threads[n][(tx + ty) % node_sizes[n]];
+        }
+    }
+    return tiles_place_framebuffer(ctx);
+}
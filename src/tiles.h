@@ -0,0 +1,110 @@
+/*
+ * MyTinyGL - OpenGL 1.x Software Renderer
+ * Copyright (c) 2025 zbufferoverflow (Eliezer Solinger)
+ * https://github.com/zbufferoverflow/MyTinyGL
+ * SPDX-License-Identifier: MIT
+ *
+ * tiles.h - Tile-binned (sort-middle) multi-threaded rasterization
+ *
+ * When a context has render threads (gl_set_render_threads), filled triangles
+ * are not rasterized immediately: primitive assembly appends them, together
+ * with a snapshot of the render state, to per-tile bins. At a sync point
+ * (glFinish, glFlush, glReadPixels, glClear, texture changes, ...) the context's
+ * worker pool (workers.h) rasterizes the tiles in parallel, each tile replaying its triangles in
+ * submission order, so the result is identical to immediate rendering. Tiles
+ * are started by decreasing rasterization time at their previous flush, and
+ * threads that run out of tiles steal from the others. With NUMA placement
+ * each tile has a fixed owner thread whose node holds the tile's pages.
+ *
+ * glClear is lazy: tiles it covers are only marked in a side table, and the
+ * clear values are written by the thread that next rasterizes the tile, just
+ * before its triangles, or at a sync point that reads the framebuffer.
+ */
+
+#ifndef MYTINYGL_TILES_H
+#define MYTINYGL_TILES_H
+
+#include "mytinygl.h"
+
+/* Screen tile size; a multiple of the rasterizer block size */
+#define TILE_SHIFT 6
+#define TILE_SIZE  (1 << TILE_SHIFT)
+
+/* Binned triangles before an automatic flush */
+#define TILES_MAX_TRIANGLES (1 << 18)
+
+/* Triangle vertex as handed from primitive assembly to the rasterizer */
+typedef struct {
+    int32_t x, y;           /* 28.4 fixed-point window position */
+    float z;                /* NDC depth */
+    float w_inv;            /* 1/w */
+    color_t color;
+    vec2_t texcoord;
+    float eye_z;            /* Fog coordinate */
+    vec3_t eye_pos;         /* Per-fragment lighting inputs */
+    vec3_t eye_normal;
+} raster_vertex_t;
+
+typedef struct {
+    raster_vertex_t v[3];
+    int is_back_facing;
+} raster_triangle_t;
+
+/* Block shading function chosen for a draw, stored opaquely with binned triangles */
+typedef void (*tile_shade_func_t)(void);
+
+/* Rasterize tri with the given state and shading function, touching only pixels in
+ * [x0, x1] x [y0, y1] (raster.c) */
+void raster_triangle_rect(GLState *state, tile_shade_func_t shade, const raster_triangle_t *tri,
+                          int32_t x0, int32_t y0, int32_t x1, int32_t y1);
+
+/* Renderer lifetime; rasterizes on ctx->workers (see gl_set_render_threads) */
+int tiles_create(GLState *ctx);
+void tiles_destroy(GLState *ctx);
+
+/* NUMA placement (after worker_pool_set_numa on ctx->workers): every tile gets a fixed
+ * owner thread, a band of tile rows per node, and the framebuffer pages are moved to
+ * their owner's node. 0 restores dealing by cost. Returns 0 on success. */
+int tiles_set_numa(GLState *ctx, int enabled);
+
+/* Move the framebuffer pages of each tile to its owner's node again, e.g. after the
+ * color buffer was replaced. Returns 0 on success, -1 without NUMA placement. */
+int tiles_place_framebuffer(GLState *ctx);
+
+/* Queue a filled triangle drawn with the current state */
+void tiles_bin_triangle(GLState *ctx, tile_shade_func_t shade, const raster_triangle_t *tri);
+
+/* Buffers of a lazy clear */
+#define TILE_CLEAR_COLOR   0x1
+#define TILE_CLEAR_DEPTH   0x2
+#define TILE_CLEAR_STENCIL 0x4
+
+/* Clear the TILE_CLEAR_* buffers in [x0, x1) x [y0, y1) (clamped to the framebuffer) to
+ * the context's clear values. Tiles inside the rect only record the clear, which is
+ * written when the tile is next rasterized or by tiles_resolve; the edges of the rect
+ * are cleared on the worker pool. */
+void tiles_clear(GLState *ctx, unsigned buffers, int32_t x0, int32_t y0, int32_t x1, int32_t y1);
+
+/* Rasterize everything binned so far and wait for completion */
+void tiles_flush(GLState *ctx);
+
+/* Write the clears still pending in tiles */
+void tiles_resolve(GLState *ctx);
+
+/* Sync point: make the framebuffer and textures consistent with all previous commands */
+static inline void tiles_sync(GLState *ctx)
+{
+    if (ctx->tiles) {
+        tiles_flush(ctx);
+        tiles_resolve(ctx);
+    }
+}
+
+/* Sync point for texture and buffer changes: binned triangles are rasterized, clears
+ * may stay pending */
+static inline void tiles_sync_objects(GLState *ctx)
+{
+    if (ctx->tiles) tiles_flush(ctx);
+}
+
+#endif /* MYTINYGL_TILES_H */
@@ -0,0 +1,246 @@
+/*
+ * MyTinyGL - OpenGL 1.x Fixed Function Pipeline
+ * upload.c - Background texture uploads
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include "upload.h"
+#include "workers.h"
+#include "allocation.h"
+#include <pthread.h>
+#include <time.h>
+
+typedef struct upload_job {
+    texture_t *tex;
+    uint8_t *staging;
+    uint32_t format;
+    uint64_t seq;
+    struct upload_job *next;
+} upload_job_t;
+
+struct texture_uploader {
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t submitted_cond;  /* Upload thread: a job is queued */
+    pthread_cond_t completed_cond;  /* Waiters: a job completed */
+    struct worker_pool *workers;    /* Conversion and mip generation */
+
+    upload_job_t *head;         /* Oldest job, stays queued while it runs */
+    upload_job_t *tail;
+    int pending;
+    int reserved;               /* Slots reserved by upload_reserve, not submitted yet */
+    int shutdown;
+    uint64_t id;
+};
+
+/* Upload numbers are global so fences stay valid across upload thread restarts */
+static uint64_t upload_sequence = 0;
+
+/* Uploader numbers, so a reservation can tell its uploader was replaced */
+static uint64_t uploader_sequence = 0;
+
+static void convert_chunk(void *arg, uint32_t item)
+{
+    upload_job_t *job = arg;
+    texture_t *tex = job->tex;
+    int32_t y0 = (int32_t)item * UPLOAD_CHUNK_ROWS;
+    int32_t y1 = y0 + UPLOAD_CHUNK_ROWS < tex->height ? y0 + UPLOAD_CHUNK_ROWS : tex->height;
+    texture_convert_rows(tex->pixels, job->staging, job->format, tex->width, y0, y1);
+}
+
+static void mip1_chunk(void *arg, uint32_t item)
+{
+    upload_job_t *job = arg;
+    texture_t *tex = job->tex;
+    int32_t y0 = (int32_t)item * UPLOAD_CHUNK_ROWS;
+    int32_t y1 = y0 + UPLOAD_CHUNK_ROWS < tex->mip1_height ? y0 + UPLOAD_CHUNK_ROWS : tex->mip1_height;
+    texture_build_mip1_rows(tex, y0, y1);
+}
+
+static uint32_t chunks(int32_t rows)
+{
+    return (uint32_t)((rows + UPLOAD_CHUNK_ROWS - 1) / UPLOAD_CHUNK_ROWS);
+}
+
+static void *upload_thread(void *arg)
+{
+    struct texture_uploader *u = arg;
+
+    pthread_mutex_lock(&u->lock);
+    for (;;) {
+        while (!u->head && !u->shutdown) {
+            pthread_cond_wait(&u->submitted_cond, &u->lock);
+        }
+        if (!u->head) break;
+        upload_job_t *job = u->head;
+        pthread_mutex_unlock(&u->lock);
+
+        /* Mip level 1 is built whatever the filter: it is cheap here and saves
+         * building it under the share group lock when a mipmap filter is set later */
+        texture_t *tex = job->tex;
+        worker_pool_run(u->workers, convert_chunk, job, chunks(tex->height));
+        mtgl_free(job->staging);
+        if (texture_alloc_mip1(tex) == 0) {
+            worker_pool_run(u->workers, mip1_chunk, job, chunks(tex->mip1_height));
+        }
+
+        pthread_mutex_lock(&u->lock);
+        __atomic_store_n(&tex->upload_pending, 0, __ATOMIC_RELEASE);
+        u->head = job->next;
+        if (!u->head) u->tail = NULL;
+        u->pending--;
+        mtgl_free(job);
+        pthread_cond_broadcast(&u->completed_cond);
+    }
+    pthread_mutex_unlock(&u->lock);
+    return NULL;
+}
+
+int upload_create(struct share_group *group, int threads)
+{
+    struct texture_uploader *u = mtgl_calloc(1, sizeof(struct texture_uploader));
+    if (!u) return -1;
+
+    u->workers = worker_pool_create(threads);
+    if (!u->workers) {
+        mtgl_free(u);
+        return -1;
+    }
+    pthread_mutex_init(&u->lock, NULL);
+    pthread_cond_init(&u->submitted_cond, NULL);
+    pthread_cond_init(&u->completed_cond, NULL);
+    if (pthread_create(&u->thread, NULL, upload_thread, u) != 0) {
+        pthread_mutex_destroy(&u->lock);
+        pthread_cond_destroy(&u->submitted_cond);
+        pthread_cond_destroy(&u->completed_cond);
+        worker_pool_destroy(u->workers);
+        mtgl_free(u);
+        return -1;
+    }
+
+    u->id = __sync_add_and_fetch(&uploader_sequence, 1);
+    group->uploader = u;
+    return 0;
+}
+
+void upload_destroy(struct share_group *group)
+{
+    struct texture_uploader *u = group->uploader;
+    if (!u) return;
+
+    pthread_mutex_lock(&u->lock);
+    u->shutdown = 1;
+    pthread_cond_signal(&u->submitted_cond);
+    pthread_mutex_unlock(&u->lock);
+    pthread_join(u->thread, NULL);
+
+    pthread_mutex_destroy(&u->lock);
+    pthread_cond_destroy(&u->submitted_cond);
+    pthread_cond_destroy(&u->completed_cond);
+    worker_pool_destroy(u->workers);
+    mtgl_free(u);
+    group->uploader = NULL;
+}
+
+uint64_t upload_reserve(struct texture_uploader *u)
+{
+    pthread_mutex_lock(&u->lock);
+    while (u->pending + u->reserved >= UPLOAD_MAX_PENDING) {
+        pthread_cond_wait(&u->completed_cond, &u->lock);
+    }
+    u->reserved++;
+    pthread_mutex_unlock(&u->lock);
+    return u->id;
+}
+
+int upload_reserved(const struct texture_uploader *u, uint64_t id)
+{
+    return u && u->id == id;
+}
+
+void upload_cancel(struct texture_uploader *u)
+{
+    pthread_mutex_lock(&u->lock);
+    u->reserved--;
+    pthread_cond_broadcast(&u->completed_cond);
+    pthread_mutex_unlock(&u->lock);
+}
+
+int upload_submit(struct texture_uploader *u, texture_t *tex, uint8_t *staging, uint32_t format)
+{
+    upload_job_t *job = mtgl_alloc(sizeof(upload_job_t));
+    if (!job) {
+        upload_cancel(u);
+        return -1;
+    }
+    job->tex = tex;
+    job->staging = staging;
+    job->format = format;
+    job->next = NULL;
+    __atomic_store_n(&tex->upload_pending, 1, __ATOMIC_RELAXED);
+
+    pthread_mutex_lock(&u->lock);
+    u->reserved--;
+    job->seq = __sync_add_and_fetch(&upload_sequence, 1);
+    if (u->tail) {
+        u->tail->next = job;
+    } else {
+        u->head = job;
+    }
+    u->tail = job;
+    u->pending++;
+    pthread_cond_signal(&u->submitted_cond);
+    pthread_mutex_unlock(&u->lock);
+    return 0;
+}
+
+uint64_t upload_last(void)
+{
+    return __atomic_load_n(&upload_sequence, __ATOMIC_ACQUIRE);
+}
+
+int upload_wait(struct texture_uploader *u, uint64_t seq, uint64_t timeout_ns)
+{
+    if (!u || seq == 0) return 1;
+
+    /* Jobs complete in order: done once the oldest queued one is newer than seq */
+    pthread_mutex_lock(&u->lock);
+    if (u->head && u->head->seq <= seq && timeout_ns > 0) {
+        struct timespec deadline;
+        clock_gettime(CLOCK_REALTIME, &deadline);
+        /* Clamp so very long timeouts (GL_TIMEOUT_IGNORED) cannot overflow */
+        uint64_t max_wait = (uint64_t)365 * 24 * 3600 * 1000000000ull;
+        if (timeout_ns > max_wait) timeout_ns = max_wait;
+        uint64_t nsec = (uint64_t)deadline.tv_nsec + timeout_ns % 1000000000ull;
+        deadline.tv_sec += (time_t)(timeout_ns / 1000000000ull + nsec / 1000000000ull);
+        deadline.tv_nsec = (long)(nsec % 1000000000ull);
+
+        while (u->head && u->head->seq <= seq) {
+            if (pthread_cond_timedwait(&u->completed_cond, &u->lock, &deadline) != 0) break;
+        }
+    }
+    int done = !u->head || u->head->seq > seq;
+    pthread_mutex_unlock(&u->lock);
+    return done;
+}
+
+void upload_wait_texture(struct texture_uploader *u, texture_t *tex)
+{
+    if (!u) return;
+    pthread_mutex_lock(&u->lock);
+    while (!upload_ready(tex)) {
+        pthread_cond_wait(&u->completed_cond, &u->lock);
+    }
+    pthread_mutex_unlock(&u->lock);
+}
+
+void upload_finish(struct texture_uploader *u)
+{
+    if (!u) return;
+    pthread_mutex_lock(&u->lock);
+    while (u->head) {
+        pthread_cond_wait(&u->completed_cond, &u->lock);
+    }
+    pthread_mutex_unlock(&u->lock);
+}
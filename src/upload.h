@@ -0,0 +1,81 @@
+/*
+ * MyTinyGL - OpenGL 1.x Software Renderer
+ * Copyright (c) 2025 zbufferoverflow (Eliezer Solinger)
+ * https://github.com/zbufferoverflow/MyTinyGL
+ * SPDX-License-Identifier: MIT
+ *
+ * upload.h - Background texture uploads
+ *
+ * With gl_set_texture_upload_threads, glTexImage2D only copies the client
+ * image and returns: an upload thread of the share group converts it to
+ * RGBA32 and builds mip level 1, splitting the rows over its own worker
+ * pool. Until then the texture is marked upload_pending; draws sampling it
+ * wait for it (others do not), glAreTexturesResident reports it as not
+ * resident and fences created after glTexImage2D wait for it.
+ *
+ * The upload thread never takes the share group lock. Texture fields are
+ * written by the submitter (under the write lock) and by the upload thread
+ * while upload_pending is set; everything else waits for the upload first.
+ */
+
+#ifndef MYTINYGL_UPLOAD_H
+#define MYTINYGL_UPLOAD_H
+
+#include "mytinygl.h"
+#include "share.h"
+
+/* Uploads queued before glTexImage2D blocks (bounds staging memory) */
+#define UPLOAD_MAX_PENDING 16
+
+/* Rows per work item of the upload worker pool */
+#define UPLOAD_CHUNK_ROWS 32
+
+struct texture_uploader;
+
+/* Start/stop the upload thread of a share group (threads >= 1, including the upload
+ * thread). upload_destroy completes every queued upload. */
+int upload_create(struct share_group *group, int threads);
+void upload_destroy(struct share_group *group);
+
+/* Reserve a queue slot, blocking while UPLOAD_MAX_PENDING uploads are queued or reserved.
+ * Called without the share group write lock, so the wait does not stall other contexts.
+ * Returns the uploader's id for upload_reserved. */
+uint64_t upload_reserve(struct texture_uploader *u);
+
+/* True if u is the uploader a reservation with this id was made on; once the uploader
+ * has been replaced the reservation is void and must be neither submitted nor canceled */
+int upload_reserved(const struct texture_uploader *u, uint64_t id);
+
+/* Give up a reservation */
+void upload_cancel(struct texture_uploader *u);
+
+/* Queue an upload in a reserved slot: tex has level 0 storage of the image size, staging
+ * holds the tightly packed client image and is freed by the uploader. Sets upload_pending.
+ * Returns -1 (reservation released) when out of memory. */
+int upload_submit(struct texture_uploader *u, texture_t *tex, uint8_t *staging, uint32_t format);
+
+/* Number of the last upload submitted by any share group */
+uint64_t upload_last(void);
+
+/* Wait up to timeout_ns until every upload numbered <= seq has completed; returns 1 if
+ * they have. */
+int upload_wait(struct texture_uploader *u, uint64_t seq, uint64_t timeout_ns);
+
+/* Wait for the upload of one texture, or for all of them */
+void upload_wait_texture(struct texture_uploader *u, texture_t *tex);
+void upload_finish(struct texture_uploader *u);
+
+static inline int upload_ready(const texture_t *tex)
+{
+    return __atomic_load_n(&tex->upload_pending, __ATOMIC_ACQUIRE) == 0;
+}
+
+/* Texture for sampling (under the share group read lock): waits for its upload */
+static inline texture_t *upload_texture_get(GLState *ctx, GLuint id)
+{
+    texture_t *tex = texture_get(&ctx->shared->textures, id);
+    if (tex && !upload_ready(tex)) upload_wait_texture(ctx->shared->uploader, tex);
+    return tex;
+}
+
+#endif /* MYTINYGL_UPLOAD_H */
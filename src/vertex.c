@@ -0,0 +1,217 @@
+/*
+ * MyTinyGL - OpenGL 1.x Fixed Function Pipeline
+ * vertex.c - Batched vertex transform
+ */
+
+#include "vertex.h"
+#include "lighting.h"
+#include <float.h>
+#include <math.h>
+
+/* Lanes of the widest vector unit available; the scalar fallback is a single lane */
+#if defined(__AVX__)
+#include <immintrin.h>
+#define LANES 8
+typedef __m256 lanes_t;
+#define lanes_load(p)      _mm256_loadu_ps(p)
+#define lanes_store(p, v)  _mm256_storeu_ps(p, v)
+#define lanes_set1(f)      _mm256_set1_ps(f)
+#define lanes_add(a, b)    _mm256_add_ps(a, b)
+#define lanes_mul(a, b)    _mm256_mul_ps(a, b)
+#define lanes_max(a, b)    _mm256_max_ps(a, b)
+#define lanes_sqrt(a)      _mm256_sqrt_ps(a)
+#define lanes_div(a, b)    _mm256_div_ps(a, b)
+#elif defined(__SSE__)
+#include <xmmintrin.h>
+#define LANES 4
+typedef __m128 lanes_t;
+#define lanes_load(p)      _mm_loadu_ps(p)
+#define lanes_store(p, v)  _mm_storeu_ps(p, v)
+#define lanes_set1(f)      _mm_set1_ps(f)
+#define lanes_add(a, b)    _mm_add_ps(a, b)
+#define lanes_mul(a, b)    _mm_mul_ps(a, b)
+#define lanes_max(a, b)    _mm_max_ps(a, b)
+#define lanes_sqrt(a)      _mm_sqrt_ps(a)
+#define lanes_div(a, b)    _mm_div_ps(a, b)
+#else
+#define LANES 1
+typedef float lanes_t;
+#define lanes_load(p)      (*(p))
+#define lanes_store(p, v)  (*(p) = (v))
+#define lanes_set1(f)      (f)
+#define lanes_add(a, b)    ((a) + (b))
+#define lanes_mul(a, b)    ((a) * (b))
+#define lanes_max(a, b)    fmaxf(a, b)
+#define lanes_sqrt(a)      sqrtf(a)
+#define lanes_div(a, b)    ((a) / (b))
+#endif
+
+/* Load the n lanes at p; in a partial group (n < LANES) the lanes past n are zero, since
+ * the batch holds no data there and stale values could be NaN or denormal */
+static inline lanes_t lanes_load_partial(const float *p, size_t n)
+{
+    if (n >= LANES) return lanes_load(p);
+    float tail[LANES] = { 0 };
+    for (size_t k = 0; k < n; k++) tail[k] = p[k];
+    return lanes_load(tail);
+}
+
+/* Row r of column-major matrix m times (x, y, z, w) */
+static inline lanes_t row4(const float *m, int r, lanes_t x, lanes_t y, lanes_t z, lanes_t w)
+{
+    return lanes_add(lanes_add(lanes_add(lanes_mul(lanes_set1(m[r]), x),
+                                         lanes_mul(lanes_set1(m[4 + r]), y)),
+                               lanes_mul(lanes_set1(m[8 + r]), z)),
+                     lanes_mul(lanes_set1(m[12 + r]), w));
+}
+
+/* Row r of m times (x, y, z, 0) */
+static inline lanes_t row3(const float *m, int r, lanes_t x, lanes_t y, lanes_t z)
+{
+    return lanes_add(lanes_add(lanes_mul(lanes_set1(m[r]), x),
+                               lanes_mul(lanes_set1(m[4 + r]), y)),
+                     lanes_mul(lanes_set1(m[8 + r]), z));
+}
+
+void vertex_apply_color_material(GLState *c, material_t *front, material_t *back, color_t col)
+{
+    GLenum mode = c->color_material_mode;
+    GLenum face = c->color_material_face;
+
+    /* Clamp color components to [0, 1] before using as material property */
+    color_t clamped_color = color_clamp(col);
+
+    if (face == GL_FRONT || face == GL_FRONT_AND_BACK) {
+        if (mode == GL_AMBIENT || mode == GL_AMBIENT_AND_DIFFUSE)
+            front->ambient = clamped_color;
+        if (mode == GL_DIFFUSE || mode == GL_AMBIENT_AND_DIFFUSE)
+            front->diffuse = clamped_color;
+        if (mode == GL_SPECULAR)
+            front->specular = clamped_color;
+        if (mode == GL_EMISSION)
+            front->emission = clamped_color;
+    }
+    if (face == GL_BACK || face == GL_FRONT_AND_BACK) {
+        if (mode == GL_AMBIENT || mode == GL_AMBIENT_AND_DIFFUSE)
+            back->ambient = clamped_color;
+        if (mode == GL_DIFFUSE || mode == GL_AMBIENT_AND_DIFFUSE)
+            back->diffuse = clamped_color;
+        if (mode == GL_SPECULAR)
+            back->specular = clamped_color;
+        if (mode == GL_EMISSION)
+            back->emission = clamped_color;
+    }
+}
+
+void vertex_process_batch(GLState *c, material_t *front, material_t *back,
+                          const vertex_batch_t *in, size_t count, vertex_t *out)
+{
+    /* Only the outputs read downstream are computed (gl_vertex_live). Eye-space position
+     * and normal are needed by lighting and fog; otherwise the combined matrix goes
+     * straight to clip space. Texture coordinates are passed through untextured. */
+    uint32_t live = gl_vertex_live(c);
+    int lighting = (c->flags & FLAG_LIGHTING) != 0;
+    int eye_space = lighting || (live & VERTEX_LIVE_FOG);
+    int affine = (c->transform_class & TRANSFORM_MODELVIEW_AFFINE) != 0;
+    int tex_matrix = (live & VERTEX_LIVE_TEXCOORD) && !(c->transform_class & TRANSFORM_TEXTURE_IDENTITY);
+    const float *mv = c->modelview_matrix[c->modelview_stack_depth];
+    const float *proj = c->projection_matrix[c->projection_stack_depth];
+    const float *tm = c->texture_matrix[c->texture_stack_depth];
+
+    /* Transformed attributes, structure of arrays. Lanes past count transform zeros
+     * and are never read. */
+    float px[VERTEX_BATCH_SIZE], py[VERTEX_BATCH_SIZE], pz[VERTEX_BATCH_SIZE], pw[VERTEX_BATCH_SIZE];
+    float ex[VERTEX_BATCH_SIZE], ey[VERTEX_BATCH_SIZE], ez[VERTEX_BATCH_SIZE];
+    float enx[VERTEX_BATCH_SIZE], eny[VERTEX_BATCH_SIZE], enz[VERTEX_BATCH_SIZE];
+    float ts[VERTEX_BATCH_SIZE], tt[VERTEX_BATCH_SIZE], tq[VERTEX_BATCH_SIZE];
+
+    for (size_t i = 0; i < count; i += LANES) {
+        size_t n = count - i;
+        lanes_t x = lanes_load_partial(in->x + i, n), y = lanes_load_partial(in->y + i, n);
+        lanes_t z = lanes_load_partial(in->z + i, n), w = lanes_load_partial(in->w + i, n);
+
+        if (eye_space) {
+            lanes_t eye_x = row4(mv, 0, x, y, z, w);
+            lanes_t eye_y = row4(mv, 1, x, y, z, w);
+            lanes_t eye_z = row4(mv, 2, x, y, z, w);
+            lanes_t eye_w = affine ? w : row4(mv, 3, x, y, z, w);
+            lanes_store(ex + i, eye_x);
+            lanes_store(ey + i, eye_y);
+            lanes_store(ez + i, eye_z);
+            lanes_store(px + i, row4(proj, 0, eye_x, eye_y, eye_z, eye_w));
+            lanes_store(py + i, row4(proj, 1, eye_x, eye_y, eye_z, eye_w));
+            lanes_store(pz + i, row4(proj, 2, eye_x, eye_y, eye_z, eye_w));
+            lanes_store(pw + i, row4(proj, 3, eye_x, eye_y, eye_z, eye_w));
+        } else {
+            lanes_store(px + i, row4(c->mvp_matrix, 0, x, y, z, w));
+            lanes_store(py + i, row4(c->mvp_matrix, 1, x, y, z, w));
+            lanes_store(pz + i, row4(c->mvp_matrix, 2, x, y, z, w));
+            lanes_store(pw + i, row4(c->mvp_matrix, 3, x, y, z, w));
+        }
+
+        if (lighting) {
+            /* Inverse-transpose of the modelview handles non-uniform scaling; the result
+             * is always normalized. A zero normal stays zero: 0 * (1 / FLT_MIN) = 0. */
+            lanes_t ox = lanes_load_partial(in->nx + i, n);
+            lanes_t oy = lanes_load_partial(in->ny + i, n);
+            lanes_t oz = lanes_load_partial(in->nz + i, n);
+            lanes_t nx = row3(c->normal_matrix, 0, ox, oy, oz);
+            lanes_t ny = row3(c->normal_matrix, 1, ox, oy, oz);
+            lanes_t nz = row3(c->normal_matrix, 2, ox, oy, oz);
+            lanes_t len = lanes_sqrt(lanes_add(lanes_add(lanes_mul(nx, nx), lanes_mul(ny, ny)), lanes_mul(nz, nz)));
+            lanes_t inv = lanes_div(lanes_set1(1.0f), lanes_max(len, lanes_set1(FLT_MIN)));
+            lanes_store(enx + i, lanes_mul(nx, inv));
+            lanes_store(eny + i, lanes_mul(ny, inv));
+            lanes_store(enz + i, lanes_mul(nz, inv));
+        }
+
+        if (tex_matrix) {
+            lanes_t s = lanes_load_partial(in->s + i, n), t = lanes_load_partial(in->t + i, n);
+            lanes_t zero = lanes_set1(0.0f), one = lanes_set1(1.0f);
+            lanes_store(ts + i, row4(tm, 0, s, t, zero, one));
+            lanes_store(tt + i, row4(tm, 1, s, t, zero, one));
+            lanes_store(tq + i, row4(tm, 3, s, t, zero, one));
+        }
+    }
+
+    /* Color material and lighting in vertex order: a vertex's color material update
+     * applies to the vertices after it */
+    int color_material = lighting && (c->flags & FLAG_COLOR_MATERIAL);
+    int vertex_lighting = lighting && c->shade_model != GL_PHONG;
+    for (size_t i = 0; i < count; i++) {
+        vertex_t *v = &out[i];
+        color_t col = color(in->r[i], in->g[i], in->b[i], in->a[i]);
+
+        v->position = vec4(px[i], py[i], pz[i], pw[i]);
+        if (eye_space) {
+            v->eye_z = -ez[i];  /* Negate because OpenGL looks down -Z */
+            v->eye_pos = vec3(ex[i], ey[i], ez[i]);
+        } else {
+            v->eye_z = 0.0f;
+            v->eye_pos = vec3(0.0f, 0.0f, 0.0f);
+        }
+        v->eye_normal = lighting ? vec3(enx[i], eny[i], enz[i]) : vec3(0.0f, 0.0f, 0.0f);
+
+        /* For GL_PHONG, lighting is computed per-fragment in the rasterizer. Two-sided
+         * Gouraud lighting is also resolved there since the face orientation is not known
+         * yet: the front material is used here. */
+        if (color_material) {
+            vertex_apply_color_material(c, front, back, col);
+        }
+        if (vertex_lighting) {
+            col = compute_lighting(c, v->eye_pos, v->eye_normal, front);
+        }
+        v->color = col;
+
+        if (tex_matrix) {
+            /* Perspective divide if q != 1 (for projective texturing) */
+            if (tq[i] != 0.0f && tq[i] != 1.0f) {
+                v->texcoord = vec2(ts[i] / tq[i], tt[i] / tq[i]);
+            } else {
+                v->texcoord = vec2(ts[i], tt[i]);
+            }
+        } else {
+            v->texcoord = vec2(in->s[i], in->t[i]);
+        }
+    }
+}
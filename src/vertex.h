@@ -0,0 +1,64 @@
+/*
+ * MyTinyGL - OpenGL 1.x Software Renderer
+ * Copyright (c) 2025 zbufferoverflow (Eliezer Solinger)
+ * https://github.com/zbufferoverflow/MyTinyGL
+ * SPDX-License-Identifier: MIT
+ *
+ * vertex.h - Batched vertex transform
+ *
+ * Vertices are transformed in batches of up to VERTEX_BATCH_SIZE held in
+ * structure-of-arrays form, so the modelview, projection, normal and texture
+ * matrices are applied to 8 (AVX) or 4 (SSE) vertices per instruction. Color
+ * material and per-vertex lighting then run over the batch in order and the
+ * result is written to the vertex buffer read by primitive assembly.
+ *
+ * glVertex calls inside glBegin/glEnd (including display list replay) are
+ * staged in the context's batch and transformed when it fills, at glEnd or
+ * before glMaterial changes the material; array draws fill batches directly.
+ */
+
+#ifndef MYTINYGL_VERTEX_H
+#define MYTINYGL_VERTEX_H
+
+#include "mytinygl.h"
+
+/* Vertices per batch (a multiple of the widest lane count) */
+#define VERTEX_BATCH_SIZE 64
+
+/* Object-space attributes of a batch of vertices */
+typedef struct vertex_batch {
+    float x[VERTEX_BATCH_SIZE], y[VERTEX_BATCH_SIZE], z[VERTEX_BATCH_SIZE], w[VERTEX_BATCH_SIZE];
+    float r[VERTEX_BATCH_SIZE], g[VERTEX_BATCH_SIZE], b[VERTEX_BATCH_SIZE], a[VERTEX_BATCH_SIZE];
+    float s[VERTEX_BATCH_SIZE], t[VERTEX_BATCH_SIZE];
+    float nx[VERTEX_BATCH_SIZE], ny[VERTEX_BATCH_SIZE], nz[VERTEX_BATCH_SIZE];
+} vertex_batch_t;
+
+/* Store one vertex with the given attributes at slot i of a batch */
+static inline void vertex_batch_set(vertex_batch_t *b, size_t i, float x, float y, float z, float w,
+                                    color_t col, vec2_t texcoord, vec3_t normal)
+{
+    b->x[i] = x;
+    b->y[i] = y;
+    b->z[i] = z;
+    b->w[i] = w;
+    b->r[i] = col.r;
+    b->g[i] = col.g;
+    b->b[i] = col.b;
+    b->a[i] = col.a;
+    b->s[i] = texcoord.x;
+    b->t[i] = texcoord.y;
+    b->nx[i] = normal.x;
+    b->ny[i] = normal.y;
+    b->nz[i] = normal.z;
+}
+
+/* GL_COLOR_MATERIAL: track the current color in the selected material properties */
+void vertex_apply_color_material(GLState *ctx, material_t *front, material_t *back, color_t col);
+
+/* Transform and light the first count vertices of a batch into out[0..count). Color
+ * material updates go to front/back, so parallel callers can pass private copies. The
+ * derived transform state must be valid (gl_validate_transform). */
+void vertex_process_batch(GLState *ctx, material_t *front, material_t *back,
+                          const vertex_batch_t *in, size_t count, vertex_t *out);
+
+#endif /* MYTINYGL_VERTEX_H */
@@ -0,0 +1,414 @@
+/*
+ * MyTinyGL - OpenGL 1.x Fixed Function Pipeline
+ * workers.c - Worker thread pool
+ */
+
+#define _GNU_SOURCE
+
+#include "workers.h"
+#include "allocation.h"
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <dirent.h>
+
+/* Items of one thread for the current loop: slots [head, tail) of its segment. Both
+ * ends move by compare-and-swap on the packed pair (head in the low 32 bits): the
+ * owner takes from the head, thieves from the tail. */
+typedef struct {
+    uint64_t range;
+    uint32_t *slots;
+    char pad[64 - sizeof(uint64_t) - sizeof(uint32_t *)];   /* One cache line per deque */
+} worker_deque_t;
+
+struct worker_pool;
+
+typedef struct {
+    struct worker_pool *pool;
+    int index;                  /* Deque owned by the thread (0 = submitting thread) */
+} worker_t;
+
+struct worker_pool {
+    pthread_t threads[WORKERS_MAX_THREADS];
+    worker_t workers[WORKERS_MAX_THREADS];
+    int thread_count;           /* Worker threads (the submitting thread is not counted) */
+    int node[WORKERS_MAX_THREADS];  /* NUMA node of each thread, -1 if not pinned to one */
+    int node_count;             /* Nodes the workers are spread over, 0 without NUMA placement */
+    pthread_mutex_t lock;
+    pthread_cond_t start_cond;
+    pthread_cond_t done_cond;
+    unsigned generation;        /* Incremented per loop */
+    int busy;                   /* Workers still running the current loop */
+    int shutdown;
+
+    /* Current loop */
+    worker_func_t func;
+    void *arg;
+    int steal;                  /* Threads may run items of other threads */
+    worker_deque_t deques[WORKERS_MAX_THREADS];
+    uint32_t *slots;            /* Deque segments */
+    uint32_t slot_capacity;
+};
+
+static int pop_head(worker_deque_t *d, uint32_t *item)
+{
+    for (;;) {
+        uint64_t range = __atomic_load_n(&d->range, __ATOMIC_ACQUIRE);
+        uint32_t head = (uint32_t)range, tail = (uint32_t)(range >> 32);
+        if (head >= tail) return 0;
+        if (__sync_bool_compare_and_swap(&d->range, range, ((uint64_t)tail << 32) | (head + 1))) {
+            *item = d->slots[head];
+            return 1;
+        }
+    }
+}
+
+static int steal_tail(worker_deque_t *d, uint32_t *item)
+{
+    for (;;) {
+        uint64_t range = __atomic_load_n(&d->range, __ATOMIC_ACQUIRE);
+        uint32_t head = (uint32_t)range, tail = (uint32_t)(range >> 32);
+        if (head >= tail) return 0;
+        if (__sync_bool_compare_and_swap(&d->range, range, ((uint64_t)(tail - 1) << 32) | head)) {
+            *item = d->slots[tail - 1];
+            return 1;
+        }
+    }
+}
+
+/* Steal an item, from threads of our node first when the workers are placed on nodes */
+static int steal_any(struct worker_pool *pool, int self, uint32_t *item)
+{
+    int count = pool->thread_count + 1;
+    int node = pool->node[self];
+    if (pool->node_count > 1 && node >= 0) {
+        for (int i = 1; i < count; i++) {
+            int victim = (self + i) % count;
+            if (pool->node[victim] == node && steal_tail(&pool->deques[victim], item)) return 1;
+        }
+    }
+    for (int i = 1; i < count; i++) {
+        if (steal_tail(&pool->deques[(self + i) % count], item)) return 1;
+    }
+    return 0;
+}
+
+/* Run items from our deque, then steal from the others until all are empty (a loop
+ * never adds items, so an empty sweep means we are done) */
+static void run_items(struct worker_pool *pool, int self)
+{
+    uint32_t item;
+    for (;;) {
+        if (pop_head(&pool->deques[self], &item) || (pool->steal && steal_any(pool, self, &item))) {
+            pool->func(pool->arg, item);
+            continue;
+        }
+        break;
+    }
+}
+
+static void *worker_main(void *arg)
+{
+    worker_t *worker = arg;
+    struct worker_pool *pool = worker->pool;
+    unsigned seen = 0;
+
+    pthread_mutex_lock(&pool->lock);
+    for (;;) {
+        while (pool->generation == seen && !pool->shutdown) {
+            pthread_cond_wait(&pool->start_cond, &pool->lock);
+        }
+        if (pool->shutdown) break;
+        seen = pool->generation;
+        pthread_mutex_unlock(&pool->lock);
+
+        run_items(pool, worker->index);
+
+        pthread_mutex_lock(&pool->lock);
+        if (--pool->busy == 0) pthread_cond_signal(&pool->done_cond);
+    }
+    pthread_mutex_unlock(&pool->lock);
+    return NULL;
+}
+
+struct worker_pool *worker_pool_create(int threads)
+{
+    if (threads > WORKERS_MAX_THREADS) threads = WORKERS_MAX_THREADS;
+
+    struct worker_pool *pool = mtgl_calloc(1, sizeof(struct worker_pool));
+    if (!pool) return NULL;
+
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->start_cond, NULL);
+    pthread_cond_init(&pool->done_cond, NULL);
+    for (int i = 0; i < WORKERS_MAX_THREADS; i++) {
+        pool->node[i] = -1;
+    }
+
+    for (int i = 0; i < threads - 1; i++) {
+        worker_t *worker = &pool->workers[i];
+        worker->pool = pool;
+        worker->index = i + 1;
+        if (pthread_create(&pool->threads[i], NULL, worker_main, worker) != 0) break;
+        pool->thread_count++;
+    }
+    if (threads > 1 && pool->thread_count == 0) {
+        worker_pool_destroy(pool);
+        return NULL;
+    }
+    return pool;
+}
+
+void worker_pool_destroy(struct worker_pool *pool)
+{
+    if (!pool) return;
+
+    pthread_mutex_lock(&pool->lock);
+    pool->shutdown = 1;
+    pthread_cond_broadcast(&pool->start_cond);
+    pthread_mutex_unlock(&pool->lock);
+    for (int i = 0; i < pool->thread_count; i++) {
+        pthread_join(pool->threads[i], NULL);
+    }
+    pthread_mutex_destroy(&pool->lock);
+    pthread_cond_destroy(&pool->start_cond);
+    pthread_cond_destroy(&pool->done_cond);
+    mtgl_free(pool->slots);
+    mtgl_free(pool);
+}
+
+int worker_pool_threads(const struct worker_pool *pool)
+{
+    return pool->thread_count + 1;
+}
+
+int worker_pool_set_affinity(struct worker_pool *pool, int enabled)
+{
+    /* Replaces NUMA placement */
+    pool->node_count = 0;
+    for (int i = 0; i < WORKERS_MAX_THREADS; i++) {
+        pool->node[i] = -1;
+    }
+
+#if defined(__linux__)
+    cpu_set_t allowed;
+    if (sched_getaffinity(0, sizeof(allowed), &allowed) != 0) return -1;
+
+    /* Worker i goes to the (i + 1)th CPU the process may use; the submitting thread
+     * (the application's) keeps its own mask */
+    int cpus[CPU_SETSIZE];
+    int cpu_count = 0;
+    for (int cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+        if (CPU_ISSET(cpu, &allowed)) cpus[cpu_count++] = cpu;
+    }
+    if (cpu_count == 0) return -1;
+
+    int result = 0;
+    for (int i = 0; i < pool->thread_count; i++) {
+        cpu_set_t set = allowed;
+        if (enabled) {
+            CPU_ZERO(&set);
+            CPU_SET(cpus[(i + 1) % cpu_count], &set);
+        }
+        if (pthread_setaffinity_np(pool->threads[i], sizeof(set), &set) != 0) result = -1;
+    }
+    return result;
+#else
+    (void)pool;
+    return enabled ? -1 : 0;
+#endif
+}
+
+/* Parse a sysfs CPU list ("0-3,8,10-11") into cpu_node */
+static void parse_cpulist(const char *list, int node, int16_t *cpu_node, int max_cpus)
+{
+    const char *p = list;
+    while (*p) {
+        char *end;
+        long first = strtol(p, &end, 10);
+        if (end == p) break;
+        long last = first;
+        p = end;
+        if (*p == '-') {
+            last = strtol(p + 1, &end, 10);
+            p = end;
+        }
+        for (long cpu = first; cpu <= last && cpu < max_cpus; cpu++) {
+            if (cpu >= 0) cpu_node[cpu] = (int16_t)node;
+        }
+        if (*p != ',') break;
+        p++;
+    }
+}
+
+int worker_topology_read(const char *node_dir, int16_t *cpu_node, int max_cpus)
+{
+    for (int cpu = 0; cpu < max_cpus; cpu++) {
+        cpu_node[cpu] = -1;
+    }
+
+    /* No NUMA support in the kernel: a single node */
+    DIR *dir = opendir(node_dir);
+    if (!dir) {
+        for (int cpu = 0; cpu < max_cpus; cpu++) {
+            cpu_node[cpu] = 0;
+        }
+        return 1;
+    }
+
+    int node_count = 0;
+    struct dirent *entry;
+    while ((entry = readdir(dir)) != NULL) {
+        int node;
+        char tail;
+        if (sscanf(entry->d_name, "node%d%c", &node, &tail) != 1 || node < 0) continue;
+
+        char path[512];
+        char list[4096];
+        snprintf(path, sizeof(path), "%s/%s/cpulist", node_dir, entry->d_name);
+        FILE *f = fopen(path, "r");
+        if (!f) continue;
+        if (fgets(list, sizeof(list), f)) {
+            parse_cpulist(list, node, cpu_node, max_cpus);
+        }
+        fclose(f);
+        if (node + 1 > node_count) node_count = node + 1;
+    }
+    closedir(dir);
+    return node_count > 0 ? node_count : -1;
+}
+
+int worker_pool_set_numa(struct worker_pool *pool, int enabled)
+{
+    if (worker_pool_set_affinity(pool, 0) != 0 || !enabled) return enabled ? -1 : 0;
+
+#if defined(__linux__)
+    int16_t cpu_node[CPU_SETSIZE];
+    int cpus[CPU_SETSIZE];
+    int nodes = worker_topology_read(WORKERS_NODE_DIR, cpu_node, CPU_SETSIZE);
+    cpu_set_t allowed;
+    if (nodes < 1 || sched_getaffinity(0, sizeof(allowed), &allowed) != 0) return -1;
+
+    /* Allowed CPUs grouped by node; workers go round-robin over the nodes that have
+     * some, so a node's share of the threads matches its share of the CPUs we use */
+    int node_first[WORKERS_MAX_THREADS + 1];
+    int used_nodes[WORKERS_MAX_THREADS];
+    int used_count = 0, cpu_count = 0;
+    for (int node = 0; node < nodes && used_count < WORKERS_MAX_THREADS; node++) {
+        int first = cpu_count;
+        for (int cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+            if (CPU_ISSET(cpu, &allowed) && cpu_node[cpu] == node) cpus[cpu_count++] = cpu;
+        }
+        if (cpu_count > first) {
+            node_first[used_count] = first;
+            used_nodes[used_count++] = node;
+        }
+    }
+    if (used_count == 0) return -1;
+    node_first[used_count] = cpu_count;
+
+    int result = 0;
+    for (int i = 0; i < pool->thread_count; i++) {
+        int n = i % used_count;
+        int span = node_first[n + 1] - node_first[n];
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET(cpus[node_first[n] + (i / used_count) % span], &set);
+        if (pthread_setaffinity_np(pool->threads[i], sizeof(set), &set) != 0) result = -1;
+        pool->node[i + 1] = used_nodes[n];
+    }
+    if (result < 0) {
+        worker_pool_set_numa(pool, 0);
+        return -1;
+    }
+    pool->node_count = used_count < pool->thread_count ? used_count : pool->thread_count;
+    return pool->node_count;
+#else
+    return -1;
+#endif
+}
+
+int worker_pool_thread_node(const struct worker_pool *pool, int thread)
+{
+    return pool->node[thread];
+}
+
+/* Deal the items into the deques (to thread home[item], or round-robin so every thread
+ * starts with one of the first items) and run the loop */
+static void run_loop(struct worker_pool *pool, worker_func_t func, void *arg,
+                     const uint32_t *order, const uint8_t *home, uint32_t count, int steal)
+{
+    if (count == 0) return;
+
+    int threads = pool->thread_count + 1;
+    if (count > pool->slot_capacity) {
+        uint32_t *new_slots = mtgl_realloc(pool->slots, (size_t)count * sizeof(uint32_t));
+        if (!new_slots) {
+            /* No room to deal: run everything here */
+            for (uint32_t i = 0; i < count; i++) func(arg, order ? order[i] : i);
+            return;
+        }
+        pool->slots = new_slots;
+        pool->slot_capacity = count;
+    }
+
+    uint32_t sizes[WORKERS_MAX_THREADS] = { 0 };
+    for (uint32_t i = 0; i < count; i++) {
+        uint32_t item = order ? order[i] : i;
+        sizes[home ? home[item] % threads : i % threads]++;
+    }
+    uint32_t offset = 0;
+    for (int t = 0; t < threads; t++) {
+        pool->deques[t].slots = pool->slots + offset;
+        pool->deques[t].range = 0;
+        offset += sizes[t];
+    }
+    for (uint32_t i = 0; i < count; i++) {
+        uint32_t item = order ? order[i] : i;
+        worker_deque_t *d = &pool->deques[home ? home[item] % threads : i % threads];
+        uint32_t tail = (uint32_t)(d->range >> 32);
+        d->slots[tail] = item;
+        d->range = (uint64_t)(tail + 1) << 32;
+    }
+
+    pool->func = func;
+    pool->arg = arg;
+    pool->steal = steal;
+
+    /* A single item is not worth waking anyone */
+    if (pool->thread_count == 0 || (count == 1 && sizes[0] == 1)) {
+        run_items(pool, 0);
+        return;
+    }
+
+    pthread_mutex_lock(&pool->lock);
+    pool->busy = pool->thread_count;
+    pool->generation++;
+    pthread_cond_broadcast(&pool->start_cond);
+    pthread_mutex_unlock(&pool->lock);
+
+    run_items(pool, 0);
+
+    pthread_mutex_lock(&pool->lock);
+    while (pool->busy > 0) {
+        pthread_cond_wait(&pool->done_cond, &pool->lock);
+    }
+    pthread_mutex_unlock(&pool->lock);
+}
+
+void worker_pool_run_ordered(struct worker_pool *pool, worker_func_t func, void *arg,
+                             const uint32_t *order, uint32_t count)
+{
+    run_loop(pool, func, arg, order, NULL, count, 1);
+}
+
+void worker_pool_run_homed(struct worker_pool *pool, worker_func_t func, void *arg,
+                           const uint32_t *order, const uint8_t *home, uint32_t count, int steal)
+{
+    run_loop(pool, func, arg, order, home, count, steal);
+}
+
+void worker_pool_run(struct worker_pool *pool, worker_func_t func, void *arg, uint32_t count)
+{
+    worker_pool_run_ordered(pool, func, arg, NULL, count);
+}
@@ -0,0 +1,77 @@
+/*
+ * MyTinyGL - OpenGL 1.x Software Renderer
+ * Copyright (c) 2025 zbufferoverflow (Eliezer Solinger)
+ * https://github.com/zbufferoverflow/MyTinyGL
+ * SPDX-License-Identifier: MIT
+ *
+ * workers.h - Worker thread pool
+ *
+ * A context with render threads (gl_set_render_threads) owns a pool used for
+ * tile rasterization and for vertex processing of large array draws. Work is
+ * submitted as a parallel loop over items; the submitting thread takes items
+ * too and returns once all of them are done. Only one loop runs at a time.
+ *
+ * Items are dealt round-robin into one deque per thread, in the order given
+ * (so the first items, e.g. the most expensive ones, start first). A thread
+ * runs its own items front to back, then steals from the back of the others.
+ *
+ * With NUMA placement (worker_pool_set_numa) the workers are pinned to CPUs
+ * spread over the nodes found in sysfs, and loops can deal each item to a
+ * fixed home thread (worker_pool_run_homed) so the memory it touches stays on
+ * that thread's node from one loop to the next. Idle threads steal from their
+ * own node before going remote.
+ */
+
+#ifndef MYTINYGL_WORKERS_H
+#define MYTINYGL_WORKERS_H
+
+#include <stdint.h>
+
+#define WORKERS_MAX_THREADS 64
+
+/* Where the kernel lists NUMA nodes (nodeN/cpulist) */
+#define WORKERS_NODE_DIR "/sys/devices/system/node"
+
+struct worker_pool;
+
+/* Called once per item, from any thread of the pool */
+typedef void (*worker_func_t)(void *arg, uint32_t item);
+
+/* Create a pool of `threads` threads, counting the submitting thread.
+ * Returns NULL on failure. */
+struct worker_pool *worker_pool_create(int threads);
+void worker_pool_destroy(struct worker_pool *pool);
+
+/* Number of threads working on a loop, including the submitting thread */
+int worker_pool_threads(const struct worker_pool *pool);
+
+/* Run func(arg, i) for i in [0, count) and wait for completion */
+void worker_pool_run(struct worker_pool *pool, worker_func_t func, void *arg, uint32_t count);
+
+/* Same for the items order[0..count), started roughly in that order */
+void worker_pool_run_ordered(struct worker_pool *pool, worker_func_t func, void *arg,
+                             const uint32_t *order, uint32_t count);
+
+/* Same, each item going to the deque of thread home[item] (0 = submitting thread).
+ * Without steal every item runs on its home thread. */
+void worker_pool_run_homed(struct worker_pool *pool, worker_func_t func, void *arg,
+                           const uint32_t *order, const uint8_t *home, uint32_t count, int steal);
+
+/* Pin each worker thread to its own CPU (or restore the process mask); the submitting
+ * thread is left alone. Returns 0 on success, -1 if unsupported or refused. */
+int worker_pool_set_affinity(struct worker_pool *pool, int enabled);
+
+/* Read the node of each CPU from node_dir (normally WORKERS_NODE_DIR): cpu_node[cpu] is
+ * -1 for CPUs no node lists. Returns the number of node ids (all CPUs on node 0 when
+ * node_dir does not exist), -1 if no node could be read. */
+int worker_topology_read(const char *node_dir, int16_t *cpu_node, int max_cpus);
+
+/* Pin the worker threads to CPUs spread round-robin over the NUMA nodes (enabled), or
+ * let them float again. Returns the number of nodes used, -1 if unsupported or refused.
+ * The submitting thread is left alone and belongs to no node. */
+int worker_pool_set_numa(struct worker_pool *pool, int enabled);
+
+/* NUMA node of thread t (0 = submitting thread), -1 without placement */
+int worker_pool_thread_node(const struct worker_pool *pool, int thread);
+
+#endif /* MYTINYGL_WORKERS_H */
@@ -0,0 +1,477 @@
+/*
+ * mt-stress.c
+ * Headless check of the threaded paths of MyTinyGL (no SDL, MyTinyGL only):
+ * - the same scene rendered in immediate mode, with tile-binned render threads,
+ *   in async mode, with background texture uploads and from several threads at
+ *   once must be pixel-identical
+ * - fences stay usable after their context is destroyed, and glWaitSync makes
+ *   another context's render thread wait
+ * - the context pool outlives its share context, rejects bad releases and
+ *   foreign templates, and hands out working contexts under contention
+ * Exits with status 1 if any check fails.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "../src/mytinygl.h"
+
+#define WIDTH  256
+#define HEIGHT 192
+#define GRID   24
+#define GRID_VERTICES ((GRID + 1) * (GRID + 1))
+
+#define POOL_THREADS    4
+#define POOL_ITERATIONS 8
+
+static int failures = 0;
+
+static void check(int ok, const char *what)
+{
+    printf("%s: %s\n", ok ? "PASS" : "FAIL", what);
+    if (!ok) failures++;
+}
+
+/* Scene data, shared read-only by every thread */
+static float grid_vertices[GRID_VERTICES][3];
+static float grid_normals[GRID_VERTICES][3];
+static float grid_colors[GRID_VERTICES][4];
+static GLushort grid_indices[GRID * GRID * 6];
+static GLsizei grid_index_count;
+static GLushort column_indices[GRID * 6];     /* One column of quads: sparse indices */
+static GLsizei column_index_count;
+static uint8_t checker[64 * 64 * 4];
+
+static void scene_data_init(void)
+{
+    for (int y = 0; y <= GRID; y++) {
+        for (int x = 0; x <= GRID; x++) {
+            int v = y * (GRID + 1) + x;
+            float u = (float)x / GRID, w = (float)y / GRID;
+            float h = 0.25f * sinf(u * 6.0f) * cosf(w * 5.0f);
+            grid_vertices[v][0] = u * 2.0f - 1.0f;
+            grid_vertices[v][1] = h;
+            grid_vertices[v][2] = w * 2.0f - 1.0f;
+            grid_normals[v][0] = -1.5f * cosf(u * 6.0f) * cosf(w * 5.0f);
+            grid_normals[v][1] = 1.0f;
+            grid_normals[v][2] = 1.25f * sinf(u * 6.0f) * sinf(w * 5.0f);
+            grid_colors[v][0] = u;
+            grid_colors[v][1] = 0.5f + 0.5f * w;
+            grid_colors[v][2] = 1.0f - u;
+            grid_colors[v][3] = 1.0f;
+        }
+    }
+
+    grid_index_count = 0;
+    column_index_count = 0;
+    for (int y = 0; y < GRID; y++) {
+        for (int x = 0; x < GRID; x++) {
+            GLushort a = (GLushort)(y * (GRID + 1) + x), b = a + 1;
+            GLushort c = (GLushort)(a + GRID + 1), d = c + 1;
+            GLushort quad[6] = { a, c, d, a, d, b };
+            if ((x + y) % 5 != 0) {
+                memcpy(&grid_indices[grid_index_count], quad, sizeof(quad));
+                grid_index_count += 6;
+            }
+            if (x == GRID / 2) {
+                memcpy(&column_indices[column_index_count], quad, sizeof(quad));
+                column_index_count += 6;
+            }
+        }
+    }
+
+    for (int y = 0; y < 64; y++) {
+        for (int x = 0; x < 64; x++) {
+            uint8_t *p = &checker[(y * 64 + x) * 4];
+            int on = ((x >> 3) ^ (y >> 3)) & 1;
+            p[0] = on ? 240 : 40;
+            p[1] = (uint8_t)(x * 4);
+            p[2] = on ? 60 : 200;
+            p[3] = 255;
+        }
+    }
+}
+
+typedef struct {
+    GLuint texture;
+    GLuint list;
+} scene_objects_t;
+
+/* Texture and display list of the scene, in the share group of the current context */
+static scene_objects_t scene_objects_create(void)
+{
+    scene_objects_t o;
+    glGenTextures(1, &o.texture);
+    glBindTexture(GL_TEXTURE_2D, o.texture);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, 64, 64, 0, GL_RGBA, GL_UNSIGNED_BYTE, checker);
+
+    o.list = glGenLists(1);
+    glNewList(o.list, GL_COMPILE);
+    glBegin(GL_TRIANGLES);
+    for (int i = 0; i < 12; i++) {
+        float a = i * 0.5236f;
+        glColor4f(0.5f + 0.5f * cosf(a), 0.5f + 0.5f * sinf(a), 0.8f, 0.5f);
+        glVertex3f(0.0f, 1.0f, 0.0f);
+        glVertex3f(cosf(a) * 1.5f, 0.2f, sinf(a) * 1.5f);
+        glVertex3f(cosf(a + 0.4f) * 1.5f, 0.2f, sinf(a + 0.4f) * 1.5f);
+    }
+    glEnd();
+    glEndList();
+    return o;
+}
+
+/* One frame of the scene: scissored clear, textured floor, lit indexed mesh (dense and
+ * sparse indices), a blended display list, lines and points */
+static void draw_scene(const scene_objects_t *o, int frame)
+{
+    glViewport(0, 0, WIDTH, HEIGHT);
+    glClearColor(0.1f, 0.1f, 0.2f, 1.0f);
+    glClearDepth(1.0);
+    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+    glEnable(GL_SCISSOR_TEST);
+    glScissor(40, 30, 100, 80);
+    glClearColor(0.3f, 0.1f, 0.1f, 1.0f);
+    glClear(GL_COLOR_BUFFER_BIT);
+    glDisable(GL_SCISSOR_TEST);
+
+    glEnable(GL_DEPTH_TEST);
+    glDepthFunc(GL_LESS);
+    glMatrixMode(GL_PROJECTION);
+    glLoadIdentity();
+    glFrustum(-1.0, 1.0, -0.75, 0.75, 1.0, 20.0);
+    glMatrixMode(GL_MODELVIEW);
+    glLoadIdentity();
+    glTranslatef(0.0f, -0.3f, -3.5f);
+    glRotatef(25.0f, 1.0f, 0.0f, 0.0f);
+    glRotatef(10.0f * frame, 0.0f, 1.0f, 0.0f);
+
+    glEnable(GL_TEXTURE_2D);
+    glBindTexture(GL_TEXTURE_2D, o->texture);
+    glBegin(GL_QUADS);
+    glColor3f(1.0f, 1.0f, 1.0f);
+    glTexCoord2f(0.0f, 0.0f); glVertex3f(-4.0f, -0.5f, -6.0f);
+    glTexCoord2f(0.0f, 6.0f); glVertex3f(-4.0f, -0.5f, 2.0f);
+    glTexCoord2f(6.0f, 6.0f); glVertex3f(4.0f, -0.5f, 2.0f);
+    glTexCoord2f(6.0f, 0.0f); glVertex3f(4.0f, -0.5f, -6.0f);
+    glEnd();
+    glDisable(GL_TEXTURE_2D);
+
+    GLfloat light_pos[4] = { 1.0f, 2.0f, 2.0f, 0.0f };
+    glEnable(GL_LIGHTING);
+    glEnable(GL_LIGHT0);
+    glLightfv(GL_LIGHT0, GL_POSITION, light_pos);
+    glEnable(GL_COLOR_MATERIAL);
+    glEnableClientState(GL_VERTEX_ARRAY);
+    glEnableClientState(GL_NORMAL_ARRAY);
+    glEnableClientState(GL_COLOR_ARRAY);
+    glVertexPointer(3, GL_FLOAT, 0, grid_vertices);
+    glNormalPointer(GL_FLOAT, 0, grid_normals);
+    glColorPointer(4, GL_FLOAT, 0, grid_colors);
+    glDrawElements(GL_TRIANGLES, grid_index_count, GL_UNSIGNED_SHORT, grid_indices);
+    glPushMatrix();
+    glTranslatef(0.0f, 0.6f, 0.0f);
+    glDrawElements(GL_TRIANGLES, column_index_count, GL_UNSIGNED_SHORT, column_indices);
+    glPopMatrix();
+    glDisableClientState(GL_VERTEX_ARRAY);
+    glDisableClientState(GL_NORMAL_ARRAY);
+    glDisableClientState(GL_COLOR_ARRAY);
+    glDisable(GL_COLOR_MATERIAL);
+    glDisable(GL_LIGHTING);
+
+    glEnable(GL_BLEND);
+    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+    glCallList(o->list);
+    glDisable(GL_BLEND);
+
+    glBegin(GL_LINES);
+    for (int i = 0; i < 8; i++) {
+        glColor3f(1.0f, 1.0f, 0.0f);
+        glVertex3f(-1.5f + i * 0.4f, -0.4f, 1.0f);
+        glVertex3f(-1.2f + i * 0.4f, 1.2f, -1.0f);
+    }
+    glEnd();
+    glPointSize(3.0f);
+    glBegin(GL_POINTS);
+    for (int i = 0; i < 16; i++) {
+        glColor3f(0.0f, 1.0f, 1.0f);
+        glVertex3f(-1.6f + i * 0.2f, 1.3f, 0.5f);
+    }
+    glEnd();
+}
+
+/* Render frames 0..2 on the current context and read the last one back */
+static void render(const scene_objects_t *o, uint8_t *pixels)
+{
+    for (int frame = 0; frame < 3; frame++) {
+        draw_scene(o, frame);
+    }
+    glReadPixels(0, 0, WIDTH, HEIGHT, GL_RGBA, GL_UNSIGNED_BYTE, pixels);
+}
+
+static long count_differences(const uint8_t *a, const uint8_t *b)
+{
+    long n = 0;
+    for (long i = 0; i < (long)WIDTH * HEIGHT; i++) {
+        n += memcmp(a + i * 4, b + i * 4, 4) != 0;
+    }
+    return n;
+}
+
+static uint8_t reference[WIDTH * HEIGHT * 4];
+
+typedef struct {
+    const char *name;
+    int threads;        /* gl_set_render_threads */
+    int async;          /* gl_set_async */
+    int uploads;        /* gl_set_texture_upload_threads */
+} render_mode_t;
+
+static const render_mode_t modes[] = {
+    { "threads=2", 2, 0, 0 },
+    { "threads=4", 4, 0, 0 },
+    { "async", 0, 1, 0 },
+    { "async threads=4", 4, 1, 0 },
+    { "async threads=4 uploads=2", 4, 1, 2 },
+};
+
+/* Render with a mode on a new context current on the calling thread; 0 differing pixels
+ * from the reference is a pass */
+static long render_mode(const render_mode_t *m, GLState *share)
+{
+    GLState *c = gl_create_context_shared(WIDTH, HEIGHT, share);
+    if (!c) return -1;
+    gl_make_current(c);
+    gl_set_render_threads(c, m->threads);
+    if (m->uploads) gl_set_texture_upload_threads(c, m->uploads);
+    if (m->async) gl_set_async(c, 1);
+
+    uint8_t *pixels = malloc(WIDTH * HEIGHT * 4);
+    scene_objects_t o = scene_objects_create();
+    render(&o, pixels);
+    long diff = count_differences(reference, pixels);
+
+    free(pixels);
+    gl_destroy_context(c);
+    gl_make_current(NULL);
+    return diff;
+}
+
+static void check_modes(void)
+{
+    GLState *c = gl_create_context(WIDTH, HEIGHT);
+    gl_make_current(c);
+    scene_objects_t o = scene_objects_create();
+    render(&o, reference);
+    gl_destroy_context(c);
+    gl_make_current(NULL);
+
+    /* Guard against comparing empty frames: most pixels differ from the clear color */
+    long drawn = 0;
+    for (long i = 0; i < (long)WIDTH * HEIGHT; i++) {
+        drawn += memcmp(reference + i * 4, reference, 4) != 0;
+    }
+    check(drawn > (long)WIDTH * HEIGHT / 2, "immediate mode reference frame has the scene drawn");
+
+    char what[128];
+    for (size_t i = 0; i < sizeof(modes) / sizeof(modes[0]); i++) {
+        long diff = render_mode(&modes[i], NULL);
+        snprintf(what, sizeof(what), "%s matches immediate mode (%ld pixels differ)", modes[i].name, diff);
+        check(diff == 0, what);
+    }
+}
+
+/* Several threads rendering at once, each with its own mode */
+typedef struct {
+    const render_mode_t *mode;
+    long diff;
+} mode_job_t;
+
+static void *mode_thread(void *arg)
+{
+    mode_job_t *job = arg;
+    job->diff = render_mode(job->mode, NULL);
+    return NULL;
+}
+
+static void check_concurrent_modes(void)
+{
+    enum { COUNT = sizeof(modes) / sizeof(modes[0]) };
+    pthread_t threads[COUNT];
+    mode_job_t jobs[COUNT];
+    for (int i = 0; i < COUNT; i++) {
+        jobs[i].mode = &modes[i];
+        pthread_create(&threads[i], NULL, mode_thread, &jobs[i]);
+    }
+    int ok = 1;
+    for (int i = 0; i < COUNT; i++) {
+        pthread_join(threads[i], NULL);
+        ok &= jobs[i].diff == 0;
+    }
+    check(ok, "all modes rendering concurrently match immediate mode");
+}
+
+static void check_fence_after_destroy(void)
+{
+    GLState *a = gl_create_context(WIDTH, HEIGHT);
+    GLState *b = gl_create_context(WIDTH, HEIGHT);
+
+    gl_make_current(a);
+    gl_set_render_threads(a, 2);
+    gl_set_async(a, 1);
+    scene_objects_t o = scene_objects_create();
+    draw_scene(&o, 0);
+    GLsync fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    gl_destroy_context(a);
+
+    gl_make_current(b);
+    GLenum result = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000ull);
+    check(result == GL_ALREADY_SIGNALED || result == GL_CONDITION_SATISFIED,
+          "fence of a destroyed context is signaled and can be waited on");
+    check(glIsSync(fence) == GL_TRUE, "fence of a destroyed context is still a sync object");
+    glDeleteSync(fence);
+    check(glGetError() == GL_NO_ERROR && glIsSync(fence) == GL_FALSE, "deleted fence is no longer a sync object");
+    glDeleteSync(fence);
+    check(glGetError() == GL_INVALID_VALUE, "deleting a fence twice is GL_INVALID_VALUE");
+
+    gl_destroy_context(b);
+    gl_make_current(NULL);
+}
+
+/* Context B waits on the GPU side (glWaitSync) for a fence of context A */
+typedef struct {
+    GLState *share;
+    GLsync wait_for;
+    int pending;            /* wait_for had not signaled yet when B queued the wait */
+    int signaled_first;     /* wait_for had signaled when B's own fence did */
+} wait_job_t;
+
+static void *wait_thread(void *arg)
+{
+    wait_job_t *job = arg;
+    GLState *b = gl_create_context_shared(WIDTH, HEIGHT, job->share);
+    gl_make_current(b);
+    gl_set_async(b, 1);
+
+    job->pending = glClientWaitSync(job->wait_for, 0, 0) == GL_TIMEOUT_EXPIRED;
+    glWaitSync(job->wait_for, 0, GL_TIMEOUT_IGNORED);
+    glClear(GL_COLOR_BUFFER_BIT);
+    GLsync own = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    glClientWaitSync(own, GL_SYNC_FLUSH_COMMANDS_BIT, GL_TIMEOUT_IGNORED);
+    job->signaled_first = glClientWaitSync(job->wait_for, 0, 0) == GL_ALREADY_SIGNALED;
+    glDeleteSync(own);
+
+    gl_destroy_context(b);
+    gl_make_current(NULL);
+    return NULL;
+}
+
+static void check_wait_sync(void)
+{
+    GLState *a = gl_create_context(WIDTH, HEIGHT);
+    gl_make_current(a);
+    gl_set_async(a, 1);
+    scene_objects_t o = scene_objects_create();
+    /* Enough queued work that the fence is usually still pending when B waits */
+    for (int frame = 0; frame < 40; frame++) {
+        draw_scene(&o, frame);
+    }
+
+    wait_job_t job = { a, glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0), 0, 0 };
+    pthread_t thread;
+    pthread_create(&thread, NULL, wait_thread, &job);
+    pthread_join(thread, NULL);
+    check(job.signaled_first, job.pending ?
+          "glWaitSync makes another context's render thread wait for the fence" :
+          "glWaitSync on another context (fence had already signaled)");
+
+    glDeleteSync(job.wait_for);
+    gl_destroy_context(a);
+    gl_make_current(NULL);
+}
+
+/* Pool shared by the worker threads of check_pool */
+typedef struct {
+    struct context_pool *pool;
+    scene_objects_t objects;
+    int failures;
+} pool_job_t;
+
+static void *pool_thread(void *arg)
+{
+    pool_job_t *job = arg;
+    uint8_t *pixels = malloc(WIDTH * HEIGHT * 4);
+    for (int i = 0; i < POOL_ITERATIONS; i++) {
+        GLState *c = gl_context_pool_acquire(job->pool, NULL);
+        if (!c) {
+            __sync_fetch_and_add(&job->failures, 1);
+            continue;
+        }
+        gl_make_current(c);
+        render(&job->objects, pixels);
+        if (count_differences(reference, pixels) != 0) __sync_fetch_and_add(&job->failures, 1);
+        gl_make_current(NULL);
+        if (gl_context_pool_release(job->pool, c) != 0) __sync_fetch_and_add(&job->failures, 1);
+    }
+    free(pixels);
+    return NULL;
+}
+
+static void check_pool(void)
+{
+    /* The pool keeps the share group of a context that is destroyed right away */
+    GLState *share = gl_create_context(WIDTH, HEIGHT);
+    gl_make_current(share);
+    pool_job_t job = { NULL, scene_objects_create(), 0 };
+    struct context_pool *pool = gl_context_pool_create(WIDTH, HEIGHT, 2, share);
+    gl_destroy_context(share);
+    gl_make_current(NULL);
+    job.pool = pool;
+
+    GLState *a = gl_context_pool_acquire(pool, NULL);
+    GLState *b = gl_context_pool_acquire(pool, NULL);
+    GLState *foreign = gl_create_context(WIDTH, HEIGHT);
+    check(a && b && a != b, "pool hands out distinct contexts after its share context is destroyed");
+    check(gl_context_pool_release(pool, foreign) == -1, "pool rejects a context it did not create");
+    check(gl_context_pool_release(pool, a) == 0, "pool takes back an acquired context");
+    check(gl_context_pool_release(pool, a) == -1, "pool rejects a double release");
+    check(gl_context_pool_acquire(pool, foreign) == NULL, "pool rejects a template from another share group");
+    GLState *copy = gl_context_pool_acquire(pool, b);
+    check(copy != NULL, "pool accepts a template from its share group");
+    gl_context_pool_release(pool, copy);
+    gl_context_pool_release(pool, b);
+    gl_destroy_context(foreign);
+
+    /* More threads than contexts: acquire blocks until one is released */
+    pthread_t threads[POOL_THREADS];
+    for (int i = 0; i < POOL_THREADS; i++) {
+        pthread_create(&threads[i], NULL, pool_thread, &job);
+    }
+    for (int i = 0; i < POOL_THREADS; i++) {
+        pthread_join(threads[i], NULL);
+    }
+    check(job.failures == 0, "pooled contexts under contention render the reference image");
+    gl_context_pool_destroy(pool);
+}
+
+int main(void)
+{
+    scene_data_init();
+    check_modes();
+    check_concurrent_modes();
+    check_fence_after_destroy();
+    check_wait_sync();
+    check_pool();
+
+    if (failures) {
+        printf("%d check(s) failed\n", failures);
+        return 1;
+    }
+    printf("All checks passed\n");
+    return 0;
+}